@@ -24,42 +24,126 @@ limitations under the License.
 #include "LC_ADC.h"
 #endif
 #include "AudioRenderer.h" 
+#include "FilterBank.h"
+#include "AutoGain.h"
+#include "OnsetDetector.h"
+#include "FrameQueue.h"
+#include "Telemetry.h"
 #include "EEPROM.h"
+#ifndef __MKL26Z64__
+#include "FixedFFT.h"
+#include "MultirateAnalyzer.h"
+
+// Where the magnitudes an FFT object leaves in output[] sit in frequency
+template<class FFT>
+struct FFTSpectrum {
+	typedef typename FFT::Spectrum type;
+};
+
+template<>
+struct FFTSpectrum<AudioAnalyzeFFT1024> {
+	typedef UniformSpectrum<512, AUDIO_SAMPLE_RATE_MHZ> type;
+};
+#endif
 
 #define MAX_FFT_HZ ((float)AUDIO_SAMPLE_RATE/2.0)
 #define FFT_BIN_SIZE_HZ (MAX_FFT_HZ / (float)FFT_OUTPUT_SIZE)
 #define HZ_TO_NEAREST_FFT_BIN(h) (round((float)h/FFT_BIN_SIZE_HZ))
 
-template<int FREQ_BINS = 8, int MAX_VISUALIZERS = 16, int BUILD_NUM = 0x01>
+// REDUCE_KERNEL sums the spectrum into display bins, see ReduceKernel.h.
+// FFT is the analyzer to read: the Audio library's AudioAnalyzeFFT1024 or
+// an FFTAnalyzer of another size (see FixedFFT.h) or a MultirateAnalyzer
+// for finer bass (see MultirateAnalyzer.h). The Teensy LC always
+// reads its own LCAnalyzeFFT.
+//
+// With CHANNELS above 1 there is an FFT per channel, all reduced against
+// the one bin map: every band is summed for all channels in one pass over
+// their spectra side by side, into sums interleaved by channel. Each frame
+// then has an output per channel plus a mid and a side output, and
+// renderers connect to the one they draw. The analyzers only give
+// magnitudes, so mid is the mean of the channels' bin sums and side half
+// their spread (|L - R| / 2 in stereo): a level difference, not the
+// spectrum of L - R. For true mid/side, mix those signals with the Audio
+// library and analyze them as channels.
+//
+// MAX_VISUALIZERS is how many renderers connectAudioRenderer() takes, each
+// called through AudioRenderer's virtual update(). Renderers known at
+// compile time can be passed to analyzeData() as a RendererSet instead,
+// and with MAX_VISUALIZERS at 0 the slots cost nothing.
+//
+// MAX_WEIGHTS sizes the filterbank's pool of Triangle, Mel and Bark
+// weights, one per FFT bin a weighted band reads; a band that doesn't fit
+// is summed flat. A half-overlapping mel layout over FFT1024 reads about
+// 850 at 8 bins. With only Flat bins it can be 0.
+#ifndef __MKL26Z64__
+template<int FREQ_BINS = 8, int MAX_VISUALIZERS = 16, int BUILD_NUM = 0x01, class REDUCE_KERNEL = DefaultReduceKernel, class FFT = AudioAnalyzeFFT1024, int CHANNELS = 1, int MAX_WEIGHTS = FREQ_BINS * 32>
+#else
+template<int FREQ_BINS = 8, int MAX_VISUALIZERS = 16, int BUILD_NUM = 0x01, class REDUCE_KERNEL = DefaultReduceKernel, class FFT = LCAnalyzeFFT, int CHANNELS = 1, int MAX_WEIGHTS = FREQ_BINS * 32>
+#endif
 class AudioProcessor
 {
 public:
+	// frames analyzeData() can run ahead of renderQueued()
+	static const int FRAME_QUEUE_SIZE = 4;
+	// outputs for connectAudioRenderer(): the channels, then mid and side
+	static const int OUTPUTS = CHANNELS > 1 ? CHANNELS + 2 : 1;
+	static const int MID = CHANNELS;
+	static const int SIDE = CHANNELS + 1;
+
+	// One frame of every output
+	struct Frame {
+		FFTBinData<FREQ_BINS> outputs[OUTPUTS];
+	};
+	typedef FrameQueue<Frame, FRAME_QUEUE_SIZE> Queue;
+
 #ifndef __MKL26Z64__
-	AudioProcessor(AudioAnalyzeFFT1024  & myFFT) : myFFT(myFFT) {
+	typedef typename FFTSpectrum<FFT>::type Spectrum;
+	static const int SPECTRUM_SIZE = Spectrum::SIZE;
+
+	AudioProcessor(FFT  & myFFT) : queued(false), telemetry(NULL) {
+		static_assert(CHANNELS == 1, "pass one FFT per channel");
+		ffts[0] = &myFFT;
 		for(int i = 0; i < MAX_VISUALIZERS; i++)
 			visualizer[i] = NULL;
 	}
-	AudioProcessor(AudioAnalyzeFFT1024  * myFFT, bool uniformScale) : myFFT(myFFT), uniformScale(uniformScale) {
+	AudioProcessor(FFT  * myFFT, bool uniformScale) : queued(false), telemetry(NULL) {
+		static_assert(CHANNELS == 1, "pass one FFT per channel");
+		ffts[0] = myFFT;
+		for(int i = 0; i < MAX_VISUALIZERS; i++)
+			visualizer[i] = NULL;
+		setUniformScale(uniformScale);
+	}
+	// The analyzer of each channel, fed from the same audio graph so that
+	// their frames land together
+	AudioProcessor(FFT * const (&channelFFTs)[CHANNELS]) : queued(false), telemetry(NULL) {
+		for(int c = 0; c < CHANNELS; c++)
+			ffts[c] = channelFFTs[c];
 		for(int i = 0; i < MAX_VISUALIZERS; i++)
 			visualizer[i] = NULL;
 	}
 #else
-	AudioProcessor(int inputPin, int averaging=8, int resolution=12, uint8_t analogReferenceType = INTERNAL) {
+	static_assert(CHANNELS == 1, "the Teensy LC analyzes one channel");
+
+	typedef UniformSpectrum<FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ> Spectrum;
+	static const int SPECTRUM_SIZE = Spectrum::SIZE;
+
+	AudioProcessor(int inputPin, int averaging=8, int resolution=12, uint8_t analogReferenceType = INTERNAL) : queued(false), telemetry(NULL) {
 		myFFT.init(inputPin, averaging, resolution, analogReferenceType);
 		myFFT.enable();
 		for(int i = 0; i < MAX_VISUALIZERS; i++)
 			visualizer[i] = NULL;
 	}
 #endif
-	void init(DisplayBin * bins) {
+	void init(const DisplayBin * bins) {
 #ifdef __MKL26Z64__
 		calibrateADC();
 #endif
 		enableDebugFFT = false;
 		enableDebugAutoscale = false;
 
-		for(int i = 0; i < FREQ_BINS; i++)
-			autoScaleValue[i] = INITIAL_AUTOSCALE;
+		autoGain.setMinimumScale(SCALE_ONE);
+		autoGain.reset(INITIAL_AUTOSCALE);
+		lastFrameMicros = micros();
 		configureBins(bins);
 	}
 #ifdef __MKL26Z64__
@@ -91,16 +175,104 @@ public:
 	}
 #endif
 
-	void configureBins(DisplayBin * bins) {
-		for(int i = 0; i < FREQ_BINS; i++) {
-			BIN_SUM_COUNTS[i]= bins[i].endFFTBin - bins[i].startFFTBin;
+	// Compiles the FFT bin ranges and weightings of bins into the filterbank,
+	// and lets the analyzer skip the FFT bins no display bin reads
+	void configureBins(const DisplayBin * bins) {
+		filterBank.template configure<Spectrum>(bins);
+#ifndef __MKL26Z64__
+		for(int c = 0; c < CHANNELS; c++)
+			selectFFTBins(*ffts[c], bins, FREQ_BINS);
+#endif
+	}
+
+	FilterBank<FREQ_BINS, MAX_WEIGHTS, REDUCE_KERNEL> & getFilterBank() {
+		return filterBank;
+	}
+
+	// Attack and release time constants of the autoscale, in milliseconds
+	void setAutoScaleTimes(uint16_t attackMs, uint16_t releaseMs) {
+		autoGain.setTimes(attackMs, releaseMs);
+	}
+
+	// Bins whose filterbank sum is below level keep their scale
+	void setNoiseGate(uint32_t level) {
+		autoGain.setNoiseFloor(level);
+	}
+
+	// Scales every bin, of every output, by the loudest one's autoscale
+	// instead of its own
+	void setUniformScale(bool uniform) {
+		autoGain.setLinked(uniform);
+	}
+
+	// One gain per display bin of each output, output by output
+	AutoGain<FREQ_BINS * OUTPUTS> & getAutoGain() {
+		return autoGain;
+	}
+
+	// Runs on the mid output, or the only one, and its onsets and beats are
+	// copied to every output
+	OnsetDetector<FREQ_BINS> & getOnsetDetector() {
+		return onsetDetector;
+	}
+
+	// Publishes each frame to a queue instead of rendering it, so that
+	// analyzeData() can run from an interrupt or a thread of its own while
+	// loop() calls renderQueued(). Set it before analysis starts.
+	void setQueued(bool queued) {
+		this->queued = queued;
+	}
+
+	bool isQueued() {
+		return queued;
+	}
+
+	// Renders the newest queued frame, skipping any older ones, or renders
+	// NULL if none came in. Returns true on a new frame.
+	bool renderQueued() {
+		RendererSet<FREQ_BINS> none;
+		return renderQueued(none);
+	}
+
+	// As renderQueued(), but renders with renderers as well (see
+	// analyzeData(renderers)).
+	template<class RENDERERS>
+	bool renderQueued(RENDERERS & renderers) {
+		if(frames.popLatest(renderFrame)) {
+			visualize(&renderFrame, renderers);
+			return true;
 		}
+		visualize(NULL, renderers);
+		return false;
 	}
 
-	bool connectAudioRenderer(AudioRenderer<FREQ_BINS> * visualizer) {
+	Queue & getFrameQueue() {
+		return frames;
+	}
+
+	// Writes the records in mask (see Telemetry.h) into ring on every
+	// frame, for the caller to drain to the serial port, in place of the
+	// debug text. NULL stops them.
+	void setTelemetry(TelemetryRing * ring, uint8_t mask = TELEMETRY_DEFAULT) {
+		telemetry = ring;
+		telemetryMask = mask;
+	}
+
+	TelemetryRing * getTelemetry() {
+		return telemetry;
+	}
+
+	// Whether record goes to the telemetry ring
+	bool isLogging(TelemetryRecord record) {
+		return telemetry != NULL && (telemetryMask & TELEMETRY_MASK(record));
+	}
+
+	// Renders output (a channel, MID or SIDE) with visualizer
+	bool connectAudioRenderer(AudioRenderer<FREQ_BINS> * visualizer, int output = 0) {
 		for(int i = 0; i <MAX_VISUALIZERS; i++)
 			if(this->visualizer[i] == NULL) {
 				this->visualizer[i] = visualizer;
+				visualizerOutput[i] = constrain(output, 0, OUTPUTS - 1);
 				return true;
 				}
 		return false;
@@ -108,113 +280,245 @@ public:
 
 
 
+	// Analyzes a new frame, if there is one, and renders it with the
+	// connected renderers or queues it. Returns the average bin sum, or -1
+	// if no frame came in.
 	int analyzeData(float scale =-1.0f) {
-		if (myFFT.available()) {
-			uint16_t sums[FREQ_BINS];
-			memset(sums, 0, FREQ_BINS*sizeof(uint16_t));
-			int peak = 0;
-			int n=0;
-			int count=0;
-			int avg = 0;
-			if(enableDebugFFT)
+		RendererSet<FREQ_BINS> none;
+		return analyzeData(none, scale);
+	}
+
+	// As analyzeData(), but renders output 0 with renderers as well, a
+	// RendererSet whose updates are inlined here. With MAX_VISUALIZERS at 0
+	// they are all there is to render, and no slots are kept or scanned.
+	template<class RENDERERS>
+	int analyzeData(RENDERERS & renderers, float scale =-1.0f) {
+		if (channelFFT(0).available()) {
+			AUDIO_PROFILE_END(ProfileFFTWait);
+			// the other channels' frames come in the same audio update
+			for(int c = 1; c < CHANNELS; c++)
+				channelFFT(c).available();
+			uint32_t sums[FREQ_BINS * OUTPUTS];
+			bool autoScale = scale < 0.0f;
+			scale_t manualScale = 0;
+			if(!autoScale) {
+#if FIXED_POINT_MATH
+				manualScale = max(1, (int)(scale * SCALE_ONE));
+#else
+				manualScale = scale;
+#endif
+			}
+			if(isLogging(TelemetrySpectrum))
+				logSpectrum();
+			else if(enableDebugFFT) {
 				Serial.println("FFT:");
-			for (int i=0; i<FFT_OUTPUT_SIZE; i++) {
-				sums[n] = sums[n] + myFFT.output[i];
-				if(enableDebugFFT) {
-					Serial.printf("[%2u]",myFFT.output[i]);
-				}
-				count++;
-				if (count >= BIN_SUM_COUNTS[n]) {
-					if(enableDebugFFT)
-						Serial.printf("\nFilled bin %2u, value: %6u\n", n, sums[n]);
-					avg += sums[n]/FREQ_BINS;
-					n++;
-					if (n >= FREQ_BINS) 
-						break;
-					count = 0;
-				}
+				for (int i=0; i<SPECTRUM_SIZE; i++)
+					Serial.printf("[%2u]",channelFFT(0).output[i]);
+				Serial.println();
+			}
+			int avg;
+			{
+				AUDIO_PROFILE(ProfileReduce);
+				// sums are 32 bit all the way through; wide bands used to wrap at 16
+				avg = reduce(sums) / (FREQ_BINS * CHANNELS);
 			}
-			if(enableDebugFFT)
+			AUDIO_PROFILE_BEGIN(ProfileAutoscale);
+			uint32_t now = micros();
+			if(autoScale)
+				autoGain.update(sums, now - lastFrameMicros);
+			const int beatOutput = CHANNELS > 1 ? MID : 0;
+			FFTBinData<FREQ_BINS> & beats = frame.outputs[beatOutput];
+			onsetDetector.update(sums + beatOutput * FREQ_BINS, now - lastFrameMicros, beats);
+			lastFrameMicros = now;
+			// the scale of each sum in Q8.8, for the telemetry
+			uint32_t scales[FREQ_BINS * OUTPUTS];
+			const bool logScale = isLogging(TelemetryScale);
+			if(enableDebugFFT && telemetry == NULL) {
+				for(int n = 0; n < FREQ_BINS; n++)
+					Serial.printf("Filled bin %2u, value: %6lu\n", n, (unsigned long)sums[n]);
 				Serial.println();
+			}
 
-			for(int i = 0 ; i<FREQ_BINS; i++) {
-				float rScale;
-				if(scale < 0.0f)
-					rScale = autoScaleValue[i];
-				else
-					rScale = scale;
-				data.binValues[i] = min(MAX_BIN_VALUE,max(0,sums[i]/rScale));
-				peak = (max(peak, data.binValues[i]));
-				if(enableDebugAutoscale) {
-					Serial.printf("Freq Bin %2u: [Value: %3u, Scale: ",i, sums[i]);
-					// no printf float support!
-					Serial.print(rScale);
-					Serial.printf(", Scaled Value: %3u]\n", data.binValues[i]);
+			for(int o = 0; o < OUTPUTS; o++) {
+				FFTBinData<FREQ_BINS> & data = frame.outputs[o];
+				int peak = 0;
+				for(int i = 0 ; i<FREQ_BINS; i++) {
+					int n = o * FREQ_BINS + i;
+					scale_t rScale;
+					if(autoScale) {
+#if FIXED_POINT_MATH
+						rScale = autoGain.scale(n);
+#else
+						rScale = autoGain.scale(n) / (float)SCALE_ONE;
+#endif
+					}
+					else
+						rScale = manualScale;
+					if(logScale)
+						scales[n] = autoScale ? autoGain.scale(n) : (uint32_t)(scale * SCALE_ONE);
+#if FIXED_POINT_MATH
+					// shifting a sum of 2^24 or more up by the fraction bits would overflow
+					uint32_t scaled;
+					if(sums[n] < ((uint32_t)1 << (32 - SCALE_FRACTION_BITS)))
+						scaled = (sums[n] << SCALE_FRACTION_BITS) / rScale;
+					else
+						scaled = sums[n] / max((scale_t)1, rScale >> SCALE_FRACTION_BITS);
+					data.binValues[i] = min((uint32_t)MAX_BIN_VALUE, scaled);
+#else
+					data.binValues[i] = min(MAX_BIN_VALUE, sums[n]/rScale);
+#endif
+					peak = (max(peak, data.binValues[i]));
+					if(enableDebugAutoscale && telemetry == NULL) {
+						Serial.printf("Freq Bin %2u: [Value: %3lu, Scale: ",i, (unsigned long)sums[n]);
+						// no printf float support!
+#if FIXED_POINT_MATH
+						Serial.print(rScale / (float)SCALE_ONE);
+#else
+						Serial.print(rScale);
+#endif
+						Serial.printf(", Scaled Value: %3u]\n", data.binValues[i]);
+					}
+				}
+				data.setPeak(peak);
+				if(o != beatOutput) {
+					data.onset = beats.onset;
+					data.onsetStrength = beats.onsetStrength;
+					data.beat = beats.beat;
+					data.beatPhase = beats.beatPhase;
+					data.tempo = beats.tempo;
 				}
 			}
-			if(enableDebugAutoscale)
+			if(enableDebugAutoscale && telemetry == NULL)
 				Serial.println();
-			data.setPeak(peak);
-			if(scale < 0.0f)
-				updateAutoScale(data);
-			visualize(&data);
+			AUDIO_PROFILE_END(ProfileAutoscale);
+			if(logScale)
+				logScales(now, sums, scales);
+			if(isLogging(TelemetryBins))
+				logBins(now, frame);
+			if(queued)
+				frames.push(frame);
+			else
+				visualize(&frame, renderers);
+			AUDIO_PROFILE_BEGIN(ProfileFFTWait);
 			return avg;
 		}
 		else {
-			visualize(NULL);
+			if(!queued)
+				visualize(NULL, renderers);
 			return -1;
 		}
 	}
 
-	void visualize(FFTBinData<FREQ_BINS> * data) {
+	// Renders frame, or NULL between frames, with the connected renderers
+	void visualize(Frame * frame) {
+		if(MAX_VISUALIZERS == 0)
+			return;
+		AUDIO_PROFILE(ProfileConnected);
 		for(int i = 0; i < MAX_VISUALIZERS; i++)
 			if(visualizer[i] != NULL)
-				visualizer[i]->update(data);
+				visualizer[i]->update(frame ? &frame->outputs[visualizerOutput[i]] : NULL);
+	}
+
+	// Renders output 0 of frame with renderers, then with the connected ones
+	template<class RENDERERS>
+	void visualize(Frame * frame, RENDERERS & renderers) {
+		renderers.update(frame ? &frame->outputs[0] : NULL);
+		visualize(frame);
 	}
 
 	// debug flags
 	bool enableDebugFFT;
 	bool enableDebugAutoscale;
 private:
-	const float AUTOSCALE_INCREMENT = 0.1f;
+#if FIXED_POINT_MATH
+	// Q8.8
+	typedef uint32_t scale_t;
+#else
+	typedef float scale_t;
+#endif
+	// Q8.8, the autoscale runs on fixed point either way
+	const uint32_t INITIAL_AUTOSCALE = 4*SCALE_ONE;
     const int MAX_BIN_VALUE = _BV(RESOLUTION)-1;
-	const int HALF_MAX_BIN_VALUE = MAX_BIN_VALUE/4;
-	const float INITIAL_AUTOSCALE = 4;
-	const float MINIMUM_SCALE = 1;
 	
 #ifndef __MKL26Z64__
-	AudioAnalyzeFFT1024  & myFFT;
+	FFT * ffts[CHANNELS];
+
+	FFT & channelFFT(int c) {
+		return *ffts[c];
+	}
 #else
-	LCAnalyzeFFT  myFFT;
+	FFT  myFFT;
+
+	FFT & channelFFT(int) {
+		return myFFT;
+	}
 #endif
-	FFTBinData<FREQ_BINS> data;
+	bool queued;
+	Frame frame;
+	Queue frames;
+	// the consumer's copy of the frame it renders
+	Frame renderFrame;
+	// zero length when MAX_VISUALIZERS is 0
 	AudioRenderer<FREQ_BINS> * visualizer[MAX_VISUALIZERS];
-	int BIN_SUM_COUNTS[FREQ_BINS];
-	float autoScaleValue[FREQ_BINS];
-	bool uniformScale;
+	uint8_t visualizerOutput[MAX_VISUALIZERS];
+	FilterBank<FREQ_BINS, MAX_WEIGHTS, REDUCE_KERNEL> filterBank;
+	AutoGain<FREQ_BINS * OUTPUTS> autoGain;
+	OnsetDetector<FREQ_BINS> onsetDetector;
+	uint32_t lastFrameMicros;
+	TelemetryRing * telemetry;
+	uint8_t telemetryMask;
 
+	void logSpectrum() {
+		TelemetryFields fields;
+		fields.u32(micros()).u16(SPECTRUM_SIZE);
+		telemetry->write(TelemetrySpectrum, fields.data(), fields.size(), channelFFT(0).output, SPECTRUM_SIZE * sizeof(uint16_t));
+	}
 
+	void logScales(uint32_t now, const uint32_t * sums, const uint32_t * scales) {
+		const int count = FREQ_BINS * OUTPUTS;
+		TelemetryFields fields;
+		fields.u32(now).u16(count);
+		uint32_t values[count * 2];
+		memcpy(values, sums, sizeof(uint32_t) * count);
+		memcpy(values + count, scales, sizeof(uint32_t) * count);
+		telemetry->write(TelemetryScale, fields.data(), fields.size(), values, sizeof(values));
+	}
 
-	// autoscale is pretty dumb -- we're aiming for values in the range 0-_BV(RESOLUTION). 
-	// lets assume that the last autoscale value was pretty good, 
-	// if most of the values are over halfway, lets increment a bit. If most of them are under halfway, lets decrement a bit.
-	// increment faster for clipped values
-	void updateAutoScale(FFTBinData<FREQ_BINS> & data) {
+	void logBins(uint32_t now, const Frame & frame) {
+		for(int o = 0; o < OUTPUTS; o++) {
+			const FFTBinData<FREQ_BINS> & data = frame.outputs[o];
+			TelemetryFields fields;
+			fields.u32(now).u8(o).u8(FREQ_BINS).u8(data.peak).u8((data.onset ? 1 : 0) | (data.beat ? 2 : 0))
+				.u8(data.onsetStrength).u8(data.beatPhase).u8(data.tempo);
+			telemetry->write(TelemetryBins, fields.data(), fields.size(), data.binValues, FREQ_BINS);
+		}
+	}
+
+	// Fills sums[o * FREQ_BINS + i] for display bin i of output o. Returns
+	// the total over the channels.
+	uint32_t reduce(uint32_t * sums) {
+		if(CHANNELS == 1)
+			return filterBank.apply(channelFFT(0).output, sums);
+		const uint16_t * spectra[CHANNELS];
+		for(int c = 0; c < CHANNELS; c++)
+			spectra[c] = channelFFT(c).output;
+		uint32_t channelSums[FREQ_BINS * CHANNELS];
+		uint32_t total = filterBank.template applyChannels<CHANNELS>(spectra, channelSums);
 		for(int i = 0; i < FREQ_BINS; i++) {
-			if(data.binValues[i] < HALF_MAX_BIN_VALUE) {
-				if(autoScaleValue[i] >= AUTOSCALE_INCREMENT && autoScaleValue[i] > MINIMUM_SCALE)
-					autoScaleValue[i] -= AUTOSCALE_INCREMENT;
-				else
-					autoScaleValue[i] = MINIMUM_SCALE;
+			const uint32_t * bin = channelSums + CHANNELS * i;
+			uint32_t all = 0, low = bin[0], high = bin[0];
+			for(int c = 0; c < CHANNELS; c++) {
+				sums[c * FREQ_BINS + i] = bin[c];
+				all += bin[c];
+				low = min(low, bin[c]);
+				high = max(high, bin[c]);
 			}
-			else if (data.binValues[i] > HALF_MAX_BIN_VALUE) {
-				if(data.binValues[i] >= MAX_BIN_VALUE) {
-					autoScaleValue[i] += 4*AUTOSCALE_INCREMENT;
-				}
-				autoScaleValue[i] += AUTOSCALE_INCREMENT;
-				
+			if(OUTPUTS > CHANNELS) {
+				sums[MID * FREQ_BINS + i] = all / CHANNELS;
+				sums[SIDE * FREQ_BINS + i] = (high - low) / 2;
 			}
 		}
+		return total;
 	}
 	};
 
@@ -19,7 +19,9 @@ limitations under the License.
 
 #include "FastLED.h"
 #include "AudioStructures.h"
+#include "TransferCurve.h"
 #include "hsv2rgb.h"
+#include "Profiler.h"
 
 //#define PRINT_DEBUG
 template<int DISPLAY_BINS>
@@ -28,64 +30,245 @@ public:
 	virtual void update(FFTBinData<DISPLAY_BINS> * data) = 0;
 };
 
+// A fixed set of renderers for AudioProcessor::analyzeData(renderers). Each
+// is updated in turn by a direct call on its own class, which the compiler
+// can inline, instead of through the virtual update() of a connected
+// pointer. Holds references, so the renderers must outlive the set.
+template<int DISPLAY_BINS, class... RENDERERS>
+class RendererSet;
+
 template<int DISPLAY_BINS>
+class RendererSet<DISPLAY_BINS> {
+public:
+	void update(FFTBinData<DISPLAY_BINS> *, int = 0) {
+	}
+};
+
+template<int DISPLAY_BINS, class FIRST, class... REST>
+class RendererSet<DISPLAY_BINS, FIRST, REST...> {
+public:
+	RendererSet(FIRST & first, REST &... rest) : first(first), rest(rest...) {
+	}
+
+	// index is where first is in the set, for its profile stage
+	void update(FFTBinData<DISPLAY_BINS> * data, int index = 0) {
+		{
+			AUDIO_PROFILE(ProfileRenderer + min(index, ProfileRendererLast - ProfileRenderer));
+			first.FIRST::update(data);
+		}
+		rest.update(data, index + 1);
+	}
+
+private:
+	FIRST & first;
+	RendererSet<DISPLAY_BINS, REST...> rest;
+};
+
+// Deduces the renderer types: auto set = rendererSet<8>(strip, meter);
+template<int DISPLAY_BINS, class... RENDERERS>
+RendererSet<DISPLAY_BINS, RENDERERS...> rendererSet(RENDERERS &... renderers) {
+	return RendererSet<DISPLAY_BINS, RENDERERS...>(renderers...);
+}
+
+// The fade brightness of every pixel on the strip. With MAX_LEDS set the
+// array is part of the renderer; at 0 the strip length is only known at
+// init(), and the array comes from the heap and is reused by later calls.
+// fit() is how many of a strip's LEDs the state can hold.
+template<int MAX_LEDS>
+class PixelState {
+public:
+	int fit(int numLeds) const {
+		return min(numLeds, MAX_LEDS);
+	}
+	uint8_t * allocate(int) {
+		return brightness;
+	}
+private:
+	uint8_t brightness[MAX_LEDS];
+};
+
+template<>
+class PixelState<0> {
+public:
+	PixelState() : brightness(NULL), capacity(0) {
+	}
+	~PixelState() {
+		delete[] brightness;
+	}
+	int fit(int numLeds) const {
+		return numLeds;
+	}
+	uint8_t * allocate(int numLeds) {
+		if(numLeds > capacity) {
+			delete[] brightness;
+			brightness = new uint8_t[numLeds];
+			capacity = numLeds;
+		}
+		return brightness;
+	}
+private:
+	uint8_t * brightness;
+	int capacity;
+	PixelState(const PixelState &);
+	PixelState & operator=(const PixelState &);
+};
+
+// The fading colors, CHSV(hue8, saturation, brightness). With ENABLED each
+// brightness is converted the first time a pixel fades through it and kept
+// until clear(), which costs 800 bytes; without, every fading pixel is
+// converted as it is drawn.
+template<bool ENABLED>
+class ColorCache {
+public:
+	ColorCache() {
+		clear();
+	}
+	CRGB get(uint8_t hue8, uint8_t saturation, uint8_t brightness) {
+		uint32_t & cached = filled[brightness >> 5];
+		uint32_t bit = (uint32_t)1 << (brightness & 31);
+		if(!(cached & bit)) {
+			colors[brightness] = CHSV(hue8, saturation, brightness);
+			cached |= bit;
+		}
+		return colors[brightness];
+	}
+	void clear() {
+		memset(filled, 0, sizeof(filled));
+	}
+private:
+	CRGB colors[256];
+	// a bit per entry of colors that is filled
+	uint32_t filled[8];
+};
+
+template<>
+class ColorCache<false> {
+public:
+	CRGB get(uint8_t hue8, uint8_t saturation, uint8_t brightness) {
+		return CHSV(hue8, saturation, brightness);
+	}
+	void clear() {
+	}
+};
+
+// Draws each display bin as a bar of its LEDs in the sweeping hue, fading
+// out as the level drops. MAX_LEDS, when known, keeps all of its state
+// inside the renderer (see PixelState); init() takes at most that many.
+// COLOR_CACHE trades 800 bytes for fewer HSV conversions on long fades
+// (see ColorCache).
+template<int DISPLAY_BINS, int MAX_LEDS = 0, bool COLOR_CACHE = false>
 class LEDStripAudioRenderer : public AudioRenderer<DISPLAY_BINS>
 {
 protected:
+#if FIXED_POINT_MATH
+	// hues in Q8.24 turns of the wheel
+	typedef int32_t hue_t;
+	const hue_t FULL_TURN = HUE_ONE;
+#else
+	typedef float hue_t;
+	const hue_t FULL_TURN = 1.0f;
+#endif
 	int NUM_LEDS;
 	CRGB * leds;
 	// the begining hue of the color sweep (default 0, values [0 1))
-	float startHue;
+	hue_t startHue;
 	// the final hue of the color sweep (default 1, values (0 1])
-	float endHue;
+	hue_t endHue;
 	// The speed of the hue sweep in hue8/millisecond
-	float hueDelta;
+	hue_t hueDelta;
 	// The total amount of time to sweep the hue range
 	uint16_t hueSweepTime;
+	// How far the hue jumps on each tracked beat
+	hue_t beatHueStep;
 	// How quickly in microseconds between fade ticks
 	uint16_t fadeSpeed;
 	// How quickly in microseconds between fade ticks
 	uint16_t newValFadeSpeed;
 	// The time of the last fade tick
 	unsigned long lastFade;
-	// whether we are performing a forward color sweep (1) or backwards (0) [Datatype float to avoid excessive casting)
-	float hueSign;
+	// The time of the last tick of the bright pixels' fade
+	unsigned long lastNewValFade;
+	// The time the hue sweep was last advanced to
+	unsigned long lastHueStep;
+	// When the last analysis frame came in, and how long after the one before
+	unsigned long frameMicros;
+	unsigned long frameInterval;
+	// beat jumps of the hue not yet drawn
+	hue_t pendingHueJump;
+	// whether we are performing a forward color sweep (1) or backwards (0) [Datatype hue_t to avoid excessive casting)
+	hue_t hueSign;
 	// The current hue in the hue sweep
-	float hue;
+	hue_t hue;
+	// The current hue on the 0-255 wheel
+	uint8_t hue8;
 	// a value from 0-255 indicating how saturated we should be.
 	int saturation;
 	// the current RGB color of the strip
 	CRGB currentColor;
+	// the fading colors, cleared when the color changes
+	ColorCache<COLOR_CACHE> colors;
 
+#if FIXED_POINT_MATH
+	const int AVG_COUNT_BITS = 9;
+	const int AVG_COUNT = 1 << AVG_COUNT_BITS;
+#else
 	const float AVG_COUNT = 512;
+#endif
 	DisplayBinState binStates[DISPLAY_BINS];
+	PixelState<MAX_LEDS> pixels;
 
 
 public:
 	// enables rendering debug messages
 	bool enableDebug;
 
-	LEDStripAudioRenderer() : enableDebug(false)
+	LEDStripAudioRenderer() : beatHueStep(0), frameMicros(0), frameInterval(1), pendingHueJump(0), enableDebug(false)
 	{
 		setSpeed(2000,10000, 20000);
 		setColorSweep(0,255,255);
 	}
 
-	// Initializes the visualizer and connects to the LEDs
-	void init(CRGB * leds, int numLeds, DisplayBin * bins) {
+	// Initializes the visualizer and connects to the LEDs. Past MAX_LEDS
+	// the rest of the strip, and of any bin on it, is left dark.
+	void init(CRGB * leds, int numLeds, const DisplayBin * bins) {
+		numLeds = pixels.fit(numLeds);
 		NUM_LEDS = numLeds;
 		this->leds = leds;
+		uint8_t * brightness = pixels.allocate(numLeds);
+		memset(brightness, 0, numLeds);
+		lastFade = lastNewValFade = lastHueStep = frameMicros = micros();
 		// configure the display bins to their initial state
 		for(int i = 0; i < DISPLAY_BINS; i++) {
 			DisplayBinState * bs = &binStates[i];
 			bs->configuration = &bins[i];
-			bs->num_leds = bins[i].endLEDNum - bins[i].startLEDNum;
-			bs->leds = &leds[bins[i].startLEDNum];
-			bs->brightness = new uint8_t[bs->num_leds];
+			int start = min((int)bins[i].startLEDNum, numLeds);
+			bs->num_leds = constrain((int)bins[i].endLEDNum, start, numLeds) - start;
+			bs->barLeds = bs->num_leds;
+			bs->barOffset = 0;
+			bs->leds = &leds[start];
+			bs->curve = transferCurve(bins[i].displayFunction).table;
+			bs->brightness = brightness + start;
 			bs->value = 0;
+			bs->fromValue = 0;
+			bs->toValue = 0;
+			bs->avgV = 0;
+			bs->avgCount = 0;
 		}
 	}
 
+	// Draws bin's LEDs as the part of a longer bar of barLeds, starting
+	// offset into it, for a bar split over strips. Call after init().
+	void setBarSpan(int bin, uint8_t barLeds, uint8_t offset) {
+		binStates[bin].barLeds = barLeds;
+		binStates[bin].barOffset = offset;
+	}
+
+	// Replaces the display function of a bin with a custom curve. Call after
+	// init(); the curve must outlive the renderer (a global or constexpr).
+	void setTransferCurve(int bin, const TransferCurve & curve) {
+		binStates[bin].curve = curve.table;
+	}
+
 	CRGB * getLEDS() {
 		return leds; 
 	}
@@ -101,43 +284,74 @@ public:
 		// divide by the render resolution
 		this->fadeSpeed = (edgeFadeSpeed)/RESOLUTION;
 		this->newValFadeSpeed = (newValFadeSpeed)/RESOLUTION;
-		this->lastFade = 0;
 		this->hueSweepTime = sweepTime;
-		this->hueDelta = abs(this->endHue - this->startHue)/(float)sweepTime;
+		this->hueDelta = abs(this->endHue - this->startHue)/(hue_t)sweepTime;
 	}
 
 
+	// Jumps the hue sweep ahead by step8/255 of the wheel on every beat the
+	// processor's OnsetDetector tracks. 0 (the default) sweeps by time only.
+	void setBeatHueStep(uint8_t step8) {
+#if FIXED_POINT_MATH
+		beatHueStep = ((hue_t)step8 << HUE_FRACTION_BITS)/255;
+#else
+		beatHueStep = (float)step8/255.0f;
+#endif
+	}
+
 	// Sets the range of colors that we're using for the fade. Defaults to the whole spectrum
 	// The FastLED/pixeltypes.h HSVHue enum has some good reference values
 	// Set reverse = true if you want the hue sweep to traverse backwards around the color wheel
 	void setColorSweep(uint8_t startHue8, uint8_t endHue8, uint8_t saturation8 = 255, bool reverseWheel = false) 
 	{
 		this->saturation = saturation8;
+#if FIXED_POINT_MATH
+		this->startHue = ((hue_t)startHue8 << HUE_FRACTION_BITS)/255;
+		this->endHue = ((hue_t)endHue8 << HUE_FRACTION_BITS)/255;
+#else
 		this->startHue = (float)startHue8/255.0f;
 		this->endHue = (float)endHue8/255.0f;
+#endif
 		this->hue = startHue;
 
 		// change the endpoint relative to the wheel direction we are heading
 		if(reverseWheel) {
-			hueSign = -1.0f;
+			hueSign = -1;
 			if(startHue < endHue) {
-				endHue -= 1.0f;
+				endHue -= FULL_TURN;
 			}
 		}
 		else {
-			hueSign = 1.0f;
+			hueSign = 1;
 			if(endHue < startHue) {
-				endHue += 1.0;
+				endHue += FULL_TURN;
 			}
 		}
 
-		currentColor = CHSV(hue*255,this->saturation,255);
+		setHue8(toHue8(hue), true);
 		// recalculate the hue delta
-		this->hueDelta = abs(this->endHue - this->startHue)/(float)hueSweepTime;
+		this->hueDelta = abs(this->endHue - this->startHue)/(hue_t)hueSweepTime;
 
 	}
 
 
+#if FIXED_POINT_MATH
+	// value and result are curve outputs
+	uint32_t avgV(DisplayBinState * bs, uint32_t value) {
+		if(bs->avgCount < AVG_COUNT)
+			bs->avgCount++;
+
+		uint32_t v = value << 16;
+		uint32_t delta = v > bs->avgV ? v - bs->avgV : bs->avgV - v;
+		// once the window is full the divide is a shift
+		delta = bs->avgCount == AVG_COUNT ? delta >> AVG_COUNT_BITS : delta / bs->avgCount;
+		if(v > bs->avgV)
+			bs->avgV += delta;
+		else
+			bs->avgV -= delta;
+		return bs->avgV >> 16;
+	}
+#else
 	float avgV(DisplayBinState * bs, float value) {
 		if(bs->avgCount < AVG_COUNT)
 			bs->avgCount++;
@@ -146,97 +360,195 @@ public:
 		bs->avgV += (float)value/(float)bs->avgCount;
 		return bs->avgV;
 	}
+#endif
 
 	// Updates the strip with the spcified frequency data.
 	void update(FFTBinData<DISPLAY_BINS> * data) {
-		unsigned long currentMicros = micros();
-		unsigned long microsSinceFade = currentMicros - lastFade;
-		int fadeAmount = microsSinceFade / fadeSpeed;
-		int newValFadeAmount = microsSinceFade / newValFadeSpeed;
-		if(fadeAmount) {
-			lastFade = currentMicros;
-		}
+		update(data, micros());
+	}
+
+	// As update(), at a time the caller read, so that renderers sharing a
+	// frame (see ShardedRenderer) fade and sweep the hue in step
+	void update(FFTBinData<DISPLAY_BINS> * data, unsigned long now) {
+		if(data != NULL)
+			setFrame(data, now);
+		draw(data != NULL, false, now);
+	}
+
+	// Takes in an analysis frame without drawing it, for render() to draw.
+	void setFrame(FFTBinData<DISPLAY_BINS> * data) {
+		setFrame(data, micros());
+	}
 
+	void setFrame(FFTBinData<DISPLAY_BINS> * data, unsigned long now) {
+		// the bars fall to the new heights over the time the frame took
+		frameInterval = constrain(now - frameMicros, 1UL, 100000UL);
+		frameMicros = now;
 		for(int i = 0; i < DISPLAY_BINS; i++) {
 			DisplayBinState * bs = &binStates[i];
-			if(data != NULL) {
-				float v = bs->applyDisplayFunction(data->binValues[i]);
-				float a = avgV(bs, v)/1.25;
-				if(v > a )
-					v -= a;
-				else v = 0;
-				float m = functionMaxValue(bs->configuration->displayFunction) - (a);
-				int fV = max(0,map(v,0,m,0,255));			
-				fV= map(fV, 0, 255, 0, bs->num_leds);
-				fV = constrain(fV,0,bs->num_leds);
-				bs->value = fV;
-				if(enableDebug && i == 0 ) {
-					Serial.printf("Display %u: \n", i);
-					Serial.printf("\tinput: %3u",data->binValues[i]);
-					Serial.print("\toutput: ");
-					Serial.print(bs->applyDisplayFunction(data->binValues[i]));
-					Serial.print("\tavg: ");
-					Serial.print(a);
-					Serial.print("\toffset v: ");
-					Serial.print(v);
-					Serial.print("\tmax v: ");
-					Serial.print(m);
-					Serial.printf("\tnum leds: %u\n", fV);
-				}
+			// The curve is normalized to 0-65535 of its full scale. The offset
+			// and mapping below are scale invariant, so only its shape matters.
+			uint16_t curveValue = bs->curve[data->binValues[i]];
+#if FIXED_POINT_MATH
+			uint32_t v = curveValue;
+			// avg/1.25
+			uint32_t a = (avgV(bs, v) * 52429) >> 16;
+			if(v > a)
+				v -= a;
+			else v = 0;
+			uint32_t m = 65535 - a;
+#else
+			float v = curveValue;
+			float a = avgV(bs, v)/1.25;
+			if(v > a )
+				v -= a;
+			else v = 0;
+			float m = 65535 - a;
+#endif
+			// a is at most 80% of full scale, so m is never 0
+			int fV = v*255/m;
+			uint8_t target = min(255, fV) * bs->barLeds / 255;
+			bs->fromValue = bs->value;
+			bs->toValue = target;
+			// a rising bar shows at once, only falls glide
+			if(target >= bs->value)
+				bs->value = bs->fromValue = target;
+			if(enableDebug && i == 0 ) {
+				Serial.printf("Display %u: \n", i);
+				Serial.printf("\tinput: %3u",data->binValues[i]);
+				Serial.printf("\toutput: %5u", curveValue);
+				Serial.print("\tavg: ");
+				Serial.print(a);
+				Serial.print("\toffset v: ");
+				Serial.print(v);
+				Serial.print("\tmax v: ");
+				Serial.print(m);
+				Serial.printf("\tnum leds: %u\n", target);
 			}
-			// just update the bin so it fades
-			renderBin(bs, fadeAmount,newValFadeAmount, data != NULL);
+		}
+		if(data->beat)
+			pendingHueJump += beatHueStep;
+	}
+
+	// Draws the strip as of now, each falling bar partway from its height
+	// at the last frame to the new one, for a steady frame rate between
+	// analysis frames (see RenderScheduler).
+	void render() {
+		render(micros());
+	}
+
+	void render(unsigned long now) {
+		draw(true, true, now);
+	}
 
+	// Fades the strip by the time since the last draw and, with drawBars,
+	// lights the bars: at their targets, or gliding toward them.
+	void draw(bool drawBars, bool glide, unsigned long now) {
+		// whole fade steps, keeping the remainders, so the fades run at the
+		// set speed however often the strip is drawn
+		int fadeAmount = (now - lastFade) / fadeSpeed;
+		lastFade += fadeAmount * fadeSpeed;
+		int newValFadeAmount = (now - lastNewValFade) / newValFadeSpeed;
+		lastNewValFade += newValFadeAmount * newValFadeSpeed;
+		uint32_t hueMillis = (now - lastHueStep) / 1000;
+		lastHueStep += hueMillis * 1000;
+		unsigned long sinceFrame = min(now - frameMicros, frameInterval);
+
+		for(int i = 0; i < DISPLAY_BINS; i++) {
+			DisplayBinState * bs = &binStates[i];
+			if(drawBars) {
+				if(glide)
+					bs->value = bs->toValue + (uint32_t)(bs->fromValue - bs->toValue) * (frameInterval - sinceFrame) / frameInterval;
+				else
+					bs->value = bs->toValue;
+			}
+			renderBin(bs, fadeAmount, newValFadeAmount, drawBars);
 		}
-		updateHue(microsSinceFade/1000);
+		updateHue(hueMillis, pendingHueJump);
+		pendingHueJump = 0;
 	}
 
 	void renderBin(DisplayBinState * b, int fadeAmount, int newValFadeAmount, bool newValue) {
-		int vOffset = (b->num_leds - b->value)/2;
+		// centered on the whole bar, in this part's pixels
+		int vOffset = (b->barLeds - b->value)/2 - b->barOffset;
+		// the ends of the bar, where a part ends at a strip's end the pixel
+		// beyond is on another strip
+		bool barStart = b->barOffset == 0;
+		bool barEnd = b->barOffset + b->num_leds == b->barLeds;
 		for(int j = 0; j < b->num_leds; j++) {
 			// The current values are full bright
 			if(j > vOffset && j < (b->value+vOffset) && newValue) {
 				b->leds[j] = currentColor;
 				b->brightness[j] = 255;
 			}
-			else if(fadeAmount > 0)
+			else if(fadeAmount > 0 || newValFadeAmount > 0)
 			{
 				uint8_t & pixelBrightness = b->brightness[j];
 				if(pixelBrightness > 80 ) {
-					pixelBrightness -= newValFadeAmount;
+					pixelBrightness = newValFadeAmount < pixelBrightness ? pixelBrightness - newValFadeAmount : 0;
 				}
 				// fade the edges 
 				else if(pixelBrightness > fadeAmount) {
-					if((j == 0 || j == b->num_leds-1 || (b->brightness[j-1] == 0) || (b->brightness[j+1] == 0)))
+					bool first = j == 0;
+					bool last = j == b->num_leds-1;
+					if((first && barStart) || (last && barEnd) || (!first && b->brightness[j-1] == 0) || (!last && b->brightness[j+1] == 0))
 						pixelBrightness -= fadeAmount;
 				}
 				else {
 					pixelBrightness = 0;
 				}
-				b->leds[j] = CHSV(hue*255.0,saturation,pixelBrightness);
+				b->leds[j] = color(pixelBrightness);
 			}
 		}
 	}
 
-	void updateHue(uint32_t millisSinceUpdate) {
-		hue += hueSign * (hueDelta * (float)millisSinceUpdate);
+	// valid hue values are between -1.0 and 2.0, 
+	// uint8_t oferflow/underflow works in our favor here.
+	uint8_t toHue8(hue_t h) {
+#if FIXED_POINT_MATH
+		return hueToHue8(h);
+#else
+		return (uint8_t)(int)(h*255);
+#endif
+	}
+
+	void updateHue(uint32_t millisSinceUpdate, hue_t jump = 0) {
+#if FIXED_POINT_MATH
+		// a longer step than a whole sweep would overflow the Q8.24 hue
+		if(millisSinceUpdate > hueSweepTime)
+			millisSinceUpdate = hueSweepTime;
+#endif
+		hue += hueSign * (hueDelta * (hue_t)millisSinceUpdate + jump);
 
 		if(hue >= endHue && hueSign > 0)  {
-			float e = endHue;
+			hue_t e = endHue;
 			endHue = startHue;
 			startHue = e;
 			hueSign = -1;
 		}
 		else if( hue <= endHue && hueSign < 0) {
-			float e = endHue;
+			hue_t e = endHue;
 			endHue = startHue;
 			startHue = e;
 			hueSign = 1;
 		}
 
-		// valid hue values are between -1.0 and 2.0, 
-		// uint8_t oferflow/underflow works in our favor here.
-		currentColor = CHSV((uint8_t)(hue*255), saturation,255);
+		setHue8(toHue8(hue));
+	}
+
+	// The fading color at brightness
+	CRGB color(uint8_t brightness) {
+		return colors.get(hue8, saturation, brightness);
+	}
+
+	// The sweep moves hue8 every few frames at most, so a cache mostly
+	// outlives the frame
+	void setHue8(uint8_t h, bool force = false) {
+		if(h == hue8 && !force)
+			return;
+		hue8 = h;
+		currentColor = CHSV(hue8, saturation, 255);
+		colors.clear();
 	}
 
 };
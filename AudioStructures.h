@@ -19,13 +19,15 @@ limitations under the License.
 
 #include "Arduino.h"
 #include "FastLED.h"
-#include "sqrt_integer.h"
+#include "FixedPoint.h"
 
 #undef SHOW_REFRESH_RATE
 #undef PRINT_DEBUG
 #define FADE_RATE 17
 #define BIT_MASK(n) ((1<<n)-1)
+#ifndef CHAR_BIT
 #define CHAR_BIT 8
+#endif
 
 // The number of amplitude bits per audio bucket, max 8.
 #define RESOLUTION	8
@@ -39,6 +41,16 @@ enum DisplayFunction {
 	Sqrt
 };
 
+// How the FFT bins inside a display bin are weighted before summing.
+// Flat is a plain sum; the others are triangles peaking at the middle of the
+// range on a linear, mel or Bark frequency axis, for overlapping filterbanks.
+enum BinWeighting {
+	Flat,
+	Triangle,
+	Mel,
+	Bark
+};
+
 
 typedef struct {
 	int16_t startFFTBin;
@@ -46,12 +58,22 @@ typedef struct {
 	int16_t startLEDNum;
 	int16_t endLEDNum;
 	DisplayFunction displayFunction;
+	BinWeighting weighting;
 } DisplayBin;
 
 template<int FREQ_BINS>
 struct FFTBinData {
 	uint8_t peak;
 	uint8_t binValues[FREQ_BINS];
+	// from the OnsetDetector: a transient starts this frame, and how far it
+	// cleared the threshold (0-255)
+	bool onset;
+	uint8_t onsetStrength;
+	// the tracked beat: set on the frame a beat starts, the position in the
+	// beat (0-255) and beats per minute, 0 while there is no tempo
+	bool beat;
+	uint8_t beatPhase;
+	uint8_t tempo;
 	// Sets the peak value, ensures it is in a valid range.
 	void setPeak(int peakValue) {
 		peak = min(255, max(MIN_PEAK_VALUE, peakValue));
@@ -65,58 +87,40 @@ struct FFTBinData {
 			Serial.print(binValues[i]);
 			Serial.print(", ");
 		}
-		Serial.println(")");
+		Serial.print(")");
+		if(onset)
+			Serial.printf(" onset %u", onsetStrength);
+		if(tempo)
+			Serial.printf(" %u bpm, phase %u", tempo, beatPhase);
+		Serial.println();
 	}
 };
 
-float applyFunction(DisplayFunction f, uint16_t value) {
-	switch(f) {
-	case DisplayFunction::Log:
-		return log(value);
-	case DisplayFunction::Sq:
-		return pow(value,2);
-	case DisplayFunction::Sqrt:
-		return sqrt(value);
-	case DisplayFunction::Lin:
-	default:
-		return value;
-	}
-}
-
 struct DisplayBinState {
-	DisplayBin * configuration; 
+	const DisplayBin * configuration; 
 	CRGB * leds;
 	uint8_t num_leds;
+	// the whole bar, and where leds starts in it, when the bin is drawn in
+	// parts (ShardedRenderer); otherwise num_leds and 0
+	uint8_t barLeds;
+	uint8_t barOffset;
+	// the bin's TransferCurve table
+	const uint16_t * curve;
 	uint8_t * brightness;
+	// LEDs lit in the bar
 	uint8_t value;
+	// the bar as of the last analysis frame and where it is heading, for
+	// gliding between frames
+	uint8_t fromValue;
+	uint8_t toValue;
+#if FIXED_POINT_MATH
+	// running average of the curve output, Q16.16
+	uint32_t avgV;
+#else
 	float avgV;
+#endif
 	int avgCount;
-	float applyDisplayFunction(uint16_t value) {
-		return applyFunction(configuration->displayFunction, value);
-	}
-
 };
 
-
-const float MAX_LOG = applyFunction(DisplayFunction::Log, _BV(RESOLUTION)-1);
-const float MAX_SQ = applyFunction(DisplayFunction::Sq, _BV(RESOLUTION)-1);
-const float MAX_SQRT = applyFunction(DisplayFunction::Sqrt, _BV(RESOLUTION)-1);
-const float MAX_LIN = applyFunction(DisplayFunction::Lin, _BV(RESOLUTION)-1);
-
-float functionMaxValue(DisplayFunction f) {
-	switch(f) {
-	case DisplayFunction::Log:
-		return MAX_LOG;
-	case DisplayFunction::Sq:
-		return MAX_SQ;
-	case DisplayFunction::Sqrt:
-		return MAX_SQRT;
-	case DisplayFunction::Lin:
-	default:
-		return MAX_LIN;
-	};
-}
-
-
 #endif
 
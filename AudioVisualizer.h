@@ -20,40 +20,161 @@ limitations under the License.
 #include "AudioStructures.h"
 #include "AudioProcessor.h"
 #include "AudioRenderer.h"
+#include "ShardedRenderer.h"
+#include "BinLayout.h"
 #include "LightingController.h"
+#include "LayerCompositor.h"
+#include "RenderScheduler.h"
+#include "LEDFrameBuffer.h"
 #include "FastLED.h"
 
+// RAM the visualizer may take, its LED buffer included, checked when it
+// is built. Whatever is left is for the stack, the core and the Audio
+// library. Define it before including this file to move it.
+#ifndef AUDIOVISUALIZER_RAM_BUDGET
+#if defined(__MKL26Z64__)
+// Teensy LC, 8K
+#define AUDIOVISUALIZER_RAM_BUDGET 6144
+#elif defined(__MK20DX128__)
+// Teensy 3.0, 16K
+#define AUDIOVISUALIZER_RAM_BUDGET 12288
+#elif defined(__MK20DX256__)
+// Teensy 3.1 and 3.2, 64K
+#define AUDIOVISUALIZER_RAM_BUDGET 49152
+#elif defined(__MK64FX512__)
+// Teensy 3.5, 192K
+#define AUDIOVISUALIZER_RAM_BUDGET 163840
+#elif defined(__MK66FX1M0__)
+// Teensy 3.6, 256K
+#define AUDIOVISUALIZER_RAM_BUDGET 229376
+#else
+#define AUDIOVISUALIZER_RAM_BUDGET 0x7FFFFFFF
+#endif
+#endif
 
-
-template<int NUM_LEDS, int DISPLAY_BINS = 8>
+// FFT is the analyzer the processor reads, see AudioProcessor. The strip
+// renderer is called directly from the analysis; EXTRA_RENDERERS is how
+// many more processor.connectAudioRenderer() takes. STRIPS splits the
+// LEDs into that many equal strips, end to end in the one buffer, for
+// parallel output; each strip gets a renderer of its own (ShardedRenderer).
+// MAX_WEIGHTS is the processor's pool of filterbank weights: raise it for
+// mel layouts, or set 0 when every bin is Flat. COLOR_CACHE gives each
+// strip renderer a ColorCache, 800 bytes apiece.
+#ifndef __MKL26Z64__
+template<int NUM_LEDS, int DISPLAY_BINS = 8, class FFT = AudioAnalyzeFFT1024, int EXTRA_RENDERERS = 0, int STRIPS = 1, int MAX_WEIGHTS = DISPLAY_BINS * 32, bool COLOR_CACHE = false>
+#else
+template<int NUM_LEDS, int DISPLAY_BINS = 8, class FFT = LCAnalyzeFFT, int EXTRA_RENDERERS = 0, int STRIPS = 1, int MAX_WEIGHTS = DISPLAY_BINS * 32, bool COLOR_CACHE = false>
+#endif
 class AudioVisualizer {
 public:
-	AudioProcessor<DISPLAY_BINS, 1> processor;
-	LEDStripAudioRenderer<DISPLAY_BINS> renderer;
+	typedef AudioProcessor<DISPLAY_BINS, EXTRA_RENDERERS, 0x01, DefaultReduceKernel, FFT, 1, MAX_WEIGHTS> Processor;
+	// The built-in bin layouts, computed at compile time
+	typedef BinLayout<NUM_LEDS, DISPLAY_BINS, Processor::SPECTRUM_SIZE, AUDIO_SAMPLE_RATE_MHZ, typename Processor::Spectrum> Layout;
+
+	typedef typename StripRenderer<DISPLAY_BINS, NUM_LEDS, STRIPS, COLOR_CACHE>::type Renderer;
+
+	Processor processor;
+	// holds the per bin and per pixel render state, so nothing is allocated
+	Renderer renderer;
 	LightingControllerClass<DISPLAY_BINS> controller;
+	// blends the layers into the strip when they are set up by init()
+	LayerCompositor<4> compositor;
+
+	// Bytes of RAM the visualizer takes, its LED buffer included. All of it
+	// is static: the renderer holds its pixel state for NUM_LEDS, so nothing
+	// comes from the heap. The layers and telemetry ring a sketch hands in
+	// later are its own and counted by ramInUse().
+	static constexpr size_t ramBytes() {
+		return sizeof(AudioVisualizer) + NUM_LEDS * sizeof(CRGB);
+	}
+
+	// ramBytes() and the buffers set up since: the audio and ambient layers
+	// and the telemetry ring with its storage
+	size_t ramInUse() {
+		size_t bytes = ramBytes();
+		if(output != NULL)
+			bytes += 2 * NUM_LEDS * sizeof(CRGB);
+		if(telemetry != NULL)
+			bytes += sizeof(TelemetryRing) + telemetry->getSize();
+		return bytes;
+	}
 
 #ifdef __MKL26Z64__
 	AudioVisualizer(int inputPin) : 
 		processor(inputPin, 8, 12, EXTERNAL), 
-		enableSerialCMD(false) {
+		enableSerialCMD(false),
+		renderers(renderer),
+		frameTargets(renderer),
+		activeBins(bins),
+		output(NULL),
+		telemetry(NULL),
+		telemetryMask(0) {
+		static_assert(ramBytes() <= AUDIOVISUALIZER_RAM_BUDGET, "AudioVisualizer is over AUDIOVISUALIZER_RAM_BUDGET: use fewer LEDs or display bins");
 	}
 #else
-	AudioVisualizer(AudioAnalyzeFFT1024  & myFFT) : 
+	AudioVisualizer(FFT  & myFFT) : 
 		processor(myFFT), 
-		enableSerialCMD(false) {
+		enableSerialCMD(false),
+		renderers(renderer),
+		frameTargets(renderer),
+		activeBins(bins),
+		output(NULL),
+		telemetry(NULL),
+		telemetryMask(0) {
+		static_assert(ramBytes() <= AUDIOVISUALIZER_RAM_BUDGET, "AudioVisualizer is over AUDIOVISUALIZER_RAM_BUDGET: use fewer LEDs or display bins");
 	}
 
 #endif
 
-	void init(CRGB * leds, DisplayBin * bins = NULL) {
+	// Connects the processor and renderer to leds. bins may be a RAM table or
+	// one of the flash tables in Layout, and defaults to Layout::octave.
+	// Nothing here waits or prints, so the first frame follows right away.
+	void init(CRGB * leds, const DisplayBin * bins = NULL) {
 		if(bins == NULL)
-			bins = getDefaultBins();
-		printBins();
+			bins = Layout::octave.bins;
+		activeBins = bins;
 		processor.init(bins);
 
 		renderer.init(leds, NUM_LEDS, bins);
-		processor.connectAudioRenderer(&renderer);
 		controller.init(leds, NUM_LEDS, _BV(7));
+		output = NULL;
+		compositor.clear();
+	}
+
+	// As above, with the bars drawn into audio and the controller's boxes
+	// into ambient, each NUM_LEDS pixels, and the two blended into leds on
+	// every frame drawn: the boxes at the bottom and the bars screened over
+	// them. More layers can go on top through compositor.addLayer().
+	void init(CRGB * leds, CRGB * audio, CRGB * ambient, const DisplayBin * bins = NULL) {
+		init(audio, bins);
+		controller.init(ambient, NUM_LEDS, _BV(7));
+		fill_solid(ambient, NUM_LEDS, CRGB::Black);
+		output = leds;
+		compositor.addLayer(ambient, Normal);
+		compositor.addLayer(audio, Screen);
+	}
+
+	// Draws the strip fps times a second, the bars gliding between analysis
+	// frames, instead of on every analysis frame. update() then returns
+	// true once per drawn frame, when the strip should be shown. 0 (the
+	// default) goes back to drawing on every analysis frame.
+	void setFrameRate(uint16_t fps) {
+		scheduler.setFrameRate(fps);
+	}
+
+	RenderScheduler & getScheduler() {
+		return scheduler;
+	}
+
+	// Streams the records in mask (see Telemetry.h) through ring and out of
+	// Serial, as fast as the port takes them, from update(). The 't' serial
+	// command stops and starts it. Nothing else should print while it runs.
+	// The ring takes one writer, so with the processor queued, where the
+	// analysis writes its records from the interrupt, there are no stats.
+	void setTelemetry(TelemetryRing * ring, uint8_t mask = TELEMETRY_DEFAULT) {
+		telemetry = ring;
+		telemetryMask = mask;
+		processor.setTelemetry(ring, mask);
 	}
 
 	void enableSerialCommands() {
@@ -68,57 +189,117 @@ public:
 		Serial.println("Display bin Configuration:");
 		for(int i = 0; i < DISPLAY_BINS; i++) {
 			Serial.printf("Display Bin: %u\n", i);
-			Serial.printf("\tApplied to FFT Bins %u-%u\n",bins[i].startFFTBin,bins[i].endFFTBin);
-			Serial.printf("\tMapped over LEDS %u-%u\n",bins[i].startLEDNum,bins[i].endLEDNum);
+			Serial.printf("\tApplied to FFT Bins %u-%u\n",activeBins[i].startFFTBin,activeBins[i].endFFTBin);
+			Serial.printf("\tMapped over LEDS %u-%u\n",activeBins[i].startLEDNum,activeBins[i].endLEDNum);
 		}
 	}
 
 	bool update() {
 		if(enableSerialCMD)
 			checkSerial();
-		return processor.analyzeData() > 0;
+		bool drawn = draw();
+		if(drawn && output != NULL) {
+			controller.render();
+			compositor.compose(output, NUM_LEDS);
+		}
+		if(telemetry != NULL) {
+			if(drawn && !processor.isQueued() && processor.isLogging(TelemetryStats))
+				logStats();
+			// what is left goes out after 't' stops the stream
+			telemetry->drain(Serial);
+		}
+		return drawn;
+	}
+
+	void printMemory() {
+		Serial.printf("RAM: %u bytes of %u budgeted, %u in use\n", (unsigned)ramBytes(), (unsigned)AUDIOVISUALIZER_RAM_BUDGET,
+			(unsigned)ramInUse());
+		Serial.printf("\tprocessor %u, renderer %u, controller %u, leds %u\n", (unsigned)sizeof(Processor),
+			(unsigned)sizeof(Renderer), (unsigned)sizeof(controller), (unsigned)(NUM_LEDS * sizeof(CRGB)));
+	}
 
+	// Prints the time each stage took since the last call, see Profiler.h
+	void printProfile() {
+#if AUDIOVISUALIZER_PROFILE
+		profiler().print();
+		profiler().reset();
+#else
+		Serial.println("Profiling is off, define AUDIOVISUALIZER_PROFILE to 1 to build it in");
+#endif
 	}
 
 	DisplayBin* getDefaultBins() {
 		return getOctaveBins();
 	}
 
+	// The layouts below return a RAM copy of the flash table that can be
+	// edited before it is passed to init().
 	DisplayBin * getOctaveBins() {
-		float functionBase =  pow(MAX_FFT_HZ, 1.0/(float)DISPLAY_BINS);
-		delay(1000);
-		Serial.println(functionBase);
-		float ledsPerBin = (float)NUM_LEDS/(float)DISPLAY_BINS;
-		for(int i = 0; i < DISPLAY_BINS; i++) {
-			bins[i].startFFTBin = HZ_TO_NEAREST_FFT_BIN(pow(functionBase, i));
-			bins[i].endFFTBin = HZ_TO_NEAREST_FFT_BIN(pow(functionBase,i+1));
-			if(bins[i].endFFTBin == bins[i].startFFTBin)
-				bins[i].endFFTBin++;
-			if(bins[i].startFFTBin > (FFT_OUTPUT_SIZE-1))
-				bins[i].startFFTBin = FFT_OUTPUT_SIZE-1;
-			if(bins[i].endFFTBin > (FFT_OUTPUT_SIZE-1))
-				bins[i].endFFTBin = FFT_OUTPUT_SIZE-1;
-			bins[i].startLEDNum = i * ledsPerBin;
-			bins[i].endLEDNum = (i+1) * ledsPerBin;
-			bins[i].displayFunction = DisplayFunction::Lin;
-		}
-		return bins;
+		return copyBins(Layout::octave);
 	}
 
 	DisplayBin * getLinearBins() { 
-		float displaySize = FFT_OUTPUT_SIZE/(float)DISPLAY_BINS;
-		float ledsPerBin = (float)NUM_LEDS/(float)DISPLAY_BINS;
-		for(int i = 0; i < DISPLAY_BINS; i++) {
-			bins[i].startFFTBin = i * displaySize;
-			bins[i].endFFTBin = (i+1.0) * displaySize;
-			bins[i].startLEDNum = i * ledsPerBin;
-			bins[i].endLEDNum = (i+1) * ledsPerBin;
-		}
-		return bins;
+		return copyBins(Layout::linear);
+	}
+
+	DisplayBin * getMelBins() {
+		return copyBins(Layout::mel);
 	}
 
 private:
+	// Hands analysis frames to the renderer without drawing them
+	struct FrameTargets {
+		Renderer & renderer;
+		FrameTargets(Renderer & renderer) : renderer(renderer) {
+		}
+		void update(FFTBinData<DISPLAY_BINS> * data) {
+			if(data != NULL)
+				renderer.setFrame(data);
+		}
+	};
+
+	// Draws the bars, returning whether the strip changed
+	bool draw() {
+		if(scheduler.isEnabled()) {
+			// analysis frames only set where the bars head, and the strip is
+			// drawn on the schedule
+			if(processor.isQueued())
+				processor.renderQueued(frameTargets);
+			else
+				processor.analyzeData(frameTargets);
+			if(!scheduler.due(micros()))
+				return false;
+			renderer.render();
+			return true;
+		}
+		// analysis runs elsewhere and leaves its frames in the queue
+		if(processor.isQueued())
+			return processor.renderQueued(renderers);
+		return processor.analyzeData(renderers) > 0;
+	}
+
 	bool enableSerialCMD;
+	RendererSet<DISPLAY_BINS, Renderer> renderers;
+	FrameTargets frameTargets;
+	RenderScheduler scheduler;
+	const DisplayBin * activeBins;
+	// where the layers are composed, NULL when the bars draw straight to the strip
+	CRGB * output;
+	TelemetryRing * telemetry;
+	uint8_t telemetryMask;
+
+	void logStats() {
+		typename Processor::Queue & frames = processor.getFrameQueue();
+		TelemetryFields fields;
+		fields.u32(micros()).u32(scheduler.getFrames()).u32(scheduler.getSkipped())
+			.u32(frames.getOverruns()).u32(frames.getDrops()).u32(telemetry->getDropped());
+		telemetry->write(TelemetryStats, fields.data(), fields.size());
+	}
+
+	DisplayBin * copyBins(const DisplayBinTable<DISPLAY_BINS> & table) {
+		memcpy(bins, table.bins, sizeof(bins));
+		return bins;
+	}
 
 	void disableDebug() {
 		processor.enableDebugAutoscale = false;
@@ -152,6 +333,18 @@ private:
 			case 'b':
 				printBins();
 				break;
+			case 'm':
+				printMemory();
+				break;
+			case 'p':
+				printProfile();
+				break;
+			case 't':
+				if(telemetry != NULL) {
+					disableDebug();
+					processor.setTelemetry(processor.getTelemetry() ? NULL : telemetry, telemetryMask);
+				}
+				break;
 #ifdef __MKL26Z64__
 			case 'c':
 				Serial.println("Calibrating ADC (You should have the input silent)");
@@ -162,24 +355,5 @@ private:
 		}
 	}
 	DisplayBin bins[DISPLAY_BINS];
-/*void updatePattern() {
-static unsigned long lastPop = 0;
-const unsigned long popTime = 2500;
-unsigned long currentTime = millis();
-for(int i = 0; i < BOXES; i++) {
-if(controller.isRendered(i)) {
-controller.setColor(i, tr(EMPTY_COLOR), true);
-}
-}
-if((currentTime-lastPop) > popTime) {
-int box = random(0, BOXES);
-Serial.print("pop: ");
-Serial.println(box);
-controller.setColor(box, tr(LEDFxUtilities::randomColor(currentMode.saturation, 255)), true);
-lastPop = currentTime;
-}
-controller.render();
-}
-*/
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _AUTOGAIN_H
+#define _AUTOGAIN_H
+
+#include "FixedPoint.h"
+
+// Automatic gain for CHANNELS display bins, in the log domain so that a
+// step in level is followed at the same speed whatever its size.
+//
+// Each frame the gain moves a fraction of the way toward the one that puts
+// the channel's level at the target bin value: elapsed/(attack + elapsed)
+// when the level rose, elapsed/(release + elapsed) when it fell. After a
+// step the remaining error shrinks by 1/e every time constant, so a 20dB
+// jump settles to within 1dB in about three of them.
+//
+// Levels under the noise floor hold the gain where it is instead of
+// winding it up on silence. Linked channels share the gain of the loudest
+// one, which keeps the balance between display bins.
+//
+// Scales are Q8.8, the same as AudioProcessor's fixed-point autoscale.
+template<int CHANNELS>
+class AutoGain {
+public:
+	// A quarter of full scale, where the stepping autoscale this replaced
+	// settled, so displays keep their brightness
+	static const uint16_t DEFAULT_TARGET = 255 / 4;
+
+	AutoGain() : linked(false), noiseFloor(0) {
+		setTimes(50, 1500);
+		setTarget(DEFAULT_TARGET);
+		setMinimumScale(SCALE_ONE);
+		reset(4 * SCALE_ONE);
+	}
+
+	// Attack and release time constants in milliseconds
+	void setTimes(uint16_t attackMs, uint16_t releaseMs) {
+		attack16 = max(1, (int)((uint32_t)attackMs * 1000 >> 4));
+		release16 = max(1, (int)((uint32_t)releaseMs * 1000 >> 4));
+	}
+
+	// The bin value a channel's level should scale to
+	void setTarget(uint16_t binValue) {
+		logTarget = log2Fixed(max(1, (int)binValue));
+	}
+
+	// Levels, in filterbank sums, below which the gain is held
+	void setNoiseFloor(uint32_t level) {
+		noiseFloor = level;
+	}
+
+	void setMinimumScale(uint32_t scale) {
+		logMinimum = log2Fixed(max((uint32_t)1, scale));
+	}
+
+	void setLinked(bool linked) {
+		this->linked = linked;
+	}
+
+	bool isLinked() {
+		return linked;
+	}
+
+	// Sets every channel to scale, Q8.8
+	void reset(uint32_t scale) {
+		int32_t logScale = log2Fixed(max((uint32_t)1, scale));
+		for(int i = 0; i < CHANNELS; i++) {
+			logScales[i] = logScale;
+			scales[i] = scale;
+		}
+	}
+
+	// Moves each gain toward levels[i], elapsedMicros after the last update.
+	void update(const uint32_t * levels, uint32_t elapsedMicros) {
+		// time in 16us ticks, so the coefficients fit 32 bit math
+		uint32_t elapsed16 = min(elapsedMicros >> 4, (uint32_t)0xFFFF);
+		uint32_t attackRate = (elapsed16 << 16) / (attack16 + elapsed16);
+		uint32_t releaseRate = (elapsed16 << 16) / (release16 + elapsed16);
+		if(linked) {
+			uint32_t loudest = 0;
+			for(int i = 0; i < CHANNELS; i++)
+				loudest = max(loudest, levels[i]);
+			if(loudest >= noiseFloor && loudest)
+				follow(0, loudest, attackRate, releaseRate);
+			for(int i = 1; i < CHANNELS; i++) {
+				logScales[i] = logScales[0];
+				scales[i] = scales[0];
+			}
+		}
+		else {
+			for(int i = 0; i < CHANNELS; i++)
+				if(levels[i] >= noiseFloor && levels[i])
+					follow(i, levels[i], attackRate, releaseRate);
+		}
+	}
+
+	// Channel i's scale, Q8.8
+	uint32_t scale(int i) {
+		return scales[i];
+	}
+
+private:
+	// scales up to 2^23 keep the Q8.8 value in 32 bits
+	static const int32_t LOG_MAXIMUM = (31 - SCALE_FRACTION_BITS) * LOG2_ONE - 1;
+
+	bool linked;
+	uint32_t noiseFloor;
+	uint32_t attack16;
+	uint32_t release16;
+	int32_t logTarget;
+	int32_t logMinimum;
+	int32_t logScales[CHANNELS];
+	uint32_t scales[CHANNELS];
+
+	void follow(int i, uint32_t level, uint32_t attackRate, uint32_t releaseRate) {
+		int32_t want = log2Fixed(level) - logTarget + SCALE_FRACTION_BITS * LOG2_ONE;
+		want = constrain(want, logMinimum, (int32_t)LOG_MAXIMUM);
+		int32_t error = want - logScales[i];
+		int64_t step = (int64_t)error * (error > 0 ? attackRate : releaseRate);
+		logScales[i] += (int32_t)((step + (step >= 0 ? 0x8000 : -0x8000)) / 65536);
+		scales[i] = max((uint32_t)1, exp2Fixed(logScales[i]));
+	}
+};
+
+#endif
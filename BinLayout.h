@@ -0,0 +1,130 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BINLAYOUT_H
+#define _BINLAYOUT_H
+
+#include "AudioStructures.h"
+#include "ConstexprMath.h"
+#include "Spectrum.h"
+
+// Display bin layouts computed by the compiler. Everything a layout depends
+// on is a template parameter, so the tables are constant-initialized and
+// live in flash; nothing runs at boot.
+
+constexpr double hzToMel(double hz) {
+	return 1127.0 * constLog(1.0 + hz / 700.0);
+}
+
+constexpr double melToHz(double mel) {
+	return 700.0 * (constExp(mel / 1127.0) - 1.0);
+}
+
+template<int DISPLAY_BINS>
+struct DisplayBinTable {
+	DisplayBin bins[DISPLAY_BINS];
+};
+
+// Builds layouts of NUM_LEDS LEDs split evenly over DISPLAY_BINS display bins
+// reading a spectrum of FFT_OUTPUT_BINS bins sampled at SAMPLE_RATE_MHZ millihertz.
+// SPECTRUM places the bins in frequency (see Spectrum.h).
+template<int NUM_LEDS, int DISPLAY_BINS, int FFT_OUTPUT_BINS, long SAMPLE_RATE_MHZ,
+	class SPECTRUM = UniformSpectrum<FFT_OUTPUT_BINS, SAMPLE_RATE_MHZ> >
+struct BinLayoutBuilder {
+	static constexpr double MAX_HZ = SAMPLE_RATE_MHZ / 2000.0;
+
+	static constexpr int hzToBin(double hz) {
+		return constRound(SPECTRUM::hzToBin(hz));
+	}
+
+	static constexpr void setLEDs(DisplayBin & bin, int i) {
+		bin.startLEDNum = i * NUM_LEDS / DISPLAY_BINS;
+		bin.endLEDNum = (i + 1) * NUM_LEDS / DISPLAY_BINS;
+		bin.displayFunction = DisplayFunction::Lin;
+		bin.weighting = BinWeighting::Flat;
+	}
+
+	static constexpr int clampBin(int bin) {
+		return bin > FFT_OUTPUT_BINS - 1 ? FFT_OUTPUT_BINS - 1 : bin;
+	}
+
+	// Each display bin covers the same ratio of frequencies, from 1Hz to Nyquist.
+	static constexpr DisplayBinTable<DISPLAY_BINS> makeOctave() {
+		DisplayBinTable<DISPLAY_BINS> t = {};
+		double logMax = constLog(MAX_HZ);
+		for(int i = 0; i < DISPLAY_BINS; i++) {
+			DisplayBin & bin = t.bins[i];
+			bin.startFFTBin = hzToBin(constExp(logMax * i / DISPLAY_BINS));
+			bin.endFFTBin = hzToBin(constExp(logMax * (i + 1) / DISPLAY_BINS));
+			if(bin.endFFTBin == bin.startFFTBin)
+				bin.endFFTBin++;
+			bin.startFFTBin = clampBin(bin.startFFTBin);
+			bin.endFFTBin = clampBin(bin.endFFTBin);
+			setLEDs(bin, i);
+		}
+		return t;
+	}
+
+	// Each display bin covers the same number of FFT bins.
+	static constexpr DisplayBinTable<DISPLAY_BINS> makeLinear() {
+		DisplayBinTable<DISPLAY_BINS> t = {};
+		for(int i = 0; i < DISPLAY_BINS; i++) {
+			DisplayBin & bin = t.bins[i];
+			bin.startFFTBin = i * FFT_OUTPUT_BINS / DISPLAY_BINS;
+			bin.endFFTBin = (i + 1) * FFT_OUTPUT_BINS / DISPLAY_BINS;
+			setLEDs(bin, i);
+		}
+		return t;
+	}
+
+	// A mel filterbank: triangles evenly spaced in mel from 0Hz to Nyquist,
+	// each spanning its neighbours' centers so adjacent bins overlap by half.
+	static constexpr DisplayBinTable<DISPLAY_BINS> makeMel() {
+		DisplayBinTable<DISPLAY_BINS> t = {};
+		double melMax = hzToMel(MAX_HZ);
+		for(int i = 0; i < DISPLAY_BINS; i++) {
+			DisplayBin & bin = t.bins[i];
+			bin.startFFTBin = clampBin(hzToBin(melToHz(melMax * i / (DISPLAY_BINS + 1))));
+			bin.endFFTBin = hzToBin(melToHz(melMax * (i + 2) / (DISPLAY_BINS + 1)));
+			if(bin.endFFTBin <= bin.startFFTBin)
+				bin.endFFTBin = bin.startFFTBin + 1;
+			if(bin.endFFTBin > FFT_OUTPUT_BINS)
+				bin.endFFTBin = FFT_OUTPUT_BINS;
+			setLEDs(bin, i);
+			bin.weighting = BinWeighting::Mel;
+		}
+		return t;
+	}
+};
+
+// The layouts for one configuration, constant-initialized in flash.
+template<int NUM_LEDS, int DISPLAY_BINS, int FFT_OUTPUT_BINS, long SAMPLE_RATE_MHZ,
+	class SPECTRUM = UniformSpectrum<FFT_OUTPUT_BINS, SAMPLE_RATE_MHZ> >
+struct BinLayout {
+	typedef BinLayoutBuilder<NUM_LEDS, DISPLAY_BINS, FFT_OUTPUT_BINS, SAMPLE_RATE_MHZ, SPECTRUM> Builder;
+	static constexpr DisplayBinTable<DISPLAY_BINS> octave = Builder::makeOctave();
+	static constexpr DisplayBinTable<DISPLAY_BINS> linear = Builder::makeLinear();
+	static constexpr DisplayBinTable<DISPLAY_BINS> mel = Builder::makeMel();
+};
+
+template<int NUM_LEDS, int DISPLAY_BINS, int FFT_OUTPUT_BINS, long SAMPLE_RATE_MHZ, class SPECTRUM>
+constexpr DisplayBinTable<DISPLAY_BINS> BinLayout<NUM_LEDS, DISPLAY_BINS, FFT_OUTPUT_BINS, SAMPLE_RATE_MHZ, SPECTRUM>::octave;
+template<int NUM_LEDS, int DISPLAY_BINS, int FFT_OUTPUT_BINS, long SAMPLE_RATE_MHZ, class SPECTRUM>
+constexpr DisplayBinTable<DISPLAY_BINS> BinLayout<NUM_LEDS, DISPLAY_BINS, FFT_OUTPUT_BINS, SAMPLE_RATE_MHZ, SPECTRUM>::linear;
+template<int NUM_LEDS, int DISPLAY_BINS, int FFT_OUTPUT_BINS, long SAMPLE_RATE_MHZ, class SPECTRUM>
+constexpr DisplayBinTable<DISPLAY_BINS> BinLayout<NUM_LEDS, DISPLAY_BINS, FFT_OUTPUT_BINS, SAMPLE_RATE_MHZ, SPECTRUM>::mel;
+
+#endif
@@ -0,0 +1,95 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _CONSTEXPRMATH_H
+#define _CONSTEXPRMATH_H
+
+// Just enough math for tables the compiler builds (bin layouts, transfer
+// curves, FFT twiddles and windows). log() reduces to [1, 2) and sums the
+// atanh series, exp() reduces by ln 2 and sin() by 2 pi, and both sum
+// their Taylor series.
+constexpr double CONST_LN2 = 0.69314718055994530942;
+constexpr double CONST_PI = 3.14159265358979323846;
+
+constexpr double constLog(double x) {
+	if(x <= 0.0)
+		return -1.0e300;
+	int k = 0;
+	while(x >= 2.0) {
+		x /= 2.0;
+		k++;
+	}
+	while(x < 1.0) {
+		x *= 2.0;
+		k--;
+	}
+	double z = (x - 1.0) / (x + 1.0);
+	double z2 = z * z;
+	double term = z;
+	double sum = 0.0;
+	for(int n = 1; n < 40; n += 2) {
+		sum += term / n;
+		term *= z2;
+	}
+	return 2.0 * sum + k * CONST_LN2;
+}
+
+constexpr double constExp(double x) {
+	int k = (int)(x / CONST_LN2);
+	double r = x - k * CONST_LN2;
+	double term = 1.0;
+	double sum = 1.0;
+	for(int n = 1; n < 30; n++) {
+		term *= r / n;
+		sum += term;
+	}
+	for(; k > 0; k--)
+		sum *= 2.0;
+	for(; k < 0; k++)
+		sum /= 2.0;
+	return sum;
+}
+
+constexpr int constRound(double x) {
+	return x < 0 ? (int)(x - 0.5) : (int)(x + 0.5);
+}
+
+constexpr double constPow(double base, double exponent) {
+	return base > 0.0 ? constExp(exponent * constLog(base)) : 0.0;
+}
+
+constexpr double constSqrt(double x) {
+	return constPow(x, 0.5);
+}
+
+constexpr double constSin(double x) {
+	double turns = x / (2.0 * CONST_PI);
+	x -= (double)constRound(turns) * 2.0 * CONST_PI;
+	double x2 = x * x;
+	double term = x;
+	double sum = x;
+	for(int n = 3; n < 40; n += 2) {
+		term *= -x2 / ((n - 1) * n);
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double constCos(double x) {
+	return constSin(x + CONST_PI / 2.0);
+}
+
+#endif
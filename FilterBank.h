@@ -0,0 +1,176 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _FILTERBANK_H
+#define _FILTERBANK_H
+
+#include "AudioStructures.h"
+#include "ReduceKernel.h"
+#include "Spectrum.h"
+
+// The FFT-to-display-bin map, compiled once from the DisplayBin table.
+// Each display bin becomes a band: the first FFT bin it reads, how many it
+// reads and, unless it is Flat, an offset into a shared pool of Q0.8 weights.
+// Bands may start anywhere and overlap; FFT bins no band covers are never read.
+// KERNEL does the per-band sums (see ReduceKernel.h). MAX_WEIGHTS at 0
+// reads every band flat.
+template<int FREQ_BINS, int MAX_WEIGHTS = 512, class KERNEL = DefaultReduceKernel>
+class FilterBank {
+public:
+	struct Band {
+		int16_t start;
+		int16_t length;
+		// index of the first weight in the pool, or -1 for an unweighted sum
+		int16_t weightOffset;
+	};
+
+	FilterBank() : weightsUsed(0) {
+		memset(bands, 0, sizeof(bands));
+	}
+
+	// Builds the bands for bins over an analyzer's SPECTRUM (see Spectrum.h).
+	template<class SPECTRUM>
+	void configure(const DisplayBin * bins) {
+		configure(bins, SPECTRUM::SIZE, &SPECTRUM::binToHz);
+	}
+
+	// Builds the bands for bins over a spectrum of spectrumSize bins, bin i
+	// sitting at binToHz(i).
+	void configure(const DisplayBin * bins, int spectrumSize, double (*binToHz)(double)) {
+		weightsUsed = 0;
+		for(int i = 0; i < FREQ_BINS; i++) {
+			Band & band = bands[i];
+			int start = constrain(bins[i].startFFTBin, 0, spectrumSize - 1);
+			int end = constrain(bins[i].endFFTBin, 0, spectrumSize);
+			// a range that collapsed still reads its one FFT bin
+			if(end <= start)
+				end = start + 1;
+			band.start = start;
+			band.length = end - start;
+			band.weightOffset = -1;
+			if(MAX_WEIGHTS > 0 && bins[i].weighting != BinWeighting::Flat)
+				compileWeights(band, bins[i].weighting, binToHz);
+		}
+	}
+
+	// Reduces spectrum into one sum per display bin. Returns the total of the sums.
+	uint32_t apply(const uint16_t * spectrum, uint32_t * sums) {
+		uint32_t total = 0;
+		for(int i = 0; i < FREQ_BINS; i++) {
+			const Band & band = bands[i];
+			if(band.weightOffset < 0)
+				sums[i] = KERNEL::sum(spectrum + band.start, band.length);
+			else
+				sums[i] = KERNEL::weightedSum(spectrum + band.start, weights + band.weightOffset, band.length);
+			total += sums[i];
+		}
+		return total;
+	}
+
+	// Reduces CHANNELS spectra in one pass per band, into sums[CHANNELS * i + c]
+	// for display bin i of channel c. Returns the total of the sums.
+	template<int CHANNELS>
+	uint32_t applyChannels(const uint16_t * const * spectra, uint32_t * sums) {
+		uint32_t total = 0;
+		for(int i = 0; i < FREQ_BINS; i++) {
+			const Band & band = bands[i];
+			uint32_t * out = sums + CHANNELS * i;
+			if(band.weightOffset < 0)
+				KERNEL::template sumChannels<CHANNELS>(spectra, band.start, band.length, out);
+			else
+				KERNEL::template weightedSumChannels<CHANNELS>(spectra, band.start,
+					weights + band.weightOffset, band.length, out);
+			for(int c = 0; c < CHANNELS; c++)
+				total += out[c];
+		}
+		return total;
+	}
+
+	const Band & getBand(int i) {
+		return bands[i];
+	}
+
+	const uint16_t * getWeights(const Band & band) {
+		return band.weightOffset < 0 ? NULL : weights + band.weightOffset;
+	}
+
+	// The number of FFT bins read per frame.
+	int tapCount() {
+		int taps = 0;
+		for(int i = 0; i < FREQ_BINS; i++)
+			taps += bands[i].length;
+		return taps;
+	}
+
+private:
+	Band bands[FREQ_BINS];
+	// Halfwords and word aligned so that kernels can read them in pairs
+	uint16_t weights[MAX_WEIGHTS > 0 ? MAX_WEIGHTS : 1] __attribute__((aligned(4)));
+	int weightsUsed;
+
+	static float warp(BinWeighting weighting, float hz) {
+		switch(weighting) {
+		case BinWeighting::Mel:
+			return 2595.0f * log10f(1.0f + hz / 700.0f);
+		case BinWeighting::Bark:
+			return 26.81f * hz / (1960.0f + hz) - 0.53f;
+		case BinWeighting::Triangle:
+		default:
+			return hz;
+		}
+	}
+
+	// A triangle over the band on the warped frequency axis, sampled at the
+	// FFT bin centers. Zero taps at the edges are trimmed off the band. If the
+	// pool is full the band stays a flat sum.
+	void compileWeights(Band & band, BinWeighting weighting, double (*binToHz)(double)) {
+		// keep each band's weights at the same word alignment as its samples
+		if((weightsUsed & 1) != (band.start & 1))
+			weightsUsed++;
+		if(weightsUsed + band.length + 1 > MAX_WEIGHTS)
+			return;
+		float low = warp(weighting, binToHz(band.start));
+		float high = warp(weighting, binToHz(band.start + band.length));
+		float center = (low + high) / 2.0f;
+		uint16_t * w = weights + weightsUsed;
+		int first = -1;
+		int last = -1;
+		for(int k = 0; k < band.length; k++) {
+			float x = warp(weighting, binToHz(band.start + k + 0.5));
+			float t = x < center ? (x - low) / (center - low) : (high - x) / (high - center);
+			w[k] = constrain((int)(t * 255.0f + 0.5f), 0, 255);
+			if(w[k]) {
+				if(first < 0)
+					first = k;
+				last = k;
+			}
+		}
+		if(first < 0) {
+			// too narrow to resolve a triangle, read it flat
+			return;
+		}
+		band.start += first;
+		// trimming may flip the parity, so start over at the right alignment
+		int pad = (weightsUsed & 1) != (band.start & 1) ? 1 : 0;
+		memmove(w + pad, w + first, (last - first + 1) * sizeof(uint16_t));
+		weightsUsed += pad;
+		band.length = last - first + 1;
+		band.weightOffset = weightsUsed;
+		weightsUsed += band.length;
+	}
+};
+
+#endif
@@ -0,0 +1,389 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _FIXEDFFT_H
+#define _FIXEDFFT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "AudioStructures.h"
+#include "ConstexprMath.h"
+#include "Spectrum.h"
+
+enum FFTWindow {
+	Rectangular,
+	Hann,
+	Hamming,
+	BlackmanHarris
+};
+
+// Q15 tables for a SIZE point transform, built by the compiler into flash.
+template<int SIZE>
+struct FFTTwiddleTable {
+	// sin(2 pi k / SIZE); cosines are read a quarter turn on
+	int16_t sine[SIZE];
+};
+
+template<int SIZE>
+struct FFTWindowTable {
+	int16_t weights[SIZE];
+};
+
+template<int SIZE>
+struct FFTTableBuilder {
+	static constexpr int16_t toQ15(double x) {
+		return (int16_t)constRound(x >= 1.0 ? 32767.0 : x * 32767.0);
+	}
+
+	static constexpr FFTTwiddleTable<SIZE> makeTwiddles() {
+		FFTTwiddleTable<SIZE> t = {};
+		for(int k = 0; k < SIZE; k++)
+			t.sine[k] = toQ15(constSin(2.0 * CONST_PI * k / SIZE));
+		return t;
+	}
+
+	static constexpr FFTWindowTable<SIZE> makeWindow(FFTWindow window) {
+		FFTWindowTable<SIZE> t = {};
+		for(int n = 0; n < SIZE; n++) {
+			double x = 2.0 * CONST_PI * n / SIZE;
+			double w = 1.0;
+			switch(window) {
+			case FFTWindow::Hann:
+				w = 0.5 - 0.5 * constCos(x);
+				break;
+			case FFTWindow::Hamming:
+				w = 0.54 - 0.46 * constCos(x);
+				break;
+			case FFTWindow::BlackmanHarris:
+				w = 0.35875 - 0.48829 * constCos(x) + 0.14128 * constCos(2.0 * x) - 0.01168 * constCos(3.0 * x);
+				break;
+			case FFTWindow::Rectangular:
+			default:
+				break;
+			}
+			t.weights[n] = toQ15(w);
+		}
+		return t;
+	}
+};
+
+// A SIZE point complex FFT on interleaved Q15 (real, imaginary) pairs.
+//
+// Pairs of radix-2 stages are done as one radix-4 butterfly (radix 2^2), so
+// a 1024 point transform is five passes over the data and a 512 point one
+// a radix-2 pass and four radix-4 ones. Each pass divides by its radix to
+// stay in 16 bits, so the result is the DFT divided by SIZE, the same
+// scaling as the CMSIS radix-4 transform the Teensy Audio library uses.
+template<int SIZE>
+class FixedFFT {
+public:
+	static_assert(SIZE >= 16 && SIZE <= 4096 && (SIZE & (SIZE - 1)) == 0, "FFT size must be a power of two from 16 to 4096");
+
+	static constexpr int bits(int n) {
+		return n > 1 ? 1 + bits(n / 2) : 0;
+	}
+	static const int BITS = bits(SIZE);
+
+	static constexpr FFTTwiddleTable<SIZE> twiddles = FFTTableBuilder<SIZE>::makeTwiddles();
+
+	// The index sample i belongs at before transform()
+	static uint16_t reverse(uint16_t i) {
+		uint16_t r = 0;
+		for(int b = 0; b < BITS; b++) {
+			r = (r << 1) | (i & 1);
+			i >>= 1;
+		}
+		return r;
+	}
+
+	// Transforms data, SIZE pairs in bit reversed order, in place.
+	static void transform(int16_t * data) {
+		int span = 1;
+		if(BITS & 1) {
+			for(int i = 0; i < 2 * SIZE; i += 4) {
+				int32_t ar = data[i], ai = data[i + 1];
+				int32_t br = data[i + 2], bi = data[i + 3];
+				data[i] = (ar + br) >> 1;
+				data[i + 1] = (ai + bi) >> 1;
+				data[i + 2] = (ar - br) >> 1;
+				data[i + 3] = (ai - bi) >> 1;
+			}
+			span = 2;
+		}
+		for(; span < SIZE; span *= 4) {
+			const int stride = SIZE / (4 * span);
+			for(int group = 0; group < SIZE; group += 4 * span) {
+				for(int j = 0; j < span; j++) {
+					int16_t * a = data + 2 * (group + j);
+					int16_t * b = a + 2 * span;
+					int16_t * c = b + 2 * span;
+					int16_t * d = c + 2 * span;
+					int k = j * stride;
+					int32_t tr, ti, pr, pi, qr, qi;
+					rotate(b, 2 * k, tr, ti);
+					rotate(c, k, pr, pi);
+					rotate(d, 3 * k, qr, qi);
+					int32_t sr = a[0] + tr, si = a[1] + ti;
+					int32_t dr = a[0] - tr, di = a[1] - ti;
+					int32_t ur = pr + qr, ui = pi + qi;
+					int32_t vr = pr - qr, vi = pi - qi;
+					a[0] = (sr + ur) >> 2;
+					a[1] = (si + ui) >> 2;
+					c[0] = (sr - ur) >> 2;
+					c[1] = (si - ui) >> 2;
+					// the odd outputs turn (p - q) by -i and +i
+					b[0] = (dr + vi) >> 2;
+					b[1] = (di - vr) >> 2;
+					d[0] = (dr - vi) >> 2;
+					d[1] = (di + vr) >> 2;
+				}
+			}
+		}
+	}
+
+private:
+	// x * e^(-2 pi i k / SIZE)
+	static inline void rotate(const int16_t * x, int k, int32_t & re, int32_t & im) __attribute__((always_inline)) {
+		int32_t c = twiddles.sine[k + SIZE / 4];
+		int32_t s = twiddles.sine[k];
+		re = (x[0] * c + x[1] * s + 16384) >> 15;
+		im = (x[1] * c - x[0] * s + 16384) >> 15;
+	}
+};
+
+template<int SIZE>
+constexpr FFTTwiddleTable<SIZE> FixedFFT<SIZE>::twiddles;
+
+template<int SIZE, int WINDOW>
+struct FFTWindowTables {
+	static constexpr FFTWindowTable<SIZE> window = FFTTableBuilder<SIZE>::makeWindow((FFTWindow)WINDOW);
+};
+
+template<int SIZE, int WINDOW>
+constexpr FFTWindowTable<SIZE> FFTWindowTables<SIZE, WINDOW>::window;
+
+// DFT bins of SIZE Q15 samples by the Goertzel recurrence, scaled like
+// FixedFFT (|X| / SIZE). Coefficients are 2cos(2 pi k / SIZE) in Q29, so
+// bin 0's 2.0 fits in 32 bits; Q15 would detune the lowest bins by a
+// sizeable fraction of a bin. BINS
+// filters run side by side so each sample is loaded once for all of them
+// and their multiplies overlap.
+template<int SIZE, int BINS>
+void goertzelMagnitudes(const int16_t * samples, const int32_t * coefficients, uint16_t * magnitudes) {
+	int32_t s1[BINS] = {0};
+	int32_t s2[BINS] = {0};
+	for(int n = 0; n < SIZE; n++) {
+		int32_t x = samples[n];
+		for(int b = 0; b < BINS; b++) {
+			int32_t s0 = x + (int32_t)(((int64_t)coefficients[b] * s1[b]) >> 29) - s2[b];
+			s2[b] = s1[b];
+			s1[b] = s0;
+		}
+	}
+	for(int b = 0; b < BINS; b++) {
+		int64_t power = (int64_t)s1[b] * s1[b] + (int64_t)s2[b] * s2[b] -
+			(((int64_t)coefficients[b] * s1[b]) >> 29) * s2[b];
+		uint32_t scaled = (uint32_t)(power >> (2 * FixedFFT<SIZE>::BITS));
+		magnitudes[b] = scaled ? min((uint32_t)65535, sqrt_uint32(scaled)) : 0;
+	}
+}
+
+#ifndef __MKL26Z64__
+#include <Audio.h>
+
+// Windows the SIZE samples of the ring history, oldest at writePos,
+// transforms them in buffer (2 * SIZE, word aligned) and writes the
+// magnitudes of bins [first, end) to out[0...].
+template<int SIZE, int WINDOW>
+void windowedMagnitudes(const int16_t * history, int writePos, int16_t * buffer, int first, int end, uint16_t * out) {
+	typedef FixedFFT<SIZE> FFT;
+	const int16_t * window = FFTWindowTables<SIZE, WINDOW>::window.weights;
+	for(int n = 0; n < SIZE; n++) {
+		int32_t s = history[(writePos + n) & (SIZE - 1)];
+		int r = 2 * FFT::reverse(n);
+		buffer[r] = WINDOW == FFTWindow::Rectangular ? s : (s * window[n]) >> 15;
+		buffer[r + 1] = 0;
+	}
+	FFT::transform(buffer);
+	for(int i = first; i < end; i++) {
+		int32_t re = buffer[2 * i];
+		int32_t im = buffer[2 * i + 1];
+		uint32_t magsq = (uint32_t)(re * re) + (uint32_t)(im * im);
+		*out++ = magsq ? sqrt_uint32_approx(magsq) : 0;
+	}
+}
+
+// A spectrum analyzer in the Teensy Audio library's mold, for use in place
+// of AudioAnalyzeFFT1024: connect an AudioConnection to it and poll
+// available(). Every SIZE/OVERLAP samples it windows the last SIZE, runs
+// FixedFFT and leaves SIZE/2 magnitudes in output[], scaled like the
+// library's analyzers so autoscale and layouts carry over.
+//
+// At 44.1kHz a 256 point transform with OVERLAP 2 gives a frame every
+// 2.9ms over a 5.8ms window, where FFT1024 gives 11.6ms over 23ms.
+//
+// When the display bins read only a few FFT bins, selectBins() switches to
+// running a Goertzel filter per bin read instead of the whole transform.
+// The other outputs stay 0. AudioProcessor calls it from configureBins().
+template<int SIZE, int WINDOW = FFTWindow::Hann, int OVERLAP = 2>
+class FFTAnalyzer : public AudioStream {
+public:
+	static_assert(OVERLAP >= 1 && SIZE % OVERLAP == 0, "OVERLAP must divide SIZE");
+	static const int OUTPUT_SIZE = SIZE / 2;
+	typedef UniformSpectrum<OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ> Spectrum;
+	// samples between frames
+	static const int HOP = SIZE / OVERLAP;
+	// A Goertzel bin costs SIZE multiply-adds; the transform is log4(SIZE)
+	// passes plus a square root per output. On the host they break even
+	// at about 1.4 * log2(SIZE) bins (11 at 256 points, 14 at 1024), and
+	// cycle counts for the M4 come out about the same, so past this many
+	// bins the full FFT is used.
+	static const int MAX_SPARSE_BINS = FixedFFT<SIZE>::BITS * 4 / 3;
+
+	FFTAnalyzer() : AudioStream(1, inputQueueArray), writePos(0), sinceFrame(0), outputflag(false), sparseCount(0) {
+		memset(history, 0, sizeof(history));
+		memset(output, 0, sizeof(output));
+	}
+
+	// Computes only the FFT bins covered by the first count bins, if there
+	// are few enough of them, or the whole spectrum otherwise. Returns
+	// true if the sparse path was chosen.
+	bool selectBins(const DisplayBin * bins, int count) {
+		uint32_t used[(OUTPUT_SIZE + 31) / 32];
+		memset(used, 0, sizeof(used));
+		int total = 0;
+		for(int i = 0; i < count; i++) {
+			int start = constrain(bins[i].startFFTBin, 0, OUTPUT_SIZE - 1);
+			int end = constrain(bins[i].endFFTBin, start + 1, OUTPUT_SIZE);
+			for(int k = start; k < end; k++) {
+				if(!(used[k / 32] & (1UL << (k % 32)))) {
+					used[k / 32] |= 1UL << (k % 32);
+					total++;
+				}
+			}
+		}
+		// the audio interrupt runs the full FFT while the list changes
+		sparseCount = 0;
+		if(total > MAX_SPARSE_BINS)
+			return false;
+		int n = 0;
+		for(int k = 0; k < OUTPUT_SIZE; k++) {
+			if(used[k / 32] & (1UL << (k % 32))) {
+				sparseBins[n] = k;
+				sparseCoefficients[n] = (int32_t)lround(2.0 * cos(2.0 * M_PI * k / SIZE) * (1L << 29));
+				n++;
+			}
+		}
+		memset(output, 0, sizeof(output));
+		sparseCount = n;
+		return true;
+	}
+
+	bool isSparse() {
+		return sparseCount > 0;
+	}
+
+	bool available() {
+		if(outputflag) {
+			outputflag = false;
+			return true;
+		}
+		return false;
+	}
+
+	float read(unsigned int binNumber) {
+		return binNumber < (unsigned)OUTPUT_SIZE ? (float)output[binNumber] / 16384.0f : 0.0f;
+	}
+
+	// Appends samples to the window, computing a spectrum at every hop.
+	void write(const int16_t * samples, int count) {
+		while(count > 0) {
+			int n = min(count, min(HOP - sinceFrame, SIZE - writePos));
+			memcpy(history + writePos, samples, n * sizeof(int16_t));
+			writePos = (writePos + n) & (SIZE - 1);
+			sinceFrame += n;
+			samples += n;
+			count -= n;
+			if(sinceFrame == HOP) {
+				sinceFrame = 0;
+				compute();
+			}
+		}
+	}
+
+	virtual void update(void) {
+		audio_block_t * block = receiveReadOnly();
+		if(!block)
+			return;
+		write(block->data, AUDIO_BLOCK_SAMPLES);
+		release(block);
+	}
+
+	uint16_t output[OUTPUT_SIZE] __attribute__((aligned(4)));
+
+private:
+	int16_t history[SIZE];
+	int writePos;
+	int sinceFrame;
+	volatile bool outputflag;
+	int16_t buffer[2 * SIZE] __attribute__((aligned(4)));
+	audio_block_t * inputQueueArray[1];
+	volatile int sparseCount;
+	uint16_t sparseBins[MAX_SPARSE_BINS];
+	int32_t sparseCoefficients[MAX_SPARSE_BINS];
+
+	void compute() {
+		const int16_t * window = FFTWindowTables<SIZE, WINDOW>::window.weights;
+		int count = sparseCount;
+		if(count) {
+			for(int n = 0; n < SIZE; n++) {
+				int32_t s = history[(writePos + n) & (SIZE - 1)];
+				buffer[n] = WINDOW == FFTWindow::Rectangular ? s : (s * window[n]) >> 15;
+			}
+			uint16_t magnitudes[4];
+			int i = 0;
+			for(; i + 4 <= count; i += 4) {
+				goertzelMagnitudes<SIZE, 4>(buffer, sparseCoefficients + i, magnitudes);
+				for(int b = 0; b < 4; b++)
+					output[sparseBins[i + b]] = magnitudes[b];
+			}
+			for(; i < count; i++) {
+				goertzelMagnitudes<SIZE, 1>(buffer, sparseCoefficients + i, magnitudes);
+				output[sparseBins[i]] = magnitudes[0];
+			}
+			outputflag = true;
+			return;
+		}
+		// the oldest sample sits at writePos
+		windowedMagnitudes<SIZE, WINDOW>(history, writePos, buffer, 0, OUTPUT_SIZE, output);
+		outputflag = true;
+	}
+};
+
+// Narrows an analyzer to the FFT bins that bins read, where it can: the
+// Audio library's analyzers always compute everything.
+template<class FFT>
+inline bool selectFFTBins(FFT &, const DisplayBin *, int) {
+	return false;
+}
+
+template<int SIZE, int WINDOW, int OVERLAP>
+inline bool selectFFTBins(FFTAnalyzer<SIZE, WINDOW, OVERLAP> & fft, const DisplayBin * bins, int count) {
+	return fft.selectBins(bins, count);
+}
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _FIXEDPOINT_H
+#define _FIXEDPOINT_H
+
+#include <stdint.h>
+#include "sqrt_integer.h"
+
+// Runs the processor and renderer on integer/fixed-point math instead of
+// float. The Teensy LC has no FPU, so it is on there by default; define
+// FIXED_POINT_MATH to 0 or 1 before including the library to override.
+#ifndef FIXED_POINT_MATH
+#ifdef __MKL26Z64__
+#define FIXED_POINT_MATH 1
+#else
+#define FIXED_POINT_MATH 0
+#endif
+#endif
+
+// Autoscale values are Q8.8
+#define SCALE_FRACTION_BITS 8
+#define SCALE_ONE ((uint32_t)1 << SCALE_FRACTION_BITS)
+
+// Hues are Q8.24 turns of the color wheel, so a whole sweep fits in an
+// int32_t with room for the [-1, 2] range the sweep wanders over.
+#define HUE_FRACTION_BITS 24
+#define HUE_ONE ((int32_t)1 << HUE_FRACTION_BITS)
+
+// Converts a Q8.24 hue to the 0-255 wheel, wrapping like the float cast did.
+inline uint8_t hueToHue8(int32_t hue) {
+	return (uint8_t)(((hue >> 8) * 255) >> (HUE_FRACTION_BITS - 8));
+}
+
+// Q16.16 base-2 logarithms
+#define LOG2_FRACTION_BITS 16
+#define LOG2_ONE ((int32_t)1 << LOG2_FRACTION_BITS)
+
+// log2(x) for x > 0, within 0.01 of an octave. The mantissa's curve is
+// approximated by a parabola through 0, 1/2 and 1.
+inline int32_t log2Fixed(uint32_t x) {
+	int msb = 31 - __builtin_clz(x);
+	uint32_t f = msb >= 16 ? x >> (msb - 16) : x << (16 - msb);
+	f &= 0xFFFF;
+	uint32_t bend = (f * (65536 - f)) >> 16;
+	return ((int32_t)msb << LOG2_FRACTION_BITS) + f + ((bend * 22713) >> 16);
+}
+
+// 2^x for 0 <= x < 32, the inverse of log2Fixed.
+inline uint32_t exp2Fixed(int32_t x) {
+	int i = x >> LOG2_FRACTION_BITS;
+	uint32_t f = x & 0xFFFF;
+	uint32_t bend = (f * (65536 - f)) >> 16;
+	uint32_t m = 65536 + f - ((bend * 22489) >> 16);
+	return i >= 16 ? m << (i - 16) : m >> (16 - i);
+}
+
+#endif
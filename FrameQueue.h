@@ -0,0 +1,134 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _FRAMEQUEUE_H
+#define _FRAMEQUEUE_H
+
+#include <stdint.h>
+
+// A single producer, single consumer ring of CAPACITY preallocated frames.
+//
+// The producer and consumer each own one index and only read the other's,
+// so neither ever waits or locks. The indexes are loaded with acquire and
+// stored with release, which orders the frame copies against them: on a
+// Teensy that is a plain load or store plus a barrier, safe between an
+// interrupt and loop(), and on the host it is safe between threads.
+//
+// Every push is numbered, whether or not it fits. A push into a full ring
+// is an overrun and is lost; frames the consumer skips by taking the newest
+// are drops. Each counter has a single writer, so neither needs an atomic
+// increment (the Teensy LC has none).
+template<class T, int CAPACITY = 4>
+class FrameQueue {
+public:
+	static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+	FrameQueue() : slots(), head(0), tail(0), nextSequence(0), overruns(0), drops(0) {
+	}
+
+	// Producer: copies frame into the ring. Returns false on an overrun.
+	bool push(const T & frame) {
+		uint32_t sequence = nextSequence;
+		store(nextSequence, sequence + 1);
+		uint32_t h = head;
+		if(h - load(tail) == CAPACITY) {
+			store(overruns, overruns + 1);
+			return false;
+		}
+		Slot & slot = slots[h & (CAPACITY - 1)];
+		slot.frame = frame;
+		slot.sequence = sequence;
+		store(head, h + 1);
+		return true;
+	}
+
+	// Consumer: takes the oldest frame. Returns false if there is none.
+	bool pop(T & frame, uint32_t * sequence = NULL) {
+		uint32_t t = tail;
+		if(load(head) == t)
+			return false;
+		take(t, frame, sequence);
+		store(tail, t + 1);
+		return true;
+	}
+
+	// Consumer: takes the newest frame and drops the older ones. Returns
+	// false if there is none.
+	bool popLatest(T & frame, uint32_t * sequence = NULL) {
+		uint32_t t = tail;
+		uint32_t h = load(head);
+		if(h == t)
+			return false;
+		// the producer never writes the slots between tail and head
+		take(h - 1, frame, sequence);
+		if(h - t > 1)
+			store(drops, drops + (h - t - 1));
+		store(tail, h);
+		return true;
+	}
+
+	// Frames waiting for the consumer
+	int size() {
+		return (int)(load(head) - load(tail));
+	}
+
+	// Pushes that found the ring full
+	uint32_t getOverruns() {
+		return load(overruns);
+	}
+
+	// Frames skipped by popLatest()
+	uint32_t getDrops() {
+		return load(drops);
+	}
+
+	// Pushes so far, overruns included
+	uint32_t getPushes() {
+		return load(nextSequence);
+	}
+
+private:
+	struct Slot {
+		T frame;
+		uint32_t sequence;
+	};
+
+	Slot slots[CAPACITY];
+	// written by the producer
+	uint32_t head;
+	// written by the consumer
+	uint32_t tail;
+	uint32_t nextSequence;
+	uint32_t overruns;
+	uint32_t drops;
+
+	void take(uint32_t index, T & frame, uint32_t * sequence) {
+		const Slot & slot = slots[index & (CAPACITY - 1)];
+		frame = slot.frame;
+		if(sequence)
+			*sequence = slot.sequence;
+	}
+
+	static uint32_t load(const uint32_t & x) {
+		return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+	}
+
+	static void store(uint32_t & x, uint32_t value) {
+		__atomic_store_n(&x, value, __ATOMIC_RELEASE);
+	}
+};
+
+#endif
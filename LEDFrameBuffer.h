@@ -0,0 +1,186 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _LEDFRAMEBUFFER_H
+#define _LEDFRAMEBUFFER_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+#include "FastLED.h"
+#include "LEDOutputStage.h"
+#include "Profiler.h"
+
+// A WS2811 clocks 24 bits at 800kHz, 30us a pixel, then latches on a 50us
+// low. This is the wire time a show() takes, however it is driven. Strips
+// driven in parallel all clock at once, so the frame takes as long as its
+// longest strip.
+inline uint32_t ws2811Micros(int numLeds, int strips = 1) {
+	return (numLeds + strips - 1) / strips * 30UL + 50;
+}
+
+// Sends through FastLED. Register the frame buffer's front() with
+// LEDS.addLeds(). FastLED's show() returns when the strip is written, so
+// nothing overlaps it, but the sketch reads the same either way. Give the
+// number of strips when they are added with parallel output
+// (WS2811_PORTD and the like).
+class FastLEDSink {
+public:
+	FastLEDSink(int strips = 1) : strips(strips) {
+	}
+
+	void begin(const CRGB *, int) {
+		LEDS.show();
+	}
+
+	bool busy() {
+		return false;
+	}
+
+	uint32_t transferMicros(int numLeds) {
+		return ws2811Micros(numLeds, strips);
+	}
+
+private:
+	int strips;
+};
+
+// Sends through a driver that transmits by DMA and returns from show() at
+// once, like OctoWS2811 or WS2812Serial: anything with setPixel(i, r, g, b),
+// show() and busy(). OctoWS2811 sends its 8 strips at once.
+template<class DRIVER>
+class PixelDriverSink {
+public:
+	PixelDriverSink(DRIVER & driver, int strips = 1) : driver(driver), strips(strips) {
+	}
+
+	void begin(const CRGB * frame, int numLeds) {
+		for(int i = 0; i < numLeds; i++)
+			driver.setPixel(i, frame[i].r, frame[i].g, frame[i].b);
+		driver.show();
+	}
+
+	bool busy() {
+		return driver.busy();
+	}
+
+	uint32_t transferMicros(int numLeds) {
+		return ws2811Micros(numLeds, strips);
+	}
+
+private:
+	DRIVER & driver;
+	int strips;
+};
+
+// Two frames of NUM_LEDS pixels: renderers draw into back() while SINK
+// sends front(). show() is the frame boundary. It waits for the last send
+// to finish, copies the back buffer to the front and starts sending it,
+// and the back buffer keeps its pixels for the fades of the next frame.
+// With an LEDOutputStage set, the copy is where the frame is corrected.
+//
+// Every show() adds the wire time of the frame and the time the caller
+// was held up, in the wait and in the sink, so getHiddenMicros() is how
+// much of the sending happened under other work.
+template<int NUM_LEDS, class SINK = FastLEDSink>
+class LEDFrameBuffer {
+public:
+	LEDFrameBuffer(SINK & sink) : sink(sink), stage(NULL), frames(0), transferTotal(0), blockedTotal(0) {
+		memset(buffers, 0, sizeof(buffers));
+	}
+
+	// Where renderers draw
+	CRGB * back() {
+		return buffers[0];
+	}
+
+	// What the sink sends
+	CRGB * front() {
+		return buffers[1];
+	}
+
+	// Corrects every frame shown with stage, or copies it as drawn with NULL
+	void setOutputStage(LEDOutputStage * stage) {
+		this->stage = stage;
+	}
+
+	// rotate pixels at the start of the back buffer go out last, for a
+	// renderer that keeps its frame as a ring (see SpectrogramRenderer).
+	void show(int rotate = 0) {
+		AUDIO_PROFILE(ProfileShow);
+		uint32_t start = micros();
+		while(sink.busy())
+			yield();
+		if(stage != NULL) {
+			stage->apply(front(), back() + rotate, NUM_LEDS - rotate);
+			stage->apply(front() + NUM_LEDS - rotate, back(), rotate, NUM_LEDS - rotate);
+			stage->nextFrame();
+		}
+		else {
+			memcpy(front(), back() + rotate, (NUM_LEDS - rotate) * sizeof(CRGB));
+			memcpy(front() + NUM_LEDS - rotate, back(), rotate * sizeof(CRGB));
+		}
+		sink.begin(front(), NUM_LEDS);
+		blockedTotal += micros() - start;
+		transferTotal += sink.transferMicros(NUM_LEDS);
+		frames++;
+	}
+
+	// Waits for the last frame to be sent
+	void flush() {
+		uint32_t start = micros();
+		while(sink.busy())
+			yield();
+		blockedTotal += micros() - start;
+	}
+
+	uint32_t getFrames() {
+		return frames;
+	}
+
+	// Wire time of every frame shown
+	uint32_t getTransferMicros() {
+		return transferTotal;
+	}
+
+	// Time show() and flush() held the caller up
+	uint32_t getBlockedMicros() {
+		return blockedTotal;
+	}
+
+	// Wire time that overlapped other work
+	uint32_t getHiddenMicros() {
+		return transferTotal > blockedTotal ? transferTotal - blockedTotal : 0;
+	}
+
+	void printReport() {
+		Serial.printf("Shows: %lu, %lu us on the wire, %lu us blocked, %lu%% hidden\n", (unsigned long)frames,
+			(unsigned long)transferTotal, (unsigned long)blockedTotal,
+			(unsigned long)(transferTotal ? (uint64_t)getHiddenMicros() * 100 / transferTotal : 0));
+	}
+
+private:
+	SINK & sink;
+	LEDOutputStage * stage;
+	CRGB buffers[2][NUM_LEDS];
+	uint32_t frames;
+	uint32_t transferTotal;
+	uint32_t blockedTotal;
+};
+
+#endif
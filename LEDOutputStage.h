@@ -0,0 +1,117 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _LEDOUTPUTSTAGE_H
+#define _LEDOUTPUTSTAGE_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+#include <math.h>
+#include "FastLED.h"
+
+// Gamma, white balance and brightness for the pixels on their way to the
+// strip, with temporal dithering of what falls between two output levels.
+//
+// Renderers work in perceived brightness, but the LEDs are linear, so a
+// fade steps visibly at the dim end and most of the 8 bits go to the
+// bright half. Each channel gets a table of 256 levels in 8.8 fixed point,
+// built by configure() and not touched per frame. The fraction decides
+// whether the pixel goes up a level this frame against a threshold that
+// cycles over 8 frames and is offset along the strip, so a level between
+// two outputs averages out over 8 frames without the strip flickering as
+// one. A pixel then costs three table reads and three compares.
+//
+// Turn off FastLED's own brightness, color correction and dithering
+// (LEDS.setBrightness(255), LEDS.setDither(0)) when showing through this.
+// The tables take 1.5K of RAM.
+class LEDOutputStage {
+public:
+	LEDOutputStage() : dither(true), phase(0) {
+		configure(1.0f, CRGB(255, 255, 255));
+	}
+
+	// gamma is the LEDs' response (2.2 to 2.8 for WS2811s), white the
+	// channel scale that makes full white look white (FastLED's
+	// TypicalLEDStrip is 255, 176, 240), brightness a scale over both.
+	void configure(float gamma, CRGB white, uint8_t brightness = 255) {
+		const uint8_t scale[3] = {white.r, white.g, white.b};
+		for(int level = 0; level < 256; level++) {
+			float g = powf(level / 255.0f, gamma);
+			for(int c = 0; c < 3; c++)
+				tables[c][level] = (uint16_t)(g * scale[c] * brightness / 255.0f * 256.0f + 0.5f);
+		}
+	}
+
+	// Dithering is on by default; off, levels round to the nearest output.
+	void setDithering(bool enable) {
+		dither = enable;
+	}
+
+	bool getDithering() {
+		return dither;
+	}
+
+	// The 8.8 output level of an input level on channel c (0 red, 1 green,
+	// 2 blue)
+	uint16_t level(int c, uint8_t value) {
+		return tables[c][value];
+	}
+
+	// Corrects count pixels of src into dst. firstPixel is where src starts
+	// on the strip, when a frame is corrected in parts.
+	void apply(CRGB * dst, const CRGB * src, int count, int firstPixel = 0) {
+		if(!dither) {
+			for(int i = 0; i < count; i++) {
+				dst[i].r = (tables[0][src[i].r] + 128) >> 8;
+				dst[i].g = (tables[1][src[i].g] + 128) >> 8;
+				dst[i].b = (tables[2][src[i].b] + 128) >> 8;
+			}
+			return;
+		}
+		for(int i = 0; i < count; i++) {
+			uint8_t threshold = threshold8(phase + firstPixel + i);
+			uint16_t r = tables[0][src[i].r], g = tables[1][src[i].g], b = tables[2][src[i].b];
+			dst[i].r = (r >> 8) + ((uint8_t)r > threshold);
+			dst[i].g = (g >> 8) + ((uint8_t)g > threshold);
+			dst[i].b = (b >> 8) + ((uint8_t)b > threshold);
+		}
+	}
+
+	// Moves the dithering on, once a frame after the last apply()
+	void nextFrame() {
+		phase++;
+	}
+
+private:
+	// The threshold of step n of 8: n's 3 bits reversed, so the extra
+	// levels of any fraction are spread evenly over the 8 frames, and set
+	// in the middle of their 32nd of the level. A fraction f goes up on
+	// round(f / 32) frames of 8, so the mean is within 1/16 of a level of
+	// the table and is not pulled up.
+	static uint8_t threshold8(int n) {
+		return ((((0x73516240UL >> ((n & 7) << 2)) & 7) << 5) | 15);
+	}
+
+	// per channel, the output level in 8.8, at most 255.0
+	uint16_t tables[3][256];
+	bool dither;
+	uint8_t phase;
+};
+
+#endif
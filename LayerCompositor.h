@@ -0,0 +1,172 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _LAYERCOMPOSITOR_H
+#define _LAYERCOMPOSITOR_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+#include "FastLED.h"
+
+// How a layer combines with the layers under it, before its opacity.
+// Normal covers them, Add sums, Screen brightens the way two projectors
+// on one wall do, Lighten keeps the brighter of the two and Multiply
+// darkens by the layer, which works as a mask.
+enum BlendMode {
+	Normal,
+	Add,
+	Screen,
+	Lighten,
+	Multiply
+};
+
+// Blends up to MAX_LAYERS pixel buffers into an output buffer, bottom layer
+// first, each with its own blend mode and opacity (255 opaque, 0 off).
+// Every output pixel is worked out through all of the layers and written
+// once, so the output is never partly drawn and a layer costs a few
+// scale8()s a pixel. Renderers draw into their own layers, and nothing
+// shows the strip until the caller does.
+template<int MAX_LAYERS>
+class LayerCompositor {
+public:
+	LayerCompositor() : count(0) {
+	}
+
+	// Adds a layer over the others, of at least as many pixels as are
+	// composed. Returns its index, or -1 when there are MAX_LAYERS already.
+	int addLayer(const CRGB * pixels, BlendMode mode = Normal, uint8_t opacity = 255) {
+		if(count >= MAX_LAYERS)
+			return -1;
+		layers[count].pixels = pixels;
+		layers[count].mode = mode;
+		layers[count].opacity = opacity;
+		return count++;
+	}
+
+	void clear() {
+		count = 0;
+	}
+
+	int getLayerCount() {
+		return count;
+	}
+
+	void setOpacity(int layer, uint8_t opacity) {
+		layers[layer].opacity = opacity;
+	}
+
+	uint8_t getOpacity(int layer) {
+		return layers[layer].opacity;
+	}
+
+	void setBlendMode(int layer, BlendMode mode) {
+		layers[layer].mode = mode;
+	}
+
+	void setPixels(int layer, const CRGB * pixels) {
+		layers[layer].pixels = pixels;
+	}
+
+	// Blends numLeds pixels of every layer into out, over black
+	void compose(CRGB * out, int numLeds) {
+		// the layers that show, so the pixel loop skips the rest
+		Layer visible[MAX_LAYERS];
+		int shown = 0;
+		for(int l = 0; l < count; l++) {
+			if(layers[l].opacity > 0)
+				visible[shown++] = layers[l];
+		}
+		for(int i = 0; i < numLeds; i++) {
+			CRGB pixel(0, 0, 0);
+			for(int l = 0; l < shown; l++)
+				blend(pixel, visible[l].pixels[i], visible[l].mode, visible[l].opacity);
+			out[i] = pixel;
+		}
+	}
+
+	// top blended over pixel, the mode picked once for the three channels
+	static void blend(CRGB & pixel, const CRGB & top, BlendMode mode, uint8_t opacity) {
+		CRGB blended;
+		switch(mode) {
+		case Add:
+			pixel.r = qadd8(pixel.r, scale8(top.r, opacity));
+			pixel.g = qadd8(pixel.g, scale8(top.g, opacity));
+			pixel.b = qadd8(pixel.b, scale8(top.b, opacity));
+			return;
+		case Screen:
+			blended.r = 255 - scale8(255 - pixel.r, 255 - top.r);
+			blended.g = 255 - scale8(255 - pixel.g, 255 - top.g);
+			blended.b = 255 - scale8(255 - pixel.b, 255 - top.b);
+			break;
+		case Lighten:
+			blended.r = max(pixel.r, top.r);
+			blended.g = max(pixel.g, top.g);
+			blended.b = max(pixel.b, top.b);
+			break;
+		case Multiply:
+			blended.r = scale8(pixel.r, top.r);
+			blended.g = scale8(pixel.g, top.g);
+			blended.b = scale8(pixel.b, top.b);
+			break;
+		default:
+			blended = top;
+			break;
+		}
+		if(opacity == 255) {
+			pixel = blended;
+		}
+		else {
+			pixel.r = lerp8by8(pixel.r, blended.r, opacity);
+			pixel.g = lerp8by8(pixel.g, blended.g, opacity);
+			pixel.b = lerp8by8(pixel.b, blended.b, opacity);
+		}
+	}
+
+	// One channel of top blended over under
+	static uint8_t blend(uint8_t under, uint8_t top, BlendMode mode, uint8_t opacity) {
+		switch(mode) {
+		case Add:
+			return qadd8(under, scale8(top, opacity));
+		case Screen:
+			top = 255 - scale8(255 - under, 255 - top);
+			break;
+		case Lighten:
+			top = max(under, top);
+			break;
+		case Multiply:
+			top = scale8(under, top);
+			break;
+		default:
+			break;
+		}
+		return opacity == 255 ? top : lerp8by8(under, top, opacity);
+	}
+
+private:
+	struct Layer {
+		const CRGB * pixels;
+		BlendMode mode;
+		uint8_t opacity;
+	};
+
+	Layer layers[MAX_LAYERS];
+	int count;
+};
+
+#endif
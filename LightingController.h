@@ -23,6 +23,11 @@ limitations under the License.
 	#include "WProgram.h"
 #endif
 #include "FastLED/FastLED.h"
+
+// Fills the strip as BOX_COUNT equal boxes of color, each fading to the
+// color it was last given. It draws into its own leds and leaves showing
+// them to the caller, so its boxes can be a layer under the audio (see
+// LayerCompositor and AudioVisualizer::init()).
 template<uint8_t BOX_COUNT>
 	class LightingControllerClass
 {
@@ -32,6 +37,9 @@ private:
 	 CRGB * leds;
 	 int numLeds;
 	 int boxSize;
+	 // each box fades from start to destination as fadePosition goes to MAX_FADE
+	 CRGB start[BOX_COUNT];
+	 CRGB current[BOX_COUNT];
 	 CRGB destination[BOX_COUNT];
 	 uint16_t fadePosition[BOX_COUNT];
 	 int16_t fadeSpeed;
@@ -42,8 +50,11 @@ private:
 		this->numLeds = numLEDS;
 		this->boxSize = numLEDS/BOX_COUNT;
 		this->fadeSpeed = fadeSpeed;
-		memset(destination, 0, sizeof(CRGB)*BOX_COUNT);
-		memset(fadePosition, 0, sizeof(uint16_t)*BOX_COUNT);
+		fill_solid(start, BOX_COUNT, CRGB::Black);
+		fill_solid(current, BOX_COUNT, CRGB::Black);
+		fill_solid(destination, BOX_COUNT, CRGB::Black);
+		for(int i = 0; i < BOX_COUNT; i++)
+			fadePosition[i] = MAX_FADE;
 	}
 
 	void setColor(CRGB color, bool fade = true) {
@@ -52,45 +63,41 @@ private:
 		}
 	}
 	CRGB getColor(int box) {
-		return leds[box*boxSize];
+		return current[box];
 	}
 	void setColor(int box, CRGB color, bool fade = true) {
+		start[box] = current[box];
 		destination[box] = color;
 		fadePosition[box] = fade ? 0 : MAX_FADE;
 	}
 
 	bool isRendered(int box) {
-		return getColor(box) == destination[box];
+		return fadePosition[box] >= MAX_FADE;
 
 	}
 
+	// Steps the fades and fills the boxes. Call LEDS.show(), or compose
+	// the layers, after.
 	void render() {
-		CRGB boxColor;
 		for(int i = 0; i < BOX_COUNT; i++) {
 			if(fadePosition[i] >= MAX_FADE) {
-				boxColor = destination[i];
+				current[i] = destination[i];
 			}
 			else {
-				boxColor = scaleColor(leds[i*boxSize],destination[i], fadePosition[i]);
+				current[i] = scaleColor(start[i], destination[i], fadePosition[i]);
 				fadePosition[i] += (uint16_t)fadeSpeed;
 			}
 			for(int j = i*boxSize; j < (i*boxSize)+boxSize; j++)
-				leds[j] = boxColor;
+				leds[j] = current[i];
 		}
-		LEDS.show();
 	}
 
-	CRGB  scaleColor(CRGB  from, CRGB to, uint16_t scale) {
-		//  current+((destionation-current)/(steps-step))
-		CRGB retval(from);
-		uint16_t divisor = (MAX_FADE/fadeSpeed)-(scale/fadeSpeed);
-		retval.r += (to.r - retval.r)/divisor;
-		retval.g += (to.g - retval.g)/divisor;
-		retval.b += (to.b - retval.b)/divisor;
-		return retval;
+	// from partway to to, scale of MAX_FADE, in 8 bit fixed point
+	static CRGB scaleColor(CRGB from, CRGB to, uint16_t scale) {
+		fract8 amount = scale >> 7;
+		return CRGB(lerp8by8(from.r, to.r, amount), lerp8by8(from.g, to.g, amount), lerp8by8(from.b, to.b, amount));
 	}
 };
 
-
 #endif
 
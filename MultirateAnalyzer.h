@@ -0,0 +1,204 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MULTIRATEANALYZER_H
+#define _MULTIRATEANALYZER_H
+
+#include "FixedFFT.h"
+
+template<int TAPS>
+struct DecimatorTaps {
+	int16_t taps[TAPS];
+};
+
+// A lowpass for decimating by FACTOR, built by the compiler into flash: a
+// Hamming windowed sinc cut off at the decimated Nyquist, Q15 with unity
+// gain at DC. TAPS_PER_PHASE taps per output phase, so TAPS_PER_PHASE *
+// FACTOR in all. 14 per phase passes 3/4 of the decimated band and is
+// down about 50dB by the time aliases would land back in it.
+template<int FACTOR, int TAPS_PER_PHASE>
+struct DecimatorTapBuilder {
+	static const int TAPS = FACTOR * TAPS_PER_PHASE;
+
+	static constexpr double tap(int n) {
+		double x = (n - (TAPS - 1) / 2.0) / FACTOR;
+		double sinc = x == 0.0 ? 1.0 : constSin(CONST_PI * x) / (CONST_PI * x);
+		return sinc * (0.54 - 0.46 * constCos(2.0 * CONST_PI * n / (TAPS - 1)));
+	}
+
+	static constexpr DecimatorTaps<TAPS> makeTaps() {
+		DecimatorTaps<TAPS> t = {};
+		double total = 0.0;
+		for(int n = 0; n < TAPS; n++)
+			total += tap(n);
+		for(int n = 0; n < TAPS; n++)
+			t.taps[n] = (int16_t)constRound(tap(n) / total * 32768.0);
+		return t;
+	}
+};
+
+// Lowpass filters and keeps one sample in FACTOR. The filter is only run
+// for the samples kept, the sum over its FACTOR polyphase branches, so
+// each input costs TAPS_PER_PHASE multiply-adds.
+template<int FACTOR, int TAPS_PER_PHASE = 14>
+class PolyphaseDecimator {
+public:
+	static const int TAPS = FACTOR * TAPS_PER_PHASE;
+	static constexpr DecimatorTaps<TAPS> filter = DecimatorTapBuilder<FACTOR, TAPS_PER_PHASE>::makeTaps();
+
+	PolyphaseDecimator() : pos(0), phase(0) {
+		memset(history, 0, sizeof(history));
+	}
+
+	// Filters count samples into out, which needs room for
+	// count / FACTOR + 1. Returns the number written.
+	int write(const int16_t * samples, int count, int16_t * out) {
+		int written = 0;
+		for(int i = 0; i < count; i++) {
+			// each sample is stored twice so the last TAPS are always contiguous
+			history[pos] = history[pos + TAPS] = samples[i];
+			pos = pos + 1 == TAPS ? 0 : pos + 1;
+			if(++phase < FACTOR)
+				continue;
+			phase = 0;
+			// the taps are symmetric, so oldest-first order needs no reversal
+			const int16_t * x = history + pos;
+			int32_t sum = 0;
+			for(int n = 0; n < TAPS; n++)
+				sum += (int32_t)filter.taps[n] * x[n];
+			out[written++] = (int16_t)constrain((sum + 16384) >> 15, -32768, 32767);
+		}
+		return written;
+	}
+
+private:
+	int16_t history[2 * TAPS];
+	int pos;
+	int phase;
+};
+
+template<int FACTOR, int TAPS_PER_PHASE>
+constexpr DecimatorTaps<PolyphaseDecimator<FACTOR, TAPS_PER_PHASE>::TAPS> PolyphaseDecimator<FACTOR, TAPS_PER_PHASE>::filter;
+
+#ifndef __MKL26Z64__
+#include <Audio.h>
+
+// A spectrum analyzer with finer bins in the bass, used like FFTAnalyzer.
+//
+// Two SIZE point FFTs run each hop: one over the full rate signal and one
+// over the signal decimated by DECIMATION, whose bins are DECIMATION times
+// narrower. output[] is the decimated spectrum up to 3/4 of its Nyquist
+// followed by the full rate spectrum from there up (see MultirateSpectrum).
+// Both are scaled like FFTAnalyzer, so a tone reads the same either side
+// of the splice.
+//
+// The default 256 point, decimate by 8 analyzer has 21.5Hz bins up to
+// 2kHz and 172Hz bins above, and a frame every 2.9ms. A single 2048 point
+// FFT has 21.5Hz bins everywhere but costs about four times as much per
+// frame. The bass window is DECIMATION times longer than the treble one,
+// 46ms at the default, which is what buys the resolution.
+//
+// The two paths are bare FixedFFT transforms over their own sample rings,
+// sharing one transform buffer and writing straight into output[].
+template<int SIZE = 256, int DECIMATION = 8, int WINDOW = FFTWindow::Hann, int OVERLAP = 2>
+class MultirateAnalyzer : public AudioStream {
+public:
+	typedef MultirateSpectrum<SIZE, DECIMATION, AUDIO_SAMPLE_RATE_MHZ> Spectrum;
+	static const int OUTPUT_SIZE = Spectrum::SIZE;
+	// full rate samples between frames
+	static const int HOP = SIZE / OVERLAP;
+
+	static_assert(HOP % DECIMATION == 0, "DECIMATION must divide the hop");
+
+	MultirateAnalyzer() : AudioStream(1, inputQueueArray), highPos(0), lowPos(0), sinceFrame(0), outputflag(false) {
+		memset(high, 0, sizeof(high));
+		memset(low, 0, sizeof(low));
+		memset(output, 0, sizeof(output));
+	}
+
+	bool available() {
+		if(outputflag) {
+			outputflag = false;
+			return true;
+		}
+		return false;
+	}
+
+	float read(unsigned int binNumber) {
+		return binNumber < (unsigned)OUTPUT_SIZE ? (float)output[binNumber] / 16384.0f : 0.0f;
+	}
+
+	// Appends samples to both paths, transforming them at every hop.
+	void write(const int16_t * samples, int count) {
+		int16_t decimated[HOP / DECIMATION + 1];
+		while(count > 0) {
+			int n = min(count, HOP - sinceFrame);
+			append(high, highPos, samples, n);
+			append(low, lowPos, decimated, decimator.write(samples, n, decimated));
+			sinceFrame += n;
+			samples += n;
+			count -= n;
+			// a hop of full rate samples is exactly a hop of decimated ones
+			if(sinceFrame == HOP) {
+				sinceFrame = 0;
+				compute();
+			}
+		}
+	}
+
+	virtual void update(void) {
+		audio_block_t * block = receiveReadOnly();
+		if(!block)
+			return;
+		write(block->data, AUDIO_BLOCK_SAMPLES);
+		release(block);
+	}
+
+	uint16_t output[OUTPUT_SIZE] __attribute__((aligned(4)));
+
+private:
+	PolyphaseDecimator<DECIMATION> decimator;
+	// the last SIZE samples at the full and the decimated rate, the oldest
+	// at highPos and lowPos
+	int16_t high[SIZE];
+	int16_t low[SIZE];
+	int highPos;
+	int lowPos;
+	int sinceFrame;
+	volatile bool outputflag;
+	int16_t buffer[2 * SIZE] __attribute__((aligned(4)));
+	audio_block_t * inputQueueArray[1];
+
+	static void append(int16_t * ring, int & pos, const int16_t * samples, int count) {
+		while(count > 0) {
+			int n = min(count, SIZE - pos);
+			memcpy(ring + pos, samples, n * sizeof(int16_t));
+			pos = (pos + n) & (SIZE - 1);
+			samples += n;
+			count -= n;
+		}
+	}
+
+	void compute() {
+		windowedMagnitudes<SIZE, WINDOW>(low, lowPos, buffer, 0, Spectrum::LOW_BINS, output);
+		windowedMagnitudes<SIZE, WINDOW>(high, highPos, buffer, Spectrum::HIGH_START, SIZE / 2,
+			output + Spectrum::LOW_BINS);
+		outputflag = true;
+	}
+};
+#endif
+
+#endif
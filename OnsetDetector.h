@@ -0,0 +1,216 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _ONSETDETECTOR_H
+#define _ONSETDETECTOR_H
+
+#include "AudioStructures.h"
+
+// Spectral flux onset detection and tempo tracking over the display bin
+// sums, one frame at a time.
+//
+// The flux is the total rise, in octaves, of every bin's level since the
+// previous frame. A frame is an onset when its flux clears the running mean
+// by sensitivity running deviations; the decision is made on the frame that
+// caused it, so no latency is added.
+//
+// The tempo comes from an autocorrelation of the flux above its mean over
+// the last HISTORY frames. Each lag's correlation is a leaky sum updated
+// with one multiply per frame. The beat phase runs freely at the best lag
+// and is pulled toward onsets that land near the beat.
+//
+// Everything is integer math, shared by the float and fixed-point builds.
+template<int FREQ_BINS, int HISTORY = 96>
+class OnsetDetector {
+public:
+	OnsetDetector() : tempoEnabled(true) {
+		setSensitivity(2 << 4);
+		setFloor(256);
+		setTempoRange(70, 180);
+		reset();
+	}
+
+	void reset() {
+		memset(logLevels, 0, sizeof(logLevels));
+		memset(novelty, 0, sizeof(novelty));
+		memset(correlation, 0, sizeof(correlation));
+		frames = 0;
+		head = 0;
+		mean = 0;
+		deviation = 0;
+		framesSinceOnset = 0;
+		framePeriod = 11610;
+		phase = 0;
+		phaseStep = 0;
+		bpm = 0;
+	}
+
+	// Deviations above the mean flux for an onset, Q4.4
+	void setSensitivity(uint8_t deviations) {
+		sensitivity = deviations;
+	}
+
+	// Added to every bin sum before the log, so changes near silence don't
+	// count as octaves of flux
+	void setFloor(uint32_t level) {
+		floor = max((uint32_t)1, level);
+	}
+
+	void setTempoRange(uint8_t minBpm, uint8_t maxBpm) {
+		this->minBpm = max(1, (int)minBpm);
+		this->maxBpm = max((int)this->minBpm, (int)maxBpm);
+	}
+
+	void enableTempo(bool enable) {
+		tempoEnabled = enable;
+		if(!enable) {
+			bpm = 0;
+			phaseStep = 0;
+		}
+	}
+
+	// Runs one frame of bin sums, elapsedMicros after the previous one, and
+	// writes the onset and beat fields of data.
+	void update(const uint32_t * sums, uint32_t elapsedMicros, FFTBinData<FREQ_BINS> & data) {
+		int32_t flux = 0;
+		for(int i = 0; i < FREQ_BINS; i++) {
+			int32_t level = log2Fixed(sums[i] + floor);
+			if(level > logLevels[i])
+				flux += level - logLevels[i];
+			logLevels[i] = level;
+		}
+		// the first frame rises from nothing; let the statistics settle
+		if(frames < WARMUP_FRAMES) {
+			frames++;
+			flux = frames == 1 ? 0 : flux;
+		}
+		else if(elapsedMicros && elapsedMicros < 100000) {
+			framePeriod += ((int32_t)elapsedMicros - (int32_t)framePeriod) / 16;
+		}
+
+		int32_t above = flux - mean;
+		uint32_t threshold = (deviation * sensitivity >> 4) + MINIMUM_FLUX;
+		if(framesSinceOnset < 0xFFFF)
+			framesSinceOnset++;
+		bool onset = frames >= WARMUP_FRAMES && above > 0 && (uint32_t)above > threshold &&
+			framesSinceOnset * framePeriod >= REFRACTORY_MICROS;
+		data.onset = onset;
+		data.onsetStrength = onset ? min((int32_t)255, (above << 5) / (int32_t)(deviation + 1)) : 0;
+		if(onset)
+			framesSinceOnset = 0;
+		mean += (flux - mean) / 16;
+		deviation += ((above < 0 ? -above : above) - (int32_t)deviation) / 16;
+
+		if(tempoEnabled)
+			updateTempo(above > 0 ? above : 0, onset);
+		uint16_t lastPhase = phase;
+		phase += phaseStep;
+		data.beat = phaseStep && phase < lastPhase;
+		data.beatPhase = phase >> 8;
+		data.tempo = bpm;
+	}
+
+	uint8_t getTempo() {
+		return bpm;
+	}
+
+	// The mean time between frames, microseconds
+	uint32_t getFramePeriod() {
+		return framePeriod;
+	}
+
+private:
+	static const int WARMUP_FRAMES = 8;
+	// a quarter octave over the whole spectrum, Q16.16
+	static const int32_t MINIMUM_FLUX = LOG2_ONE / 4;
+	static const uint32_t REFRACTORY_MICROS = 80000;
+	// the correlation forgets with a time constant of 2^8 frames
+	static const int DECAY_BITS = 8;
+
+	bool tempoEnabled;
+	uint8_t sensitivity;
+	uint32_t floor;
+	uint8_t minBpm;
+	uint8_t maxBpm;
+
+	int32_t logLevels[FREQ_BINS];
+	uint8_t frames;
+	int32_t mean;
+	uint32_t deviation;
+	uint16_t framesSinceOnset;
+	uint32_t framePeriod;
+
+	// flux above the mean, 1/64 octave steps, newest at head
+	uint16_t novelty[HISTORY];
+	int head;
+	uint32_t correlation[HISTORY];
+	// Q0.16 of a beat
+	uint16_t phase;
+	uint16_t phaseStep;
+	uint8_t bpm;
+
+	void updateTempo(int32_t above, bool onset) {
+		// 2047 keeps the products under 2^22 and the leaky sums under 2^30
+		uint32_t n = min((int32_t)2047, above >> 10);
+		head = head + 1 == HISTORY ? 0 : head + 1;
+		novelty[head] = n;
+
+		uint32_t framesPerMinute = 60000000UL / framePeriod;
+		int minLag = max(2, (int)(framesPerMinute / maxBpm));
+		int maxLag = min(HISTORY - 2, (int)(framesPerMinute / minBpm));
+		int best = 0;
+		uint32_t total = 0;
+		for(int lag = minLag - 1; lag <= maxLag + 1; lag++) {
+			int past = head - lag;
+			if(past < 0)
+				past += HISTORY;
+			correlation[lag] += n * novelty[past] - (correlation[lag] >> DECAY_BITS);
+			if(lag >= minLag && lag <= maxLag) {
+				total += correlation[lag] >> 4;
+				if(!best || correlation[lag] > correlation[best])
+					best = lag;
+			}
+		}
+		if(!best || maxLag < minLag)
+			return;
+
+		// a tempo only when the best lag stands well clear of the average
+		uint32_t average = total / (maxLag - minLag + 1);
+		if((correlation[best] >> 4) * 2 < average * 3) {
+			bpm = 0;
+			phaseStep = 0;
+			return;
+		}
+		// the peak between the neighbouring lags, Q8.8 frames
+		int64_t y0 = correlation[best - 1];
+		int64_t y1 = correlation[best];
+		int64_t y2 = correlation[best + 1];
+		int64_t curvature = y0 - 2 * y1 + y2;
+		int32_t offset = curvature < 0 ? (int32_t)((y0 - y2) * 128 / curvature) : 0;
+		uint32_t period = ((uint32_t)best << 8) + offset;
+		phaseStep = (uint32_t)(65536UL << 8) / period;
+		bpm = min((uint32_t)255, ((framesPerMinute << 8) + period / 2) / period);
+
+		// pull the phase toward onsets within a quarter beat of it
+		if(onset) {
+			int16_t error = (int16_t)phase;
+			if(error > -16384 && error < 16384)
+				phase -= error / 4;
+		}
+	}
+};
+
+#endif
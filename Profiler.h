@@ -0,0 +1,313 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+#if !defined(__arm__)
+	#include <chrono>
+#endif
+
+// Timing probes around the stages of the pipeline, into a histogram per
+// stage. They are only built with AUDIOVISUALIZER_PROFILE defined to 1
+// before the library is included; otherwise every AUDIO_PROFILE* macro is
+// empty and nothing is kept or timed. The 'p' serial command of
+// AudioVisualizer prints the histograms and starts them over.
+#ifndef AUDIOVISUALIZER_PROFILE
+#define AUDIOVISUALIZER_PROFILE 0
+#endif
+
+enum ProfileStage {
+	// from the end of one analysis frame to the next FFT being ready
+	ProfileFFTWait,
+	// summing the spectrum into display bins
+	ProfileReduce,
+	// the autoscale and beat tracking, and scaling the sums into bin values
+	ProfileAutoscale,
+	// each renderer of a RendererSet in order, the fourth and on together
+	ProfileRenderer,
+	ProfileRendererLast = ProfileRenderer + 3,
+	// the renderers connected to the processor, all together
+	ProfileConnected,
+	// showing a frame
+	ProfileShow,
+	PROFILE_STAGES
+};
+
+// The probes' time source. Teensy 3.x counts CPU cycles in the DWT, which
+// is free to read. The LC's Cortex-M0+ has no cycle counter, so it counts
+// in micros() and gets 1us resolution. The host counts steady_clock
+// nanoseconds.
+struct ProfileClock {
+#if defined(ARM_DWT_CYCCNT)
+	static const uint32_t TICKS_PER_MICRO = F_CPU / 1000000;
+
+	static void begin() {
+		ARM_DEMCR |= ARM_DEMCR_TRCENA;
+		ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+	}
+
+	static uint32_t now() {
+		return ARM_DWT_CYCCNT;
+	}
+
+	static const char * unit() {
+		return "cycles";
+	}
+#elif defined(__arm__)
+	static const uint32_t TICKS_PER_MICRO = 1;
+
+	static void begin() {
+	}
+
+	static uint32_t now() {
+		return micros();
+	}
+
+	static const char * unit() {
+		return "us";
+	}
+#else
+	static const uint32_t TICKS_PER_MICRO = 1000;
+
+	static void begin() {
+	}
+
+	static uint32_t now() {
+		return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static const char * unit() {
+		return "ns";
+	}
+#endif
+};
+
+// Counts samples in buckets two to an octave: 0-3 exactly, then 4, 6, 8,
+// 12, 16, 24... up to 2^32, each within 41% of its top. The counts are 16
+// bits, and all of them are halved when one would overflow, so the
+// histogram keeps its shape however long it runs. min and max are exact.
+class ProfileHistogram {
+public:
+	static const int BUCKETS = 64;
+
+	ProfileHistogram() {
+		reset();
+	}
+
+	void reset() {
+		memset(counts, 0, sizeof(counts));
+		total = 0;
+		samples = 0;
+		minTicks = 0xFFFFFFFF;
+		maxTicks = 0;
+	}
+
+	void add(uint32_t ticks) {
+		int b = bucket(ticks);
+		if(counts[b] == 0xFFFF) {
+			total = 0;
+			for(int i = 0; i < BUCKETS; i++) {
+				counts[i] >>= 1;
+				total += counts[i];
+			}
+		}
+		counts[b]++;
+		total++;
+		samples++;
+		minTicks = min(minTicks, ticks);
+		maxTicks = max(maxTicks, ticks);
+	}
+
+	// Samples added since reset()
+	uint32_t getSamples() {
+		return samples;
+	}
+
+	uint32_t getMin() {
+		return samples ? minTicks : 0;
+	}
+
+	uint32_t getMax() {
+		return maxTicks;
+	}
+
+	// The top of the bucket holding the percent-th percentile, held to
+	// between min and max
+	uint32_t percentile(int percent) {
+		if(total == 0)
+			return 0;
+		uint32_t rank = ((uint64_t)total * percent + 99) / 100;
+		if(rank == 0)
+			rank = 1;
+		uint32_t seen = 0;
+		for(int b = 0; b < BUCKETS; b++) {
+			seen += counts[b];
+			if(seen >= rank)
+				return constrain(top(b), getMin(), maxTicks);
+		}
+		return maxTicks;
+	}
+
+	static int bucket(uint32_t ticks) {
+		if(ticks < 4)
+			return ticks;
+		int msb = 31 - __builtin_clz(ticks);
+		return 2 * msb + ((ticks >> (msb - 1)) & 1);
+	}
+
+	// The smallest value in bucket b
+	static uint32_t bottom(int b) {
+		if(b < 4)
+			return b;
+		int msb = b / 2;
+		return ((uint32_t)1 << msb) | ((uint32_t)(b & 1) << (msb - 1));
+	}
+
+	// The largest value in bucket b
+	static uint32_t top(int b) {
+		return b + 1 < BUCKETS ? bottom(b + 1) - 1 : 0xFFFFFFFF;
+	}
+
+private:
+	uint16_t counts[BUCKETS];
+	// the sum of counts
+	uint32_t total;
+	uint32_t samples;
+	uint32_t minTicks;
+	uint32_t maxTicks;
+};
+
+// A histogram per stage, and where the stages timed across calls started
+class Profiler {
+public:
+	Profiler() {
+		ProfileClock::begin();
+		memset(started, 0, sizeof(started));
+	}
+
+	ProfileHistogram & histogram(int stage) {
+		return histograms[stage];
+	}
+
+	void add(int stage, uint32_t ticks) {
+		histograms[stage].add(ticks);
+	}
+
+	// Starts timing stage, for end()
+	void begin(int stage) {
+		starts[stage] = ProfileClock::now();
+		started[stage] = true;
+	}
+
+	// Adds the time since begin(stage), if it was called
+	void end(int stage) {
+		if(started[stage]) {
+			add(stage, ProfileClock::now() - starts[stage]);
+			started[stage] = false;
+		}
+	}
+
+	void reset() {
+		for(int i = 0; i < PROFILE_STAGES; i++)
+			histograms[i].reset();
+	}
+
+	static const char * name(int stage) {
+		switch(stage) {
+		case ProfileFFTWait:
+			return "fft wait";
+		case ProfileReduce:
+			return "reduce";
+		case ProfileAutoscale:
+			return "autoscale";
+		case ProfileConnected:
+			return "connected";
+		case ProfileShow:
+			return "show";
+		default:
+			return "renderer";
+		}
+	}
+
+	// Prints a line per stage that has samples
+	void print() {
+		Serial.printf("Profile, in %s:\n", ProfileClock::unit());
+		Serial.printf("%-12s %8s %10s %10s %10s %10s\n", "stage", "count", "min", "p50", "p99", "max");
+		for(int i = 0; i < PROFILE_STAGES; i++) {
+			ProfileHistogram & h = histograms[i];
+			if(h.getSamples() == 0)
+				continue;
+			char label[16];
+			if(i >= ProfileRenderer && i <= ProfileRendererLast)
+				snprintf(label, sizeof(label), "%s %d", name(i), i - ProfileRenderer);
+			else
+				snprintf(label, sizeof(label), "%s", name(i));
+			Serial.printf("%-12s %8lu %10lu %10lu %10lu %10lu\n", label, (unsigned long)h.getSamples(),
+				(unsigned long)h.getMin(), (unsigned long)h.percentile(50), (unsigned long)h.percentile(99),
+				(unsigned long)h.getMax());
+		}
+	}
+
+private:
+	ProfileHistogram histograms[PROFILE_STAGES];
+	uint32_t starts[PROFILE_STAGES];
+	bool started[PROFILE_STAGES];
+};
+
+// The one set of histograms the probes fill
+inline Profiler & profiler() {
+	static Profiler instance;
+	return instance;
+}
+
+// Times the enclosing block as stage
+class ProfileScope {
+public:
+	ProfileScope(int stage) : stage(stage), start(ProfileClock::now()) {
+	}
+
+	~ProfileScope() {
+		profiler().add(stage, ProfileClock::now() - start);
+	}
+
+private:
+	int stage;
+	uint32_t start;
+};
+
+#define AUDIO_PROFILE_CONCAT2(a, b) a##b
+#define AUDIO_PROFILE_CONCAT(a, b) AUDIO_PROFILE_CONCAT2(a, b)
+
+#if AUDIOVISUALIZER_PROFILE
+// times the rest of the enclosing block
+#define AUDIO_PROFILE(stage) ProfileScope AUDIO_PROFILE_CONCAT(profileScope, __LINE__)(stage)
+// time a stage that starts and ends in different calls
+#define AUDIO_PROFILE_BEGIN(stage) profiler().begin(stage)
+#define AUDIO_PROFILE_END(stage) profiler().end(stage)
+#else
+#define AUDIO_PROFILE(stage)
+#define AUDIO_PROFILE_BEGIN(stage)
+#define AUDIO_PROFILE_END(stage)
+#endif
+
+#endif
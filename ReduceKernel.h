@@ -0,0 +1,248 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _REDUCEKERNEL_H
+#define _REDUCEKERNEL_H
+
+#include <stdint.h>
+#if defined(__ARM_FEATURE_DSP)
+// the CMSIS SIMD intrinsics, as the Audio library's FFTs use
+#include "arm_math.h"
+#endif
+
+// Spectrum reduction kernels for FilterBank. Each one sums a run of FFT
+// magnitudes, optionally weighted by Q0.8 weights, into 32 bits.
+//
+// FFT1024 magnitudes are at most 46341 (sqrt of two full-scale Q15 squares),
+// so a flat sum of all 512 bins is below 2^25 and a triangle-weighted sum,
+// whose weights average half of full scale, stays below 2^32 before the
+// final shift. Nothing in a kernel can wrap.
+//
+//   sum(s, n)            s[0] + ... + s[n-1]
+//   weightedSum(s, w, n) (s[0]*w[0] + ... + s[n-1]*w[n-1]) >> 8
+//
+// The channel variants sum the same run of C spectra, side by side in one
+// pass where that pays, loading each weight once for all of them:
+//
+//   sumChannels<C>(s, offset, n, sums)            sums[c] = sum(s[c] + offset, n)
+//   weightedSumChannels<C>(s, offset, w, n, sums) sums[c] = weightedSum(s[c] + offset, w, n)
+
+// One sample per step. Best where registers are scarce (Cortex-M0+).
+struct ScalarReduceKernel {
+	static uint32_t sum(const uint16_t * s, int n) {
+		uint32_t acc = 0;
+		for(int i = 0; i < n; i++)
+			acc += s[i];
+		return acc;
+	}
+
+	static uint32_t weightedSum(const uint16_t * s, const uint16_t * w, int n) {
+		uint32_t acc = 0;
+		for(int i = 0; i < n; i++)
+			acc += (uint32_t)s[i] * w[i];
+		return acc >> 8;
+	}
+
+	template<int C>
+	static void sumChannels(const uint16_t * const * s, int offset, int n, uint32_t * sums) {
+		uint32_t acc[C] = {0};
+		for(int i = offset; i < offset + n; i++)
+			for(int c = 0; c < C; c++)
+				acc[c] += s[c][i];
+		for(int c = 0; c < C; c++)
+			sums[c] = acc[c];
+	}
+
+	template<int C>
+	static void weightedSumChannels(const uint16_t * const * s, int offset, const uint16_t * w, int n, uint32_t * sums) {
+		uint32_t acc[C] = {0};
+		for(int i = 0; i < n; i++) {
+			uint32_t weight = w[i];
+			for(int c = 0; c < C; c++)
+				acc[c] += (uint32_t)s[c][offset + i] * weight;
+		}
+		for(int c = 0; c < C; c++)
+			sums[c] = acc[c] >> 8;
+	}
+};
+
+// Eight independent lanes per step so the compiler can keep them in vector
+// registers (SSE/NEON on the host); the tail runs one sample at a time.
+struct VectorReduceKernel {
+	static const int LANES = 8;
+
+	static uint32_t sum(const uint16_t * __restrict s, int n) {
+		uint32_t lanes[LANES] = {0};
+		int i = 0;
+		for(; i + LANES <= n; i += LANES)
+			for(int l = 0; l < LANES; l++)
+				lanes[l] += s[i + l];
+		uint32_t acc = 0;
+		for(int l = 0; l < LANES; l++)
+			acc += lanes[l];
+		for(; i < n; i++)
+			acc += s[i];
+		return acc;
+	}
+
+	static uint32_t weightedSum(const uint16_t * __restrict s, const uint16_t * __restrict w, int n) {
+		uint32_t lanes[LANES] = {0};
+		int i = 0;
+		for(; i + LANES <= n; i += LANES)
+			for(int l = 0; l < LANES; l++)
+				lanes[l] += (uint32_t)s[i + l] * w[i + l];
+		uint32_t acc = 0;
+		for(int l = 0; l < LANES; l++)
+			acc += lanes[l];
+		for(; i < n; i++)
+			acc += (uint32_t)s[i] * w[i];
+		return acc >> 8;
+	}
+
+	// The lanes already fill the vector registers and a second channel in
+	// the same loop only spills them, so the channels run one at a time.
+	template<int C>
+	static void sumChannels(const uint16_t * const * s, int offset, int n, uint32_t * sums) {
+		for(int c = 0; c < C; c++)
+			sums[c] = sum(s[c] + offset, n);
+	}
+
+	template<int C>
+	static void weightedSumChannels(const uint16_t * const * s, int offset, const uint16_t * w, int n, uint32_t * sums) {
+		for(int c = 0; c < C; c++)
+			sums[c] = weightedSum(s[c] + offset, w, n);
+	}
+};
+
+// Two halfwords per 32-bit load, for the Cortex-M4 DSP extension.
+//
+// Flat sums add both halves of each word, which the compiler turns into
+// UXTAH and an add with a shifted operand. Weighted sums use SMLAD, which is
+// signed, so both samples are first halved with UHADD16 to bring them below
+// 2^15 and the result is shifted by 7 instead of 8. That drops each sample's
+// low bit, at most half a weight per tap.
+//
+// Pairs are only formed when the samples and weights share word alignment;
+// FilterBank pads the weight pool so that they do. The channel variants
+// also need every spectrum word aligned, as the analyzers' outputs are.
+//
+// OPS supplies the word load and the two instructions: the CMSIS intrinsics
+// on the device, a portable model of them in the host tests.
+template<class OPS>
+struct DualHalfwordKernel {
+	static uint32_t sum(const uint16_t * s, int n) {
+		uint32_t acc = 0;
+		if(n > 0 && ((uintptr_t)s & 2)) {
+			acc += *s++;
+			n--;
+		}
+		int i = 0;
+		for(; i + 2 <= n; i += 2) {
+			uint32_t x = OPS::pair(s + i);
+			acc += (x & 0xFFFF) + (x >> 16);
+		}
+		if(i < n)
+			acc += s[i];
+		return acc;
+	}
+
+	static uint32_t weightedSum(const uint16_t * s, const uint16_t * w, int n) {
+		if(((uintptr_t)s ^ (uintptr_t)w) & 2)
+			return ScalarReduceKernel::weightedSum(s, w, n);
+		uint32_t tail = 0;
+		if(n > 0 && ((uintptr_t)s & 2)) {
+			tail += (uint32_t)*s++ * *w++;
+			n--;
+		}
+		int32_t acc = 0;
+		int i = 0;
+		for(; i + 2 <= n; i += 2)
+			acc = OPS::smlad(OPS::uhadd16(OPS::pair(s + i), 0), OPS::pair(w + i), acc);
+		if(i < n)
+			tail += (uint32_t)s[i] * w[i];
+		return ((uint32_t)acc >> 7) + (tail >> 8);
+	}
+
+	template<int C>
+	static void sumChannels(const uint16_t * const * s, int offset, int n, uint32_t * sums) {
+		uint32_t acc[C] = {0};
+		if(n > 0 && (offset & 1)) {
+			for(int c = 0; c < C; c++)
+				acc[c] += s[c][offset];
+			offset++;
+			n--;
+		}
+		int i = 0;
+		for(; i + 2 <= n; i += 2)
+			for(int c = 0; c < C; c++) {
+				uint32_t x = OPS::pair(s[c] + offset + i);
+				acc[c] += (x & 0xFFFF) + (x >> 16);
+			}
+		for(int c = 0; c < C; c++)
+			sums[c] = acc[c] + (i < n ? s[c][offset + i] : 0);
+	}
+
+	template<int C>
+	static void weightedSumChannels(const uint16_t * const * s, int offset, const uint16_t * w, int n, uint32_t * sums) {
+		if((offset ^ ((uintptr_t)w >> 1)) & 1)
+			return ScalarReduceKernel::weightedSumChannels<C>(s, offset, w, n, sums);
+		uint32_t tail[C] = {0};
+		int32_t acc[C] = {0};
+		if(n > 0 && (offset & 1)) {
+			for(int c = 0; c < C; c++)
+				tail[c] += (uint32_t)s[c][offset] * *w;
+			offset++;
+			w++;
+			n--;
+		}
+		int i = 0;
+		for(; i + 2 <= n; i += 2) {
+			uint32_t weights = OPS::pair(w + i);
+			for(int c = 0; c < C; c++)
+				acc[c] = OPS::smlad(OPS::uhadd16(OPS::pair(s[c] + offset + i), 0), weights, acc[c]);
+		}
+		for(int c = 0; c < C; c++) {
+			if(i < n)
+				tail[c] += (uint32_t)s[c][offset + i] * w[i];
+			sums[c] = ((uint32_t)acc[c] >> 7) + (tail[c] >> 8);
+		}
+	}
+};
+
+#if defined(__ARM_FEATURE_DSP)
+struct CortexM4DualHalfwordOps {
+	static inline uint32_t pair(const uint16_t * p) __attribute__((always_inline)) {
+		return *(const uint32_t *)p;
+	}
+
+	static inline uint32_t uhadd16(uint32_t a, uint32_t b) __attribute__((always_inline)) {
+		return __UHADD16(a, b);
+	}
+
+	static inline int32_t smlad(uint32_t a, uint32_t b, int32_t acc) __attribute__((always_inline)) {
+		return __SMLAD(a, b, acc);
+	}
+};
+
+typedef DualHalfwordKernel<CortexM4DualHalfwordOps> DualHalfwordReduceKernel;
+typedef DualHalfwordReduceKernel DefaultReduceKernel;
+#elif defined(__arm__)
+typedef ScalarReduceKernel DefaultReduceKernel;
+#else
+typedef VectorReduceKernel DefaultReduceKernel;
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _RENDERSCHEDULER_H
+#define _RENDERSCHEDULER_H
+
+#include <stdint.h>
+
+// Paces rendering at a fixed frame rate, however fast loop() runs. Frames
+// fall due on a fixed grid of times, so one drawn late does not push the
+// rest back; a loop stalled for more than a frame skips the ones it missed
+// rather than drawing them back to back.
+class RenderScheduler {
+public:
+	RenderScheduler() : period(0), next(0), frames(0), skipped(0) {
+	}
+
+	// Frames per second to draw, or 0 to draw on every call
+	void setFrameRate(uint16_t fps) {
+		period = fps ? 1000000UL / fps : 0;
+		next = 0;
+		frames = 0;
+		skipped = 0;
+	}
+
+	uint16_t getFrameRate() {
+		return period ? (uint16_t)(1000000UL / period) : 0;
+	}
+
+	bool isEnabled() {
+		return period != 0;
+	}
+
+	// Microseconds between frames
+	uint32_t getPeriod() {
+		return period;
+	}
+
+	// Returns true when a frame is due at now, and counts it drawn.
+	bool due(uint32_t now) {
+		if(!period)
+			return true;
+		if(!frames && !skipped)
+			next = now;
+		if((int32_t)(now - next) < 0)
+			return false;
+		next += period;
+		if((int32_t)(now - next) >= 0) {
+			uint32_t missed = (now - next) / period + 1;
+			skipped += missed;
+			next += missed * period;
+		}
+		frames++;
+		return true;
+	}
+
+	// Frames drawn since the rate was set
+	uint32_t getFrames() {
+		return frames;
+	}
+
+	// Frames the loop was too late to draw
+	uint32_t getSkipped() {
+		return skipped;
+	}
+
+private:
+	uint32_t period;
+	uint32_t next;
+	uint32_t frames;
+	uint32_t skipped;
+};
+
+#endif
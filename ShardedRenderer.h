@@ -0,0 +1,198 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _SHARDEDRENDERER_H
+#define _SHARDEDRENDERER_H
+
+#include "AudioRenderer.h"
+
+// STRIPS strips of LEDS_PER_STRIP pixels, laid end to end in one array the
+// way the parallel drivers want them (FastLED's WS2811_PORTD outputs,
+// OctoWS2811): strip s starts at pixel s * LEDS_PER_STRIP. Display bins
+// keep indexing pixels across the whole array.
+template<int STRIPS, int LEDS_PER_STRIP>
+struct StripMap {
+	static const int NUM_LEDS = STRIPS * LEDS_PER_STRIP;
+
+	static int strip(int led) {
+		return led / LEDS_PER_STRIP;
+	}
+
+	static int offset(int led) {
+		return led % LEDS_PER_STRIP;
+	}
+
+	// The part of bin on strip s, rebased to the strip: empty if the bin
+	// is on other strips, and cut at the ends of the strip if it crosses
+	// them. barOffset() places the part in the whole bar.
+	static DisplayBin onStrip(const DisplayBin & bin, int s) {
+		DisplayBin part = bin;
+		int start = constrain(bin.startLEDNum - s * LEDS_PER_STRIP, 0, LEDS_PER_STRIP);
+		int end = constrain(bin.endLEDNum - s * LEDS_PER_STRIP, 0, LEDS_PER_STRIP);
+		part.startLEDNum = start;
+		part.endLEDNum = max(start, end);
+		return part;
+	}
+
+	// Where strip s's part of bin starts in the whole bar
+	static int barOffset(const DisplayBin & bin, int s) {
+		return max(0, s * LEDS_PER_STRIP - bin.startLEDNum);
+	}
+};
+
+// Runs the shards one after another on the calling core, as on a Teensy.
+struct SerialExecutor {
+	template<class F>
+	void run(int count, F & f) {
+		for(int i = 0; i < count; i++)
+			f(i);
+	}
+};
+
+// A renderer per strip. Each one draws only its strip's part of every
+// display bin straight into that strip's pixels, so the shards share no
+// pixels and EXECUTOR can run them at once (see HostThreadExecutor on the
+// host). Every shard sees the same frames at the same time, so their fades
+// and hue sweeps stay in step. A bin that crosses strips is still one bar,
+// centered on the whole bin; only its pixels either side of a strip's end
+// fade as if they were the bar's ends, having no neighbour to check.
+//
+// Each shard keeps its own bin state, and color cache with COLOR_CACHE, so
+// the RAM for them grows with STRIPS while the per-pixel work is split
+// between them.
+template<int DISPLAY_BINS, int STRIPS, int LEDS_PER_STRIP, class EXECUTOR = SerialExecutor, bool COLOR_CACHE = false>
+class ShardedRenderer : public AudioRenderer<DISPLAY_BINS> {
+public:
+	typedef StripMap<STRIPS, LEDS_PER_STRIP> Map;
+	typedef LEDStripAudioRenderer<DISPLAY_BINS, LEDS_PER_STRIP, COLOR_CACHE> Shard;
+
+	// enables rendering debug messages, from the first shard
+	bool enableDebug;
+
+	ShardedRenderer(EXECUTOR & executor = defaultExecutor()) : enableDebug(false), executor(executor), leds(NULL) {
+	}
+
+	// leds holds every strip, end to end; numLeds is there to match
+	// LEDStripAudioRenderer and must be STRIPS * LEDS_PER_STRIP.
+	void init(CRGB * leds, int numLeds, const DisplayBin * bins) {
+		this->leds = leds;
+		for(int s = 0; s < STRIPS; s++) {
+			for(int i = 0; i < DISPLAY_BINS; i++)
+				stripBins[s][i] = Map::onStrip(bins[i], s);
+			shards[s].init(leds + s * LEDS_PER_STRIP, LEDS_PER_STRIP, stripBins[s]);
+			for(int i = 0; i < DISPLAY_BINS; i++) {
+				int start = min((int)bins[i].startLEDNum, Map::NUM_LEDS);
+				int bar = constrain((int)bins[i].endLEDNum, start, Map::NUM_LEDS) - start;
+				shards[s].setBarSpan(i, min(bar, 255), min(Map::barOffset(bins[i], s), 255));
+			}
+		}
+	}
+
+	void update(FFTBinData<DISPLAY_BINS> * data) {
+		Update job = {this, data, micros()};
+		shards[0].enableDebug = enableDebug;
+		executor.run(STRIPS, job);
+	}
+
+	void setFrame(FFTBinData<DISPLAY_BINS> * data) {
+		unsigned long now = micros();
+		for(int s = 0; s < STRIPS; s++)
+			shards[s].setFrame(data, now);
+	}
+
+	void render() {
+		Render job = {this, micros()};
+		executor.run(STRIPS, job);
+	}
+
+	void setSpeed(int edgeFadeSpeed, int newValFadeSpeed, uint16_t sweepTime) {
+		for(int s = 0; s < STRIPS; s++)
+			shards[s].setSpeed(edgeFadeSpeed, newValFadeSpeed, sweepTime);
+	}
+
+	void setBeatHueStep(uint8_t step8) {
+		for(int s = 0; s < STRIPS; s++)
+			shards[s].setBeatHueStep(step8);
+	}
+
+	void setColorSweep(uint8_t startHue8, uint8_t endHue8, uint8_t saturation8 = 255, bool reverseWheel = false) {
+		for(int s = 0; s < STRIPS; s++)
+			shards[s].setColorSweep(startHue8, endHue8, saturation8, reverseWheel);
+	}
+
+	void setTransferCurve(int bin, const TransferCurve & curve) {
+		for(int s = 0; s < STRIPS; s++)
+			shards[s].setTransferCurve(bin, curve);
+	}
+
+	// every strip, end to end
+	CRGB * getLEDS() {
+		return leds;
+	}
+
+	// The bins as strip s draws them: its part of each, and the level of the
+	// whole bar, which every strip shares
+	DisplayBinState * getBinState(int s = 0) {
+		return shards[s].getBinState();
+	}
+
+	Shard & getShard(int s) {
+		return shards[s];
+	}
+
+private:
+	struct Update {
+		ShardedRenderer * renderer;
+		FFTBinData<DISPLAY_BINS> * data;
+		unsigned long now;
+		void operator()(int s) {
+			renderer->shards[s].update(data, now);
+		}
+	};
+
+	struct Render {
+		ShardedRenderer * renderer;
+		unsigned long now;
+		void operator()(int s) {
+			renderer->shards[s].render(now);
+		}
+	};
+
+	EXECUTOR & executor;
+	CRGB * leds;
+	Shard shards[STRIPS];
+	DisplayBin stripBins[STRIPS][DISPLAY_BINS];
+
+	static EXECUTOR & defaultExecutor() {
+		static EXECUTOR executor;
+		return executor;
+	}
+};
+
+// The strip renderer for NUM_LEDS pixels on STRIPS strips: one plain
+// renderer for a single strip, a shard per strip otherwise.
+template<int DISPLAY_BINS, int NUM_LEDS, int STRIPS, bool COLOR_CACHE = false>
+struct StripRenderer {
+	static_assert(NUM_LEDS % STRIPS == 0, "NUM_LEDS must split evenly over STRIPS");
+	typedef ShardedRenderer<DISPLAY_BINS, STRIPS, NUM_LEDS / STRIPS, SerialExecutor, COLOR_CACHE> type;
+};
+
+template<int DISPLAY_BINS, int NUM_LEDS, bool COLOR_CACHE>
+struct StripRenderer<DISPLAY_BINS, NUM_LEDS, 1, COLOR_CACHE> {
+	typedef LEDStripAudioRenderer<DISPLAY_BINS, NUM_LEDS, COLOR_CACHE> type;
+};
+
+#endif
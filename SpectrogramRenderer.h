@@ -0,0 +1,136 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _SPECTROGRAMRENDERER_H
+#define _SPECTROGRAMRENDERER_H
+
+#include "AudioRenderer.h"
+
+// A scrolling spectrogram for an LED matrix of ROWS rows of DISPLAY_BINS
+// pixels: a column per display bin and a row per analysis frame, the
+// newest row last. Quiet cells are dim and take the start hue of the
+// sweep, loud ones are bright and take the end hue.
+//
+// The rows are a ring in the LED buffer. Each frame overwrites the oldest
+// row and moves the ring's start along, so an update costs one row however
+// many are kept, and nothing is moved. The rows come out in order at
+// output time: pass getPixelOffset() to LEDFrameBuffer::show(), which
+// rotates the copy it makes anyway, or copyTo() a matrix of your own. The
+// rotation suits a matrix wired row by row in one direction; a serpentine
+// matrix flips with every row scrolled, so it takes copyTo().
+template<int DISPLAY_BINS, int ROWS>
+class SpectrogramRenderer : public AudioRenderer<DISPLAY_BINS> {
+public:
+	static const int NUM_LEDS = ROWS * DISPLAY_BINS;
+
+	SpectrogramRenderer() : leds(NULL), head(0), rows(0) {
+		// blue through green and yellow to red
+		setColorSweep(HUE_BLUE, HUE_RED, 255, true);
+		for(int i = 0; i < DISPLAY_BINS; i++)
+			curves[i] = transferCurve(DisplayFunction::Sqrt).table;
+	}
+
+	// Draws into leds, NUM_LEDS pixels. The display function of each bin
+	// shapes its column; without bins every column is Sqrt.
+	void init(CRGB * leds, const DisplayBin * bins = NULL) {
+		this->leds = leds;
+		head = 0;
+		rows = 0;
+		fill_solid(leds, NUM_LEDS, CRGB::Black);
+		if(bins != NULL) {
+			for(int i = 0; i < DISPLAY_BINS; i++)
+				curves[i] = transferCurve(bins[i].displayFunction).table;
+		}
+	}
+
+	// Quiet cells take startHue8, loud ones endHue8, around the wheel the
+	// way reverseWheel says.
+	void setColorSweep(uint8_t startHue8, uint8_t endHue8, uint8_t saturation8 = 255, bool reverseWheel = false) {
+		startHue = startHue8;
+		hueRange = reverseWheel ? startHue8 - endHue8 : endHue8 - startHue8;
+		hueSign = reverseWheel ? -1 : 1;
+		saturation = saturation8;
+	}
+
+	// Writes the frame over the oldest row. NULL, when the processor has
+	// no new frame, leaves the matrix as it is.
+	void update(FFTBinData<DISPLAY_BINS> * data) {
+		if(data == NULL)
+			return;
+		CRGB * row = leds + head * DISPLAY_BINS;
+		for(int i = 0; i < DISPLAY_BINS; i++) {
+			uint8_t level = curves[i][data->binValues[i]] >> 8;
+			uint8_t hue8 = startHue + hueSign * scale8(level, hueRange);
+			hsv2rgb_rainbow(CHSV(hue8, saturation, level), row[i]);
+		}
+		head = head + 1 < ROWS ? head + 1 : 0;
+		if(rows < ROWS)
+			rows++;
+	}
+
+	// The ring row that shows first, the oldest
+	int getRowOffset() {
+		return head;
+	}
+
+	// Where the oldest row starts in the LED buffer, for
+	// LEDFrameBuffer::show()
+	int getPixelOffset() {
+		return head * DISPLAY_BINS;
+	}
+
+	// Frames drawn since init(), up to ROWS
+	int getRows() {
+		return rows;
+	}
+
+	// The pixel of bin x, y rows after the oldest
+	CRGB & pixel(int x, int y) {
+		int r = head + y;
+		if(r >= ROWS)
+			r -= ROWS;
+		return leds[r * DISPLAY_BINS + x];
+	}
+
+	// Copies the rows in order into matrix, every other row reversed for
+	// a serpentine matrix. Costs the whole matrix, like any output.
+	void copyTo(CRGB * matrix, bool serpentine = false) {
+		for(int y = 0; y < ROWS; y++) {
+			const CRGB * row = &pixel(0, y);
+			CRGB * out = matrix + y * DISPLAY_BINS;
+			if(serpentine && (y & 1)) {
+				for(int x = 0; x < DISPLAY_BINS; x++)
+					out[x] = row[DISPLAY_BINS - 1 - x];
+			}
+			else {
+				memcpy(out, row, DISPLAY_BINS * sizeof(CRGB));
+			}
+		}
+	}
+
+private:
+	CRGB * leds;
+	// the ring row the next frame goes in, which is the oldest
+	int head;
+	int rows;
+	const uint16_t * curves[DISPLAY_BINS];
+	uint8_t startHue;
+	uint8_t hueRange;
+	int8_t hueSign;
+	uint8_t saturation;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+
+// Where each index of an analyzer's output[] sits in frequency. Analyzers
+// name theirs in a Spectrum typedef; BinLayout places display bins with
+// hzToBin() and FilterBank shapes its weights with binToHz().
+//
+// Template parameters can't be floating point, so sample rates are given
+// in millihertz: the Audio library's 44117.647Hz is 44117647, where a plain
+// cast to long would drop the fraction.
+#define AUDIO_SAMPLE_RATE_MHZ ((long)(AUDIO_SAMPLE_RATE * 1000.0 + 0.5))
+
+// BINS bins evenly spaced from 0Hz to Nyquist, as every plain FFT gives.
+template<int BINS, long SAMPLE_RATE_MHZ>
+struct UniformSpectrum {
+	static const int SIZE = BINS;
+	static constexpr double BIN_HZ = SAMPLE_RATE_MHZ / 2000.0 / BINS;
+
+	static constexpr double binToHz(double bin) {
+		return bin * BIN_HZ;
+	}
+
+	static constexpr double hzToBin(double hz) {
+		return hz / BIN_HZ;
+	}
+};
+
+// Two FFT_SIZE point transforms spliced together: one over the signal
+// decimated by DECIMATION for the bass, one at the full rate above it.
+// The decimated bins run up to 3/4 of their Nyquist, where the decimating
+// filter starts to roll off, and the full rate bins carry on from there.
+template<int FFT_SIZE, int DECIMATION, long SAMPLE_RATE_MHZ>
+struct MultirateSpectrum {
+	// decimated bins at the bottom of the spectrum
+	static const int LOW_BINS = FFT_SIZE * 3 / 8;
+	// the first full rate bin used, at the frequency LOW_BINS ends
+	static const int HIGH_START = LOW_BINS / DECIMATION;
+	static const int SIZE = LOW_BINS + FFT_SIZE / 2 - HIGH_START;
+	static constexpr double LOW_BIN_HZ = SAMPLE_RATE_MHZ / 2000.0 / DECIMATION / (FFT_SIZE / 2);
+	static constexpr double HIGH_BIN_HZ = SAMPLE_RATE_MHZ / 2000.0 / (FFT_SIZE / 2);
+
+	static_assert(LOW_BINS % DECIMATION == 0, "DECIMATION must divide 3/8 of the FFT size");
+
+	static constexpr double binToHz(double bin) {
+		return bin < LOW_BINS ? bin * LOW_BIN_HZ : (bin - LOW_BINS + HIGH_START) * HIGH_BIN_HZ;
+	}
+
+	static constexpr double hzToBin(double hz) {
+		return hz < LOW_BINS * LOW_BIN_HZ ? hz / LOW_BIN_HZ : hz / HIGH_BIN_HZ - HIGH_START + LOW_BINS;
+	}
+};
+
+#endif
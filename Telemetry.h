@@ -0,0 +1,221 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Binary telemetry: the pipeline's frames as records in a byte ring, sent
+// out of the serial port only as fast as it takes them. Nothing waits on
+// the port; a record that does not fit in the ring is dropped whole and
+// counted. extras/host/tools/TelemetryDecoder turns the stream into CSV.
+//
+// A record is, little endian:
+//   0xA5 0x5A, type (u8), payload length (u16), sequence (u16), payload,
+//   and the 8 bit sum of every byte from the type to the end of the payload
+// Arrays go as they lie in memory; every target is little endian. The
+// sequence counts every record, dropped or not, so the decoder sees
+// where records are missing, and the sync bytes and sum let it find the
+// next record after anything else on the port.
+enum TelemetryRecord {
+	// micros (u32), bin count (u16), the FFT output of channel 0 (u16 each)
+	TelemetrySpectrum = 1,
+	// one for each output: micros (u32), output (u8), bin count (u8), peak
+	// (u8), onset and beat flags (u8, bits 0 and 1), onset strength, beat
+	// phase, tempo (u8 each), then the bin values (u8 each)
+	TelemetryBins = 2,
+	// micros (u32), sum count (u16), the bin sums (u32 each), then the
+	// autoscale of each sum in Q8.8 (u32 each)
+	TelemetryScale = 3,
+	// micros (u32), frames drawn and skipped by the RenderScheduler (0
+	// without a frame rate), frame queue overruns, frame queue drops and
+	// telemetry records dropped (u32 each). Not sent when the processor is
+	// queued: only the analysis writes the ring then.
+	TelemetryStats = 4
+};
+
+// Masks of the records to send, for AudioProcessor::setTelemetry()
+#define TELEMETRY_MASK(record) (1 << (record))
+#define TELEMETRY_DEFAULT (TELEMETRY_MASK(TelemetryBins) | TELEMETRY_MASK(TelemetryScale) | TELEMETRY_MASK(TelemetryStats))
+#define TELEMETRY_ALL (TELEMETRY_DEFAULT | TELEMETRY_MASK(TelemetrySpectrum))
+
+static const uint8_t TELEMETRY_SYNC0 = 0xA5;
+static const uint8_t TELEMETRY_SYNC1 = 0x5A;
+static const int TELEMETRY_HEADER = 7;
+
+// The ring, over storage of a power of two bytes (see Telemetry below).
+// One producer writes records and one consumer drains them, as in
+// FrameQueue, so the analysis can write from an interrupt while loop()
+// drains.
+class TelemetryRing {
+public:
+	TelemetryRing(uint8_t * storage, uint32_t size) : storage(storage), size(size), head(0), tail(0), sequence(0),
+		records(0), dropped(0), droppedBytes(0) {
+	}
+
+	// Producer: writes a record of part a then part b. Returns false, and
+	// counts the record dropped, if the ring has no room for all of it.
+	bool write(uint8_t type, const void * a, uint16_t aLength, const void * b = NULL, uint16_t bLength = 0) {
+		uint16_t number = sequence++;
+		uint32_t length = (uint32_t)aLength + bLength;
+		uint32_t h = head;
+		if(length > 0xFFFF || size - (h - load(tail)) < TELEMETRY_HEADER + length + 1) {
+			store(dropped, dropped + 1);
+			droppedBytes += TELEMETRY_HEADER + length + 1;
+			return false;
+		}
+		const uint8_t header[TELEMETRY_HEADER] = {TELEMETRY_SYNC0, TELEMETRY_SYNC1, type, (uint8_t)length,
+			(uint8_t)(length >> 8), (uint8_t)number, (uint8_t)(number >> 8)};
+		uint8_t sum = 0;
+		h = put(h, header, TELEMETRY_HEADER, sum);
+		// the sync bytes are not summed
+		sum -= TELEMETRY_SYNC0 + TELEMETRY_SYNC1;
+		h = put(h, (const uint8_t *)a, aLength, sum);
+		h = put(h, (const uint8_t *)b, bLength, sum);
+		h = put(h, &sum, 1, sum);
+		store(records, records + 1);
+		store(head, h);
+		return true;
+	}
+
+	// Consumer: sends what port takes without blocking (its
+	// availableForWrite()), and returns the bytes sent.
+	template<class PORT>
+	int drain(PORT & port) {
+		uint32_t t = tail;
+		uint32_t waiting = load(head) - t;
+		int space = port.availableForWrite();
+		int sent = 0;
+		while(waiting > 0 && space > 0) {
+			// up to the end of the storage at a time
+			uint32_t offset = t & (size - 1);
+			uint32_t n = smaller(smaller(waiting, size - offset), space);
+			port.write(storage + offset, n);
+			t += n;
+			waiting -= n;
+			space -= n;
+			sent += n;
+		}
+		store(tail, t);
+		return sent;
+	}
+
+	// Bytes waiting to be sent
+	uint32_t pending() {
+		return load(head) - load(tail);
+	}
+
+	// Records written into the ring
+	uint32_t getRecords() {
+		return load(records);
+	}
+
+	// Records that found the ring full
+	uint32_t getDropped() {
+		return load(dropped);
+	}
+
+	uint32_t getDroppedBytes() {
+		return droppedBytes;
+	}
+
+	// Bytes of storage the ring was given
+	uint32_t getSize() {
+		return size;
+	}
+
+private:
+	uint8_t * storage;
+	uint32_t size;
+	// written by the producer
+	uint32_t head;
+	// written by the consumer
+	uint32_t tail;
+	uint16_t sequence;
+	uint32_t records;
+	uint32_t dropped;
+	uint32_t droppedBytes;
+
+	uint32_t put(uint32_t h, const uint8_t * data, uint32_t length, uint8_t & sum) {
+		for(uint32_t i = 0; i < length; i++) {
+			storage[(h + i) & (size - 1)] = data[i];
+			sum += data[i];
+		}
+		return h + length;
+	}
+
+	static uint32_t smaller(uint32_t a, uint32_t b) {
+		return a < b ? a : b;
+	}
+
+	static uint32_t load(const uint32_t & x) {
+		return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+	}
+
+	static void store(uint32_t & x, uint32_t value) {
+		__atomic_store_n(&x, value, __ATOMIC_RELEASE);
+	}
+};
+
+// A TelemetryRing with its own CAPACITY bytes. A spectrum record of the
+// 1024 point FFT is 1038 bytes, so keep at least 2K for it.
+template<int CAPACITY = 2048>
+class Telemetry : public TelemetryRing {
+public:
+	static_assert(CAPACITY >= 64 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+	Telemetry() : TelemetryRing(buffer, CAPACITY) {
+	}
+
+private:
+	uint8_t buffer[CAPACITY];
+};
+
+// Packs little endian fields into a record's fixed part
+class TelemetryFields {
+public:
+	TelemetryFields() : length(0) {
+	}
+
+	TelemetryFields & u8(uint8_t v) {
+		bytes[length++] = v;
+		return *this;
+	}
+
+	TelemetryFields & u16(uint16_t v) {
+		return u8(v).u8(v >> 8);
+	}
+
+	TelemetryFields & u32(uint32_t v) {
+		return u16(v).u16(v >> 16);
+	}
+
+	const uint8_t * data() const {
+		return bytes;
+	}
+
+	uint16_t size() const {
+		return length;
+	}
+
+private:
+	uint8_t bytes[32];
+	uint16_t length;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _TRANSFERCURVE_H
+#define _TRANSFERCURVE_H
+
+#include "AudioStructures.h"
+#include "ConstexprMath.h"
+
+// Maps an 8-bit bin value to 0-65535 of the curve's full scale. The table is
+// built once, by the compiler for the DisplayFunctions or when a custom
+// curve is created, so applying a curve each frame is a single lookup.
+//
+// Custom curves can be constexpr globals, which keeps them in flash:
+//   constexpr TransferCurve punchy = TransferCurve::sCurve(8.0);
+//   visualizer.renderer.setTransferCurve(0, punchy);
+struct TransferCurve {
+	uint16_t table[256];
+
+	uint16_t operator[](uint8_t value) const {
+		return table[value];
+	}
+
+	// One of the DisplayFunctions, normalized to its value at 255
+	static constexpr TransferCurve fromFunction(DisplayFunction f) {
+		TransferCurve c = {};
+		for(int x = 1; x < 256; x++) {
+			double t = x / 255.0;
+			switch(f) {
+			case DisplayFunction::Log:
+				t = constLog(x) / constLog(255);
+				break;
+			case DisplayFunction::Sq:
+				t = t * t;
+				break;
+			case DisplayFunction::Sqrt:
+				t = constSqrt(t);
+				break;
+			case DisplayFunction::Lin:
+			default:
+				break;
+			}
+			c.table[x] = toEntry(t);
+		}
+		return c;
+	}
+
+	// (x/255)^gamma
+	static constexpr TransferCurve gamma(double gamma) {
+		TransferCurve c = {};
+		for(int x = 1; x < 256; x++)
+			c.table[x] = toEntry(constPow(x / 255.0, gamma));
+		return c;
+	}
+
+	// A logistic S-curve through 0 and 255 centered on midpoint. Larger
+	// contrast gives a steeper middle; around 4 is gentle, 12 is harsh.
+	static constexpr TransferCurve sCurve(double contrast, uint8_t midpoint = 128) {
+		TransferCurve c = {};
+		double m = midpoint / 255.0;
+		double low = logistic(contrast, -m);
+		double high = logistic(contrast, 1.0 - m);
+		for(int x = 0; x < 256; x++)
+			c.table[x] = toEntry((logistic(contrast, x / 255.0 - m) - low) / (high - low));
+		return c;
+	}
+
+	// Straight lines through (x[i], y[i]) for ascending x, flat beyond the ends.
+	static constexpr TransferCurve piecewise(const uint8_t * x, const uint8_t * y, int points) {
+		TransferCurve c = {};
+		int segment = 0;
+		for(int v = 0; v < 256; v++) {
+			while(segment < points - 1 && v > x[segment + 1])
+				segment++;
+			double t = 0.0;
+			if(v <= x[0])
+				t = y[0];
+			else if(segment >= points - 1)
+				t = y[points - 1];
+			else
+				t = y[segment] + (double)(y[segment + 1] - y[segment]) * (v - x[segment]) / (x[segment + 1] - x[segment]);
+			c.table[v] = toEntry(t / 255.0);
+		}
+		return c;
+	}
+
+private:
+	static constexpr uint16_t toEntry(double t) {
+		return t <= 0.0 ? 0 : (t >= 1.0 ? 65535 : (uint16_t)(t * 65535.0 + 0.5));
+	}
+
+	static constexpr double logistic(double contrast, double x) {
+		return 1.0 / (1.0 + constExp(-contrast * x));
+	}
+};
+
+template<int FUNCTION>
+struct BuiltinTransferCurve {
+	static constexpr TransferCurve curve = TransferCurve::fromFunction((DisplayFunction)FUNCTION);
+};
+
+template<int FUNCTION>
+constexpr TransferCurve BuiltinTransferCurve<FUNCTION>::curve;
+
+// The flash table for a DisplayFunction
+inline const TransferCurve & transferCurve(DisplayFunction f) {
+	switch(f) {
+	case DisplayFunction::Log:
+		return BuiltinTransferCurve<DisplayFunction::Log>::curve;
+	case DisplayFunction::Sq:
+		return BuiltinTransferCurve<DisplayFunction::Sq>::curve;
+	case DisplayFunction::Sqrt:
+		return BuiltinTransferCurve<DisplayFunction::Sqrt>::curve;
+	case DisplayFunction::Lin:
+	default:
+		return BuiltinTransferCurve<DisplayFunction::Lin>::curve;
+	}
+}
+
+#endif
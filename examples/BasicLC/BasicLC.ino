@@ -48,6 +48,7 @@ void configureBins() {
 		binIndex += binSizes[i];
 		bins[i].endFFTBin = binIndex;
 		bins[i].displayFunction = DisplayFunction::Sqrt;
+		bins[i].weighting = BinWeighting::Flat;
 		bins[i].startLEDNum = ledIndex;
 		ledIndex += ledSizes[i];
 		bins[i].endLEDNum = ledIndex;
@@ -58,6 +59,7 @@ void loop() {
 	checkBrightnessKnob();
 
 	if(visualizer.update()) {
+		AUDIO_PROFILE(ProfileShow);
 		LEDS.show();
 	}
 }
@@ -1,3 +1,6 @@
+// To time each stage, build the probes in and send 'p' over serial (with
+// enableSerialCommands()):
+//   #define AUDIOVISUALIZER_PROFILE 1
 #include "AudioVisualizer.h"
 #include "FastLED.h"
 #include "ADC.h"
@@ -18,6 +21,12 @@ CRGB leds[NUM_LEDS] = {0};
 // Default connection to A2
 AudioInputAnalog  audioInput;         
 AudioAnalyzeFFT1024  myFFT;
+// For twice the frame rate and half the latency, analyze with a 256 point
+// FFT instead. Its bins are 4x as wide, so use binSizes of {1,2,8}:
+//   FFTAnalyzer<256, FFTWindow::Hann, 1>  myFFT;
+//   AudioVisualizer<NUM_LEDS, FFT_BINS, FFTAnalyzer<256, FFTWindow::Hann, 1> > visualizer(myFFT);
+// For 21.5Hz bass bins up to 2kHz, use MultirateAnalyzer<> myFFT and
+// getOctaveBins() or bin ranges built with MultirateAnalyzer<>::Spectrum::hzToBin.
 // Create Audio connections between the components
 AudioConnection c2(audioInput, 0, myFFT, 0);
 
@@ -45,6 +54,12 @@ void setup() {
 	visualizer.init(leds, bins);
 	visualizer.renderer.setSpeed(2000,11000,10000);
 	visualizer.renderer.setColorSweep(HUE_BLUE, HUE_PINK, 240);
+	// To show the strip at a steady 120fps, the bars gliding between FFT frames:
+	// visualizer.setFrameRate(120);
+	// To stream the frames as binary telemetry instead of debug text, with
+	// a global Telemetry<2048> telemetry; ('t' stops and starts it, and
+	// extras/host/tools/TelemetryDecoder turns a capture into CSV):
+	// visualizer.setTelemetry(&telemetry);
 	visualizer.enableSerialCommands();
 	Serial.println("Setup Complete");
 }
@@ -61,6 +76,7 @@ void configureBins() {
 		binIndex += binSizes[i];
 		bins[i].endFFTBin = binIndex;
 		bins[i].displayFunction = DisplayFunction::Sqrt;
+		bins[i].weighting = BinWeighting::Flat;
 		bins[i].startLEDNum = ledIndex;
 		ledIndex += ledSizes[i];
 		bins[i].endLEDNum = ledIndex;
@@ -70,7 +86,14 @@ void configureBins() {
 void loop() {
 	checkBrightnessKnob();
 
+	// LEDS.show() holds the loop for the whole strip, about 5ms for 168 LEDs.
+	// With a DMA driver such as WS2812Serial, draw into an LEDFrameBuffer's
+	// back() and call its show() here instead, and the analysis keeps
+	// running while the strip is sent (see LEDFrameBuffer.h). Its
+	// setOutputStage() gamma corrects and dithers each frame on the way out
+	// (see LEDOutputStage.h).
 	if(visualizer.update()) {
+		AUDIO_PROFILE(ProfileShow);
 		LEDS.show();
 	}
 }
@@ -0,0 +1,74 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Globals behind the host stand-ins for the Teensy core, FastLED, EEPROM and
+// the Audio library's integer square root guess table.
+
+#include <chrono>
+#include "Arduino.h"
+#include "FastLED.h"
+#include "EEPROM.h"
+
+HostSerial Serial;
+CFastLED FastLED;
+HostEEPROM EEPROM;
+
+namespace {
+
+class SteadyClock : public HostClock {
+public:
+	SteadyClock() : start(std::chrono::steady_clock::now()) {}
+
+	uint64_t nowMicros() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void delayMicros(uint32_t us) {
+		uint64_t end = nowMicros() + us;
+		while(nowMicros() < end)
+			;
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+SteadyClock wallClock;
+HostClock * installedClock = &wallClock;
+thread_local HostClock * threadClock = NULL;
+
+}
+
+void HostClock::install(HostClock * clock) {
+	installedClock = clock ? clock : &wallClock;
+}
+
+void HostClock::installForThread(HostClock * clock) {
+	threadClock = clock;
+}
+
+HostClock & HostClock::current() {
+	return threadClock ? *threadClock : *installedClock;
+}
+
+// Initial guesses for sqrt_uint32, indexed by __builtin_clz of the input.
+extern "C" const uint16_t sqrt_integer_guess_table[33] = {
+	55109, 38968, 27554, 19484, 13777, 9742, 6889, 4871,
+	3444, 2435, 1722, 1218, 861, 609, 431, 304,
+	215, 152, 108, 76, 54, 38, 27, 19,
+	13, 10, 7, 5, 3, 2, 2, 1,
+	1
+};
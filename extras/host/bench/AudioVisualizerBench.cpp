@@ -0,0 +1,819 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Times each stage of the pipeline on its own at several FREQ_BINS/NUM_LEDS
+// sizes. micros() runs on a virtual clock advanced one FFT period per frame,
+// so fades and hue sweeps behave as on the device; the timings themselves
+// come from steady_clock.
+//
+//   AudioVisualizerBench [-n frames] [-s spectra.raw]
+
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "AudioVisualizer.h"
+#include "LEDFrameBuffer.h"
+#include "HostLEDSink.h"
+#include "HostThreadExecutor.h"
+#include "SpectrogramRenderer.h"
+#include "LEDOutputStage.h"
+
+namespace {
+
+int frames = 2000;
+const char * spectraPath = NULL;
+VirtualClock virtualClock;
+uint32_t checksum = 0;
+
+void loadSpectra(AudioAnalyzeFFT1024 & fft) {
+	if(spectraPath == NULL || !fft.loadSpectra(spectraPath))
+		fft.synthesize(1024);
+}
+
+template<class F>
+double nanosPerCall(int calls, F f) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int i = 0; i < calls; i++)
+		f(i);
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / calls;
+}
+
+void report(const char * stage, int bins, int leds, int calls, double ns) {
+	printf("%-34s %5d %5d %8d %12.1f", stage, bins, leds, calls, ns);
+	if(leds)
+		printf(" %9.2f", ns / leds);
+	printf("\n");
+}
+
+void sumLeds(const CRGB * leds, int numLeds) {
+	for(int i = 0; i < numLeds; i++)
+		checksum = checksum * 31 + leds[i].r + leds[i].g + leds[i].b;
+}
+
+// Splits the spectrum into geometrically growing ranges and the strip into
+// equal runs, the way the octave layouts do.
+void makeBins(DisplayBin * bins, int count, int numLeds) {
+	int start = 0;
+	for(int i = 0; i < count; i++) {
+		int end = (int)round(pow(FFT_OUTPUT_SIZE, (i + 1) / (double)count));
+		if(end <= start)
+			end = start + 1;
+		bins[i].startFFTBin = start;
+		bins[i].endFFTBin = end;
+		bins[i].startLEDNum = i * numLeds / count;
+		bins[i].endLEDNum = (i + 1) * numLeds / count;
+		bins[i].displayFunction = DisplayFunction::Sqrt;
+		bins[i].weighting = BinWeighting::Flat;
+		start = end;
+	}
+}
+
+// Keeps a copy of every frame the processor publishes.
+template<int FREQ_BINS>
+class CaptureRenderer : public AudioRenderer<FREQ_BINS> {
+public:
+	std::vector<FFTBinData<FREQ_BINS> > frames;
+	void update(FFTBinData<FREQ_BINS> * data) {
+		if(data)
+			frames.push_back(*data);
+	}
+};
+
+template<int FREQ_BINS>
+void benchConfiguration(int numLeds) {
+	DisplayBin bins[FREQ_BINS];
+	makeBins(bins, FREQ_BINS, numLeds);
+	std::vector<CRGB> leds(numLeds, CRGB(0, 0, 0));
+	AudioAnalyzeFFT1024 fft;
+	loadSpectra(fft);
+	fft.setFrameInterval(0);
+	virtualClock.setMicros(0);
+
+	// spectrum reduction and autoscale only
+	AudioProcessor<FREQ_BINS> processor(fft);
+	processor.init(bins);
+	report("AudioProcessor::analyzeData", FREQ_BINS, 0, frames,
+		nanosPerCall(frames, [&](int) { checksum += processor.analyzeData(); }));
+
+	CaptureRenderer<FREQ_BINS> capture;
+	processor.connectAudioRenderer(&capture);
+	for(int i = 0; i < 256; i++)
+		processor.analyzeData();
+
+	LEDStripAudioRenderer<FREQ_BINS> renderer;
+	renderer.init(&leds[0], numLeds, bins);
+	const int frameCount = capture.frames.size();
+	report("LEDStripAudioRenderer::update", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int i) {
+			virtualClock.advanceMicros(AudioAnalyzeFFT1024::FRAME_MICROS);
+			renderer.update(&capture.frames[i % frameCount]);
+		}));
+	sumLeds(&leds[0], numLeds);
+
+	// between FFT frames the renderer is polled with no data and only fades
+	report("LEDStripAudioRenderer::update0", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int i) {
+			virtualClock.advanceMicros(1000);
+			if((i & 15) == 0)
+				renderer.update(&capture.frames[i % frameCount]);
+			else
+				renderer.update(NULL);
+		}));
+	sumLeds(&leds[0], numLeds);
+
+	DisplayBinState * states = renderer.getBinState();
+	report("LEDStripAudioRenderer::renderBin", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int i) {
+			for(int b = 0; b < FREQ_BINS; b++) {
+				states[b].value = (i * 7 + b * 13) % (states[b].num_leds + 1);
+				renderer.renderBin(&states[b], 1, 2, (i & 3) == 0);
+			}
+		}));
+	sumLeds(&leds[0], numLeds);
+
+	LightingControllerClass<FREQ_BINS> controller;
+	controller.init(&leds[0], numLeds, _BV(7));
+	report("LightingControllerClass::render", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int i) {
+			if((i & 63) == 0)
+				controller.setColor(i % FREQ_BINS, CRGB(i * 3, i * 5, i * 7));
+			controller.render();
+		}));
+	sumLeds(&leds[0], numLeds);
+}
+
+// renderBin with and without the color cache, one frame period of hue
+// sweep per frame, in pixels per microsecond.
+template<int FREQ_BINS, class RENDERER>
+double fadePixelsPerMicro(RENDERER & renderer, CRGB * leds, int numLeds) {
+	DisplayBin bins[FREQ_BINS];
+	makeBins(bins, FREQ_BINS, numLeds);
+	renderer.setSpeed(2000, 11000, 10000);
+	renderer.init(leds, numLeds, bins);
+	DisplayBinState * states = renderer.getBinState();
+	const uint32_t frameMillis = AudioAnalyzeFFT1024::FRAME_MICROS / 1000;
+	double ns = nanosPerCall(frames, [&](int i) {
+		for(int b = 0; b < FREQ_BINS; b++) {
+			states[b].value = (i * 7 + b * 13) % (states[b].num_leds + 1);
+			renderer.renderBin(&states[b], 1, 2, (i & 3) == 0);
+		}
+		renderer.updateHue(frameMillis);
+	});
+	return numLeds / ns * 1000.0;
+}
+
+template<int FREQ_BINS>
+void benchColorCache(int numLeds) {
+	std::vector<CRGB> uncachedLeds(numLeds), cachedLeds(numLeds);
+	static LEDStripAudioRenderer<FREQ_BINS> uncached;
+	static LEDStripAudioRenderer<FREQ_BINS, 0, true> cached;
+	double before = fadePixelsPerMicro<FREQ_BINS>(uncached, &uncachedLeds[0], numLeds);
+	double after = fadePixelsPerMicro<FREQ_BINS>(cached, &cachedLeds[0], numLeds);
+	printf("%-34s %5d %5d %8d %9.1f px/us -> %.1f px/us\n", "renderBin color cache", FREQ_BINS, numLeds, frames,
+		before, after);
+	if(memcmp(&uncachedLeds[0], &cachedLeds[0], numLeds * sizeof(CRGB)))
+		printf("    the cache changed the colors\n");
+	sumLeds(&cachedLeds[0], numLeds);
+}
+
+// The strip renderer connected to the processor and called through its
+// virtual update(), against the same renderer in a RendererSet with no
+// slots, then the same pair for four renderers on the one strip.
+template<int FREQ_BINS>
+void benchFanOut(int numLeds) {
+	DisplayBin bins[FREQ_BINS];
+	makeBins(bins, FREQ_BINS, numLeds);
+	std::vector<CRGB> connectedLeds(numLeds, CRGB(0, 0, 0)), staticLeds(numLeds, CRGB(0, 0, 0));
+	AudioAnalyzeFFT1024 connectedFFT, staticFFT;
+	loadSpectra(connectedFFT);
+	loadSpectra(staticFFT);
+	connectedFFT.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	staticFFT.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	const uint32_t step = AudioAnalyzeFFT1024::FRAME_MICROS / 4 + 1;
+
+	LEDStripAudioRenderer<FREQ_BINS> connected[4], fixed[4];
+	for(int i = 0; i < 4; i++) {
+		connected[i].init(&connectedLeds[0], numLeds, bins);
+		fixed[i].init(&staticLeds[0], numLeds, bins);
+	}
+	AudioProcessor<FREQ_BINS> connectedProcessor(connectedFFT);
+	AudioProcessor<FREQ_BINS, 0> staticProcessor(staticFFT);
+	connectedProcessor.init(bins);
+	staticProcessor.init(bins);
+
+	virtualClock.setMicros(0);
+	connectedProcessor.connectAudioRenderer(&connected[0]);
+	report("analyzeData+update connected", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int) {
+			virtualClock.advanceMicros(step);
+			connectedProcessor.analyzeData();
+		}));
+	virtualClock.setMicros(0);
+	RendererSet<FREQ_BINS, LEDStripAudioRenderer<FREQ_BINS> > one(fixed[0]);
+	report("analyzeData+update RendererSet", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int) {
+			virtualClock.advanceMicros(step);
+			staticProcessor.analyzeData(one);
+		}));
+	if(memcmp(&connectedLeds[0], &staticLeds[0], numLeds * sizeof(CRGB)))
+		printf("    the two paths lit the strip differently\n");
+	sumLeds(&staticLeds[0], numLeds);
+
+	for(int i = 1; i < 4; i++)
+		connectedProcessor.connectAudioRenderer(&connected[i]);
+	report("analyzeData+update x4 connected", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int) {
+			virtualClock.advanceMicros(step);
+			connectedProcessor.analyzeData();
+		}));
+	auto four = rendererSet<FREQ_BINS>(fixed[0], fixed[1], fixed[2], fixed[3]);
+	report("analyzeData+update x4 RendererSet", FREQ_BINS, numLeds, frames,
+		nanosPerCall(frames, [&](int) {
+			virtualClock.advanceMicros(step);
+			staticProcessor.analyzeData(four);
+		}));
+	sumLeds(&staticLeds[0], numLeds);
+}
+
+// update() of one renderer over the whole array, then of a renderer per
+// strip drawn in turn and on threads.
+template<int FREQ_BINS, int STRIPS, int LEDS_PER_STRIP>
+void benchShards() {
+	const int numLeds = STRIPS * LEDS_PER_STRIP;
+	DisplayBin bins[FREQ_BINS];
+	makeBins(bins, FREQ_BINS, numLeds);
+	std::vector<FFTBinData<FREQ_BINS> > data(16);
+	for(int f = 0; f < 16; f++)
+		for(int b = 0; b < FREQ_BINS; b++)
+			data[f].binValues[b] = (uint8_t)(f * 37 + b * 91);
+	std::vector<CRGB> leds(numLeds);
+	const uint32_t step = AudioAnalyzeFFT1024::FRAME_MICROS;
+	auto time = [&](const char * stage, AudioRenderer<FREQ_BINS> & renderer) {
+		virtualClock.setMicros(0);
+		report(stage, FREQ_BINS, numLeds, frames,
+			nanosPerCall(frames, [&](int i) {
+				virtualClock.advanceMicros(step);
+				renderer.update(&data[i & 15]);
+			}));
+		sumLeds(&leds[0], numLeds);
+	};
+
+	static LEDStripAudioRenderer<FREQ_BINS, numLeds> whole;
+	whole.init(&leds[0], numLeds, bins);
+	time("update one renderer", whole);
+	static ShardedRenderer<FREQ_BINS, STRIPS, LEDS_PER_STRIP> serial;
+	serial.init(&leds[0], numLeds, bins);
+	time("update shards in turn", serial);
+	static HostThreadExecutor executor;
+	static ShardedRenderer<FREQ_BINS, STRIPS, LEDS_PER_STRIP, HostThreadExecutor> threaded(executor);
+	threaded.init(&leds[0], numLeds, bins);
+	time("update shards on threads", threaded);
+	printf("    %d strips, %d worker threads, wire time %u us against %u us on one strip\n", STRIPS,
+		executor.getWorkers(), ws2811Micros(numLeds, STRIPS), ws2811Micros(numLeds));
+}
+
+// A spectrogram row written into the ring, against scrolling the whole
+// matrix down a row first, at a short and a long history.
+template<int FREQ_BINS, int ROWS>
+void benchSpectrogram() {
+	static CRGB leds[ROWS * FREQ_BINS];
+	static SpectrogramRenderer<FREQ_BINS, ROWS> spectrogram;
+	spectrogram.init(leds);
+	std::vector<FFTBinData<FREQ_BINS> > data(16);
+	for(int f = 0; f < 16; f++)
+		for(int b = 0; b < FREQ_BINS; b++)
+			data[f].binValues[b] = (uint8_t)(f * 37 + b * 91);
+	report("SpectrogramRenderer ring", FREQ_BINS, ROWS * FREQ_BINS, frames,
+		nanosPerCall(frames, [&](int i) {
+			spectrogram.update(&data[i & 15]);
+		}));
+	sumLeds(leds, ROWS * FREQ_BINS);
+	// a one row spectrogram draws the new row at the top
+	static SpectrogramRenderer<FREQ_BINS, 1> top;
+	top.init(leds);
+	report("SpectrogramRenderer memmove", FREQ_BINS, ROWS * FREQ_BINS, frames,
+		nanosPerCall(frames, [&](int i) {
+			memmove(leds + FREQ_BINS, leds, (ROWS - 1) * FREQ_BINS * sizeof(CRGB));
+			top.update(&data[i & 15]);
+		}));
+	sumLeds(leds, ROWS * FREQ_BINS);
+}
+
+// The BasicTeensy3 layout, {3,7,31} FFT bins over {72,24,72} LEDs, which
+// reads 41 of the 512 FFT bins.
+void benchExampleLayout(const char * stage, BinWeighting weighting) {
+	const int binSizes[] = {3, 7, 31};
+	const int ledSizes[] = {72, 24, 72};
+	DisplayBin bins[3];
+	int binIndex = 0;
+	int ledIndex = 0;
+	for(int i = 0; i < 3; i++) {
+		bins[i].startFFTBin = binIndex;
+		binIndex += binSizes[i];
+		bins[i].endFFTBin = binIndex;
+		bins[i].startLEDNum = ledIndex;
+		ledIndex += ledSizes[i];
+		bins[i].endLEDNum = ledIndex;
+		bins[i].displayFunction = DisplayFunction::Sqrt;
+		bins[i].weighting = weighting;
+	}
+	AudioAnalyzeFFT1024 fft;
+	loadSpectra(fft);
+	fft.setFrameInterval(0);
+	AudioProcessor<3> processor(fft);
+	processor.init(bins);
+	report(stage, 3, 0, frames,
+		nanosPerCall(frames, [&](int) { checksum += processor.analyzeData(); }));
+	printf("    filterbank reads %d of %d FFT bins\n", processor.getFilterBank().tapCount(), FFT_OUTPUT_SIZE);
+}
+
+// The reduction alone: each channel in turn, then both in one pass.
+template<int FREQ_BINS, class KERNEL>
+void benchChannelReduce(const DisplayBin * bins, const char * kernel, const char * weighting) {
+	FilterBank<FREQ_BINS, FFT_OUTPUT_SIZE, KERNEL> filterBank;
+	filterBank.template configure<FFTSpectrum<AudioAnalyzeFFT1024>::type>(bins);
+	AudioAnalyzeFFT1024 left, right;
+	loadSpectra(left);
+	loadSpectra(right);
+	left.setFrameInterval(0);
+	right.setFrameInterval(0);
+	right.available();
+	left.available();
+	const uint16_t * spectra[2] = {left.output, right.output};
+	uint32_t sums[2 * FREQ_BINS];
+	char stage[40];
+	snprintf(stage, sizeof(stage), "  %s apply x2, %s", kernel, weighting);
+	report(stage, FREQ_BINS, 0, frames,
+		nanosPerCall(frames, [&](int) { checksum += filterBank.apply(spectra[0], sums) + filterBank.apply(spectra[1], sums); }));
+	snprintf(stage, sizeof(stage), "  %s applyChannels<2>, %s", kernel, weighting);
+	report(stage, FREQ_BINS, 0, frames,
+		nanosPerCall(frames, [&](int) { checksum += filterBank.template applyChannels<2>(spectra, sums); }));
+}
+
+// Two channels through one stereo processor, against a processor per
+// channel. The stereo frame also carries mid and side.
+template<int FREQ_BINS>
+void benchStereo(BinWeighting weighting) {
+	DisplayBin bins[FREQ_BINS];
+	memcpy(bins, BinLayout<168, FREQ_BINS, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::octave.bins, sizeof(bins));
+	for(int i = 0; i < FREQ_BINS; i++)
+		bins[i].weighting = weighting;
+	AudioAnalyzeFFT1024 left, right;
+	loadSpectra(left);
+	loadSpectra(right);
+	left.setFrameInterval(0);
+	right.setFrameInterval(0);
+	const char * name = weighting == BinWeighting::Flat ? "flat" : "mel";
+	char stage[40];
+
+	AudioProcessor<FREQ_BINS> leftProcessor(left), rightProcessor(right);
+	leftProcessor.init(bins);
+	rightProcessor.init(bins);
+	snprintf(stage, sizeof(stage), "analyzeData 2 mono, %s", name);
+	report(stage, FREQ_BINS, 0, frames,
+		nanosPerCall(frames, [&](int) { checksum += leftProcessor.analyzeData() + rightProcessor.analyzeData(); }));
+
+	AudioAnalyzeFFT1024 * channels[2] = {&left, &right};
+	AudioProcessor<FREQ_BINS, 16, 0x01, DefaultReduceKernel, AudioAnalyzeFFT1024, 2> stereo(channels);
+	stereo.init(bins);
+	snprintf(stage, sizeof(stage), "analyzeData stereo+M/S, %s", name);
+	report(stage, FREQ_BINS, 0, frames,
+		nanosPerCall(frames, [&](int) { checksum += stereo.analyzeData(); }));
+
+	benchChannelReduce<FREQ_BINS, ScalarReduceKernel>(bins, "scalar", name);
+	benchChannelReduce<FREQ_BINS, VectorReduceKernel>(bins, "vector", name);
+}
+
+// The reduction loop analyzeData ran before the filterbank: one pass from
+// FFT bin 0, a branch per bin and 16 bit sums. Only handles contiguous,
+// unweighted bins starting at 0.
+template<int FREQ_BINS>
+struct LegacyReduce {
+	int counts[FREQ_BINS];
+
+	void configure(const DisplayBin * bins) {
+		for(int i = 0; i < FREQ_BINS; i++)
+			counts[i] = bins[i].endFFTBin - bins[i].startFFTBin;
+	}
+
+	uint32_t apply(const uint16_t * spectrum, uint32_t * out) {
+		uint16_t sums[FREQ_BINS];
+		memset(sums, 0, sizeof(sums));
+		uint32_t total = 0;
+		int n = 0;
+		int count = 0;
+		for(int i = 0; i < FFT_OUTPUT_SIZE; i++) {
+			sums[n] = sums[n] + spectrum[i];
+			count++;
+			if(count >= counts[n]) {
+				out[n] = sums[n];
+				total += sums[n];
+				n++;
+				if(n >= FREQ_BINS)
+					break;
+				count = 0;
+			}
+		}
+		return total;
+	}
+};
+
+template<int FREQ_BINS, class KERNEL>
+struct KernelReduce {
+	FilterBank<FREQ_BINS, FFT_OUTPUT_SIZE, KERNEL> filterBank;
+
+	void configure(const DisplayBin * bins) {
+		filterBank.template configure<FFTSpectrum<AudioAnalyzeFFT1024>::type>(bins);
+	}
+
+	uint32_t apply(const uint16_t * spectrum, uint32_t * out) {
+		return filterBank.apply(spectrum, out);
+	}
+};
+
+inline uint64_t cycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// ns and timestamp-counter cycles per frame for one reduction over every
+// spectrum in the replay, cycling through them.
+template<int FREQ_BINS, class REDUCE>
+void benchReduce(const char * stage, const DisplayBin * bins, AudioAnalyzeFFT1024 & fft) {
+	static REDUCE reduce;
+	reduce.configure(bins);
+	std::vector<uint16_t> spectra;
+	for(int i = 0; i < 64; i++) {
+		fft.available();
+		spectra.insert(spectra.end(), fft.output, fft.output + FFT_OUTPUT_SIZE);
+	}
+	uint32_t sums[FREQ_BINS];
+	uint64_t cycles = cycleCount();
+	double ns = nanosPerCall(frames, [&](int i) {
+		checksum += reduce.apply(&spectra[(i & 63) * FFT_OUTPUT_SIZE], sums);
+	});
+	cycles = cycleCount() - cycles;
+	report(stage, FREQ_BINS, 0, frames, ns);
+	if(cycles)
+		printf("    %.1f cycles/frame\n", (double)cycles / frames);
+}
+
+// The reduction kernels against the loop they replaced. The Cortex-M4
+// DualHalfwordReduceKernel needs the DSP extension and only runs on the device.
+void benchReduceKernels() {
+	AudioAnalyzeFFT1024 fft;
+	loadSpectra(fft);
+	fft.setFrameInterval(0);
+
+	const int binSizes[] = {3, 7, 31};
+	DisplayBin example[3];
+	int start = 0;
+	for(int i = 0; i < 3; i++) {
+		example[i].startFFTBin = start;
+		start += binSizes[i];
+		example[i].endFFTBin = start;
+		example[i].weighting = BinWeighting::Flat;
+	}
+	benchReduce<3, LegacyReduce<3> >("reduce {3,7,31} legacy", example, fft);
+	benchReduce<3, KernelReduce<3, ScalarReduceKernel> >("reduce {3,7,31} scalar", example, fft);
+	benchReduce<3, KernelReduce<3, VectorReduceKernel> >("reduce {3,7,31} vector", example, fft);
+
+	// the octave layout starts at 1Hz, so make it contiguous from bin 0 for the legacy loop
+	DisplayBin octave[8];
+	memcpy(octave, BinLayout<168, 8, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::octave.bins, sizeof(octave));
+	octave[0].startFFTBin = 0;
+	for(int i = 1; i < 8; i++)
+		octave[i].startFFTBin = octave[i - 1].endFFTBin;
+	benchReduce<8, LegacyReduce<8> >("reduce octave8 legacy", octave, fft);
+	benchReduce<8, KernelReduce<8, ScalarReduceKernel> >("reduce octave8 scalar", octave, fft);
+	benchReduce<8, KernelReduce<8, VectorReduceKernel> >("reduce octave8 vector", octave, fft);
+
+	const DisplayBin * mel = BinLayout<168, 16, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::mel.bins;
+	benchReduce<16, KernelReduce<16, ScalarReduceKernel> >("reduce mel16 scalar", mel, fft);
+	benchReduce<16, KernelReduce<16, VectorReduceKernel> >("reduce mel16 vector", mel, fft);
+}
+
+// The onset detector on its own, over the octave layout's sums of the
+// replayed spectra. The synthetic track is 120 BPM.
+template<int FREQ_BINS>
+void benchOnsets() {
+	AudioAnalyzeFFT1024 fft;
+	loadSpectra(fft);
+	fft.setFrameInterval(0);
+	FilterBank<FREQ_BINS, FFT_OUTPUT_SIZE> filterBank;
+	filterBank.template configure<FFTSpectrum<AudioAnalyzeFFT1024>::type>(
+		BinLayout<168, FREQ_BINS, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::octave.bins);
+	const int frameCount = 1024;
+	std::vector<uint32_t> sums(frameCount * FREQ_BINS);
+	for(int f = 0; f < frameCount; f++) {
+		fft.available();
+		filterBank.apply(fft.output, &sums[f * FREQ_BINS]);
+	}
+	OnsetDetector<FREQ_BINS> detector;
+	FFTBinData<FREQ_BINS> data;
+	int onsets = 0;
+	report("OnsetDetector::update", FREQ_BINS, 0, frames,
+		nanosPerCall(frames, [&](int i) {
+			detector.update(&sums[(i % frameCount) * FREQ_BINS], AudioAnalyzeFFT1024::FRAME_MICROS, data);
+			onsets += data.onset;
+		}));
+	printf("    %d onsets in %d frames, tempo %u bpm\n", onsets, frames, detector.getTempo());
+	checksum += onsets + detector.getTempo();
+}
+
+// One FFTAnalyzer frame: window, transform and magnitudes, on a tone plus
+// noise. Also reports the frame period and window length it gives.
+template<int SIZE, int OVERLAP>
+void benchFFT(int sparseBins = 0) {
+	static FFTAnalyzer<SIZE, FFTWindow::Hann, OVERLAP> analyzer;
+	DisplayBin bins[1];
+	bins[0].startFFTBin = 1;
+	bins[0].endFFTBin = 1 + (sparseBins ? sparseBins : SIZE / 2);
+	analyzer.selectBins(bins, 1);
+	const int hop = FFTAnalyzer<SIZE, FFTWindow::Hann, OVERLAP>::HOP;
+	std::vector<int16_t> samples(hop * 16);
+	uint32_t seed = 1;
+	for(size_t n = 0; n < samples.size(); n++) {
+		seed = seed * 1664525u + 1013904223u;
+		samples[n] = (int16_t)(8000.0 * sin(n * 0.07) + (int)(seed >> 20) - 2048);
+	}
+	char stage[40];
+	if(analyzer.isSparse())
+		snprintf(stage, sizeof(stage), "FFTAnalyzer<%d> %d goertzel bins", SIZE, sparseBins);
+	else
+		snprintf(stage, sizeof(stage), "FFTAnalyzer<%d> overlap %d", SIZE, OVERLAP);
+	report(stage, SIZE / 2, 0, frames,
+		nanosPerCall(frames, [&](int i) {
+			analyzer.write(&samples[(i & 15) * hop], hop);
+			checksum += analyzer.available() + analyzer.output[3];
+		}));
+	printf("    a frame every %.2f ms over a %.2f ms window\n",
+		hop * 1000.0 / AUDIO_SAMPLE_RATE, SIZE * 1000.0 / AUDIO_SAMPLE_RATE);
+}
+
+// The multirate analyzer per frame, against the single FFT with the same
+// bass resolution, and the octave layout each gives.
+template<int SIZE, int DECIMATION>
+void benchMultirate() {
+	typedef MultirateAnalyzer<SIZE, DECIMATION> Analyzer;
+	static Analyzer analyzer;
+	std::vector<int16_t> samples(Analyzer::HOP * 16);
+	uint32_t seed = 1;
+	for(size_t n = 0; n < samples.size(); n++) {
+		seed = seed * 1664525u + 1013904223u;
+		samples[n] = (int16_t)(8000.0 * sin(n * 0.07) + (int)(seed >> 20) - 2048);
+	}
+	char stage[40];
+	snprintf(stage, sizeof(stage), "MultirateAnalyzer<%d, %d>", SIZE, DECIMATION);
+	report(stage, Analyzer::OUTPUT_SIZE, 0, frames,
+		nanosPerCall(frames, [&](int i) {
+			analyzer.write(&samples[(i & 15) * Analyzer::HOP], Analyzer::HOP);
+			checksum += analyzer.available() + analyzer.output[3];
+		}));
+	printf("    %.1f Hz bins up to %.0f Hz, %.1f Hz above\n", Analyzer::Spectrum::LOW_BIN_HZ,
+		Analyzer::Spectrum::binToHz(Analyzer::Spectrum::LOW_BINS), Analyzer::Spectrum::HIGH_BIN_HZ);
+	benchFFT<SIZE * DECIMATION, SIZE * DECIMATION / Analyzer::HOP>();
+
+	typedef BinLayout<168, 8, Analyzer::OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ, typename Analyzer::Spectrum> Multirate;
+	typedef BinLayout<168, 8, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ> Single;
+	printf("    octave8 FFT bins, multirate:");
+	for(int i = 0; i < 8; i++)
+		printf(" %d", Multirate::octave.bins[i].endFFTBin - Multirate::octave.bins[i].startFFTBin);
+	printf("; FFT1024:");
+	for(int i = 0; i < 8; i++)
+		printf(" %d", Single::octave.bins[i].endFFTBin - Single::octave.bins[i].startFFTBin);
+	printf("\n");
+}
+
+// The output stage over a frame of changing pixels, rounded and dithered,
+// against the plain copy it replaces in LEDFrameBuffer::show().
+template<int NUM_LEDS>
+void benchOutputStage() {
+	static CRGB in[NUM_LEDS], out[NUM_LEDS];
+	for(int i = 0; i < NUM_LEDS; i++)
+		in[i] = CRGB(i * 7, i * 13, i * 29);
+	LEDOutputStage stage;
+	stage.configure(2.5f, CRGB(255, 176, 240));
+	auto time = [&](const char * name, bool dither, bool copy) {
+		stage.setDithering(dither);
+		uint64_t cycles = cycleCount();
+		double ns = nanosPerCall(frames, [&](int i) {
+			in[i % NUM_LEDS].g++;
+			if(copy)
+				memcpy(out, in, sizeof(out));
+			else
+				stage.apply(out, in, NUM_LEDS);
+			stage.nextFrame();
+		});
+		cycles = cycleCount() - cycles;
+		report(name, 0, NUM_LEDS, frames, ns);
+		if(cycles)
+			printf("    %.2f cycles/pixel\n", (double)cycles / frames / NUM_LEDS);
+		sumLeds(out, NUM_LEDS);
+	};
+	time("LEDOutputStage copy only", false, true);
+	time("LEDOutputStage rounded", false, false);
+	time("LEDOutputStage dithered", true, false);
+}
+
+// Composing the ambient boxes and the bars, then a third layer, in the one
+// pass against a pass over the output per layer.
+template<int NUM_LEDS>
+void benchCompositor() {
+	static CRGB ambient[NUM_LEDS], audio[NUM_LEDS], mask[NUM_LEDS], out[NUM_LEDS];
+	for(int i = 0; i < NUM_LEDS; i++) {
+		ambient[i] = CRGB(0, i / 8, 60);
+		audio[i] = CRGB(i * 7, i * 13, 0);
+		mask[i] = CRGB(255 - i, 255 - i, 255 - i);
+	}
+	LayerCompositor<4> compositor;
+	compositor.addLayer(ambient);
+	compositor.addLayer(audio, Screen);
+	report("LayerCompositor 2 layers", 0, NUM_LEDS, frames,
+		nanosPerCall(frames, [&](int i) {
+			audio[i % NUM_LEDS].r++;
+			compositor.compose(out, NUM_LEDS);
+		}));
+	compositor.addLayer(mask, Multiply, 180);
+	report("LayerCompositor 3 layers", 0, NUM_LEDS, frames,
+		nanosPerCall(frames, [&](int i) {
+			audio[i % NUM_LEDS].r++;
+			compositor.compose(out, NUM_LEDS);
+		}));
+	sumLeds(out, NUM_LEDS);
+	const CRGB * layers[3] = {ambient, audio, mask};
+	const BlendMode modes[3] = {Normal, Screen, Multiply};
+	const uint8_t opacities[3] = {255, 255, 180};
+	report("LayerCompositor 3 passes", 0, NUM_LEDS, frames,
+		nanosPerCall(frames, [&](int i) {
+			audio[i % NUM_LEDS].r++;
+			fill_solid(out, NUM_LEDS, CRGB::Black);
+			for(int l = 0; l < 3; l++) {
+				for(int p = 0; p < NUM_LEDS; p++) {
+					out[p].r = LayerCompositor<4>::blend(out[p].r, layers[l][p].r, modes[l], opacities[l]);
+					out[p].g = LayerCompositor<4>::blend(out[p].g, layers[l][p].g, modes[l], opacities[l]);
+					out[p].b = LayerCompositor<4>::blend(out[p].b, layers[l][p].b, modes[l], opacities[l]);
+				}
+			}
+		}));
+	sumLeds(out, NUM_LEDS);
+}
+
+template<int NUM_LEDS, int DISPLAY_BINS>
+void benchVisualizer() {
+	static CRGB leds[NUM_LEDS];
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<NUM_LEDS, DISPLAY_BINS> visualizer(fft);
+	loadSpectra(fft);
+	fft.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	virtualClock.setMicros(0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	visualizer.init(leds);
+	std::chrono::duration<double, std::nano> initTime = std::chrono::steady_clock::now() - start;
+	report("AudioVisualizer::init", DISPLAY_BINS, NUM_LEDS, 1, initTime.count());
+	printf("    init waited %u us on the device clock\n", micros());
+	printf("    %u bytes of RAM, %u in the renderer\n", (unsigned)visualizer.ramBytes(), (unsigned)sizeof(visualizer.renderer));
+	// one FFT frame per 4 polls, as when the loop outruns the audio library
+	const uint32_t step = AudioAnalyzeFFT1024::FRAME_MICROS / 4 + 1;
+	report("AudioVisualizer::update", DISPLAY_BINS, NUM_LEDS, frames,
+		nanosPerCall(frames, [&](int) {
+			virtualClock.advanceMicros(step);
+			visualizer.update();
+		}));
+	sumLeds(leds, NUM_LEDS);
+
+	// the same loop drawing at 120fps, reported per update() call
+	visualizer.setFrameRate(120);
+	int shown = 0;
+	report("AudioVisualizer::update 120fps", DISPLAY_BINS, NUM_LEDS, frames,
+		nanosPerCall(frames, [&](int) {
+			virtualClock.advanceMicros(step);
+			shown += visualizer.update();
+		}));
+	printf("    %d shows in %.2fs of audio\n", shown, frames * step / 1e6);
+	visualizer.setFrameRate(0);
+	sumLeds(leds, NUM_LEDS);
+}
+
+
+// Half a second of the visualizer at 120fps on the wall clock, showing
+// through a sink that holds the loop for the wire time and through one
+// that sends from a thread. Loop passes are the time left for analysis.
+template<int NUM_LEDS, class SINK>
+void benchShow(const char * stage, SINK & sink) {
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<NUM_LEDS, 8> visualizer(fft);
+	LEDFrameBuffer<NUM_LEDS, SINK> buffer(sink);
+	loadSpectra(fft);
+	fft.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	HostClock::install(NULL);
+	visualizer.init(buffer.back());
+	visualizer.setFrameRate(120);
+	uint32_t passes = 0, start = micros();
+	while(micros() - start < 500000) {
+		passes++;
+		if(visualizer.update())
+			buffer.show();
+	}
+	buffer.flush();
+	HostClock::install(&virtualClock);
+	uint32_t transfer = buffer.getTransferMicros();
+	printf("%-34s %5d %5d %8u %9u us wire, %u us blocked, %u%% hidden, %u passes\n", stage, 8, NUM_LEDS,
+		buffer.getFrames(), transfer, buffer.getBlockedMicros(),
+		transfer ? (unsigned)((uint64_t)buffer.getHiddenMicros() * 100 / transfer) : 0, passes);
+	sumLeds(buffer.front(), NUM_LEDS);
+}
+
+template<int NUM_LEDS>
+void benchFrameBuffer() {
+	BlockingLEDSink blocking;
+	benchShow<NUM_LEDS>("LEDFrameBuffer blocking show", blocking);
+	ThreadLEDSink threaded;
+	benchShow<NUM_LEDS>("LEDFrameBuffer threaded show", threaded);
+	if(threaded.getTorn())
+		printf("    %u frames changed while they were sent\n", threaded.getTorn());
+}
+}
+
+int main(int argc, char ** argv) {
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-n") && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+			spectraPath = argv[++i];
+		else {
+			fprintf(stderr, "usage: %s [-n frames] [-s spectra.raw]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(frames < 1)
+		frames = 1;
+
+	HostClock::install(&virtualClock);
+	// keep the library's own Serial output out of the report
+	Serial.setOutput(NULL);
+
+	printf("%-34s %5s %5s %8s %12s %9s\n", "stage", "bins", "leds", "calls", "ns/call", "ns/led");
+	benchConfiguration<1>(60);
+	benchConfiguration<1>(168);
+	benchConfiguration<3>(60);
+	benchConfiguration<3>(168);
+	benchConfiguration<8>(168);
+	benchConfiguration<8>(1000);
+	benchConfiguration<16>(1000);
+	benchColorCache<8>(168);
+	benchColorCache<8>(1000);
+	benchFanOut<1>(60);
+	benchFanOut<8>(168);
+	benchShards<8, 4, 42>();
+	benchShards<16, 8, 250>();
+	benchSpectrogram<16, 16>();
+	benchSpectrogram<16, 128>();
+	benchExampleLayout("analyzeData {3,7,31} flat", BinWeighting::Flat);
+	benchExampleLayout("analyzeData {3,7,31} mel", BinWeighting::Mel);
+	benchReduceKernels();
+	benchStereo<8>(BinWeighting::Flat);
+	benchStereo<8>(BinWeighting::Mel);
+	benchStereo<16>(BinWeighting::Mel);
+	benchOnsets<3>();
+	benchOnsets<8>();
+	benchOnsets<16>();
+	benchFFT<256, 1>();
+	benchFFT<256, 2>();
+	benchFFT<512, 2>();
+	benchFFT<1024, 2>();
+	benchFFT<1024, 2>(4);
+	benchFFT<1024, 2>(12);
+	benchMultirate<256, 8>();
+	benchMultirate<512, 8>();
+	benchOutputStage<168>();
+	benchOutputStage<1000>();
+	benchCompositor<168>();
+	benchCompositor<1000>();
+	benchVisualizer<60, 1>();
+	benchVisualizer<168, 3>();
+	benchVisualizer<1000, 8>();
+	benchFrameBuffer<168>();
+	benchFrameBuffer<1000>();
+	printf("checksum %08x\n", checksum);
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for the Teensyduino core. Only the parts the library uses
+// are provided, with the same semantics as the Teensy 3 core where it matters
+// (mixed-type min/max, integer map() that yields out_min on an empty range
+// the way the Cortex-M divider returns 0).
+
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <type_traits>
+#include <thread>
+#include "HostClock.h"
+
+#ifndef ARDUINO
+#define ARDUINO 10600
+#endif
+
+#define _BV(n) (1<<(n))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define DEC 10
+#define HEX 16
+#define DEFAULT 0
+#define INTERNAL 2
+#define EXTERNAL 0
+#define A2 16
+#define A6 20
+
+template<class A, class B>
+constexpr typename std::common_type<A, B>::type min(A a, B b) {
+	return b < a ? b : a;
+}
+
+template<class A, class B>
+constexpr typename std::common_type<A, B>::type max(A a, B b) {
+	return a < b ? b : a;
+}
+
+template<class T, class L, class H>
+constexpr T constrain(T x, L low, H high) {
+	return x < low ? low : (x > high ? high : x);
+}
+
+template<class T, class A, class B, class C, class D>
+long map(T x, A inMin, B inMax, C outMin, D outMax,
+		typename std::enable_if<!std::is_floating_point<T>::value>::type * = 0) {
+	long range = (long)inMax - (long)inMin;
+	if(range == 0)
+		return outMin;
+	return ((long)x - (long)inMin) * ((long)outMax - (long)outMin) / range + (long)outMin;
+}
+
+template<class T, class A, class B, class C, class D>
+T map(T x, A inMin, B inMax, C outMin, D outMax,
+		typename std::enable_if<std::is_floating_point<T>::value>::type * = 0) {
+	return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+inline uint32_t micros() {
+	return (uint32_t)HostClock::current().nowMicros();
+}
+
+inline uint32_t millis() {
+	return (uint32_t)(HostClock::current().nowMicros() / 1000);
+}
+
+inline void delayMicroseconds(uint32_t us) {
+	HostClock::current().delayMicros(us);
+}
+
+inline void delay(uint32_t ms) {
+	HostClock::current().delayMicros(ms * 1000);
+}
+
+// Lets other threads run, as the Teensy core's yield() runs its event handlers
+inline void yield() {
+	std::this_thread::yield();
+}
+
+inline long random(long lo, long hi) {
+	return hi > lo ? lo + rand() % (hi - lo) : lo;
+}
+
+inline long random(long hi) {
+	return random(0, hi);
+}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int analogRead(uint8_t) { return 0; }
+
+// Serial port backed by stdout. Input can be queued with inject() so
+// the serial command handlers can be driven from host code.
+class HostSerial {
+public:
+	HostSerial() : out(stdout), inputLength(0), inputPosition(0), writeSpace(4096) {}
+
+	void begin(uint32_t) {}
+
+	// Redirects output, NULL discards it.
+	void setOutput(FILE * f) {
+		out = f;
+	}
+
+	void inject(const char * text) {
+		size_t n = strlen(text);
+		if(inputLength + n > sizeof(input))
+			n = sizeof(input) - inputLength;
+		memcpy(input + inputLength, text, n);
+		inputLength += n;
+	}
+
+	int available() {
+		return (int)(inputLength - inputPosition);
+	}
+
+	int read() {
+		if(inputPosition >= inputLength)
+			return -1;
+		int c = (unsigned char)input[inputPosition++];
+		if(inputPosition == inputLength)
+			inputPosition = inputLength = 0;
+		return c;
+	}
+
+	// What write() takes without blocking, as in the Teensy's USB serial.
+	// setWriteSpace() sets it, to act as a slow or stalled port.
+	int availableForWrite() {
+		return writeSpace;
+	}
+
+	void setWriteSpace(int bytes) {
+		writeSpace = bytes;
+	}
+
+	size_t write(uint8_t c) {
+		return out ? fputc(c, out) != EOF : 1;
+	}
+
+	size_t write(const uint8_t * buffer, size_t size) {
+		return out ? fwrite(buffer, 1, size, out) : size;
+	}
+
+	int printf(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+		if(!out)
+			return 0;
+		va_list args;
+		va_start(args, format);
+		int n = vfprintf(out, format, args);
+		va_end(args);
+		return n;
+	}
+
+	size_t print(const char * s) { return printf("%s", s); }
+	size_t print(char c) { return printf("%c", c); }
+	size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(int n, int base = DEC) { return print((long)n, base); }
+	size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(long n, int base = DEC) { return base == HEX ? printf("%lX", n) : printf("%ld", n); }
+	size_t print(unsigned long n, int base = DEC) { return base == HEX ? printf("%lX", n) : printf("%lu", n); }
+	size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+
+	size_t println() { return print("\n"); }
+	template<class T>
+	size_t println(T value) { return print(value) + println(); }
+	template<class T>
+	size_t println(T value, int format) { return print(value, format) + println(); }
+
+	operator bool() { return true; }
+
+private:
+	FILE * out;
+	char input[256];
+	size_t inputLength;
+	size_t inputPosition;
+	int writeSpace;
+};
+
+extern HostSerial Serial;
+
+#endif
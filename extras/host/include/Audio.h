@@ -0,0 +1,176 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for the Teensy Audio library. AudioAnalyzeFFT1024 does no
+// signal processing here; it replays recorded spectra (raw little-endian
+// uint16 frames of 512 bins) or a deterministic synthetic track, one frame
+// per FFT period of the installed HostClock. AudioStream is just enough for
+// the library's own analyzers: deliver() hands a block to an input and runs
+// update(), as the audio interrupt would.
+
+#ifndef _HOST_AUDIO_H
+#define _HOST_AUDIO_H
+
+#include "Arduino.h"
+#include <vector>
+
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706
+#define AUDIO_SAMPLE_RATE AUDIO_SAMPLE_RATE_EXACT
+
+inline void AudioMemory(int) {}
+
+typedef struct audio_block_struct {
+	int16_t data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+class AudioStream {
+public:
+	AudioStream(unsigned char ninput, audio_block_t ** iqueue) : numInputs(ninput), inputQueue(iqueue) {
+		for(int i = 0; i < ninput; i++)
+			inputQueue[i] = NULL;
+	}
+	virtual ~AudioStream() {}
+	virtual void update(void) = 0;
+
+	void deliver(audio_block_t * block, unsigned int index = 0) {
+		if(index < numInputs) {
+			inputQueue[index] = block;
+			update();
+			inputQueue[index] = NULL;
+		}
+	}
+
+protected:
+	audio_block_t * receiveReadOnly(unsigned int index = 0) {
+		return index < numInputs ? inputQueue[index] : NULL;
+	}
+
+	void release(audio_block_t *) {}
+
+private:
+	unsigned char numInputs;
+	audio_block_t ** inputQueue;
+};
+
+class AudioAnalyzeFFT1024 {
+public:
+	static const int OUTPUT_SIZE = 512;
+	// The real object produces a new spectrum every 4 audio blocks (50% overlap).
+	static const uint32_t FRAME_MICROS = (uint32_t)(4 * AUDIO_BLOCK_SAMPLES * 1000000.0 / AUDIO_SAMPLE_RATE_EXACT);
+
+	AudioAnalyzeFFT1024() : frameCount(0), nextFrame(0), frameInterval(FRAME_MICROS), lastFrame(0), delivered(0) {
+		memset(output, 0, sizeof(output));
+	}
+
+	// Returns true once per frame period, with output[] holding the next spectrum.
+	// With a frame interval of 0 every call produces a new frame.
+	bool available() {
+		if(frameCount == 0)
+			return false;
+		if(frameInterval) {
+			uint32_t now = micros();
+			if(delivered && (uint32_t)(now - lastFrame) < frameInterval)
+				return false;
+			// frames missed while nobody polled are dropped, as on the device
+			if(!delivered || (uint32_t)(now - lastFrame) >= 2 * frameInterval)
+				lastFrame = now;
+			else
+				lastFrame += frameInterval;
+		}
+		memcpy(output, &spectra[nextFrame * OUTPUT_SIZE], sizeof(output));
+		nextFrame = (nextFrame + 1) % frameCount;
+		delivered++;
+		return true;
+	}
+
+	float read(unsigned int binNumber) {
+		return binNumber < (unsigned)OUTPUT_SIZE ? (float)output[binNumber] / 16384.0f : 0.0f;
+	}
+
+	void windowFunction(const int16_t *) {}
+
+	// Replays frameCount frames of OUTPUT_SIZE bins, looping at the end.
+	void feed(const uint16_t * frames, size_t count) {
+		spectra.assign(frames, frames + count * OUTPUT_SIZE);
+		frameCount = count;
+		nextFrame = 0;
+	}
+
+	// Loads a raw recording (little-endian uint16, OUTPUT_SIZE per frame).
+	bool loadSpectra(const char * path) {
+		FILE * f = fopen(path, "rb");
+		if(!f)
+			return false;
+		std::vector<uint16_t> frames;
+		uint8_t bytes[OUTPUT_SIZE * 2];
+		while(fread(bytes, sizeof(bytes), 1, f) == 1) {
+			for(int i = 0; i < OUTPUT_SIZE; i++)
+				frames.push_back(bytes[2*i] | (bytes[2*i+1] << 8));
+		}
+		fclose(f);
+		if(frames.empty())
+			return false;
+		feed(&frames[0], frames.size() / OUTPUT_SIZE);
+		return true;
+	}
+
+	// Generates count frames of a 120 BPM track: a decaying kick in the
+	// lowest bins, a wandering bass line, a 1/f noise floor and a slow
+	// quiet/loud envelope so autoscale has something to follow.
+	void synthesize(size_t count, uint32_t seed = 1) {
+		std::vector<uint16_t> frames(count * OUTPUT_SIZE);
+		const double framesPerBeat = 0.5 * 1000000.0 / FRAME_MICROS;
+		for(size_t f = 0; f < count; f++) {
+			double beatPhase = fmod((double)f, framesPerBeat) / framesPerBeat;
+			double kick = exp(-beatPhase * 12.0);
+			double section = 0.35 + 0.65 * (0.5 + 0.5 * sin(2.0 * M_PI * f / (framesPerBeat * 32)));
+			int bassBin = 2 + (int)((f / (int)framesPerBeat) % 4);
+			for(int i = 0; i < OUTPUT_SIZE; i++) {
+				seed = seed * 1664525u + 1013904223u;
+				double noise = (double)(seed >> 16) / 65536.0;
+				double v = 600.0 / (1.0 + i) * (0.5 + noise);
+				if(i < 4)
+					v += 2500.0 * kick;
+				if(i == bassBin || i == bassBin + 1)
+					v += 900.0 * (0.6 + 0.4 * noise);
+				v *= section;
+				frames[f * OUTPUT_SIZE + i] = (uint16_t)min(65535.0, v);
+			}
+		}
+		feed(&frames[0], count);
+	}
+
+	void setFrameInterval(uint32_t intervalMicros) {
+		frameInterval = intervalMicros;
+	}
+
+	uint32_t framesDelivered() {
+		return delivered;
+	}
+
+	uint16_t output[OUTPUT_SIZE] __attribute__((aligned(4)));
+
+private:
+	std::vector<uint16_t> spectra;
+	size_t frameCount;
+	size_t nextFrame;
+	uint32_t frameInterval;
+	uint32_t lastFrame;
+	uint32_t delivered;
+};
+
+#endif
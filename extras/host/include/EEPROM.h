@@ -0,0 +1,51 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for the EEPROM library: a RAM array that starts erased (0xFF).
+
+#ifndef _HOST_EEPROM_H
+#define _HOST_EEPROM_H
+
+#include "Arduino.h"
+
+class HostEEPROM {
+public:
+	static const int SIZE = 2048;
+
+	HostEEPROM() {
+		memset(data, 0xFF, SIZE);
+	}
+
+	uint8_t read(int address) {
+		return (address >= 0 && address < SIZE) ? data[address] : 0xFF;
+	}
+
+	void write(int address, uint8_t value) {
+		if(address >= 0 && address < SIZE)
+			data[address] = value;
+	}
+
+	int length() {
+		return SIZE;
+	}
+
+private:
+	uint8_t data[SIZE];
+};
+
+extern HostEEPROM EEPROM;
+
+#endif
@@ -0,0 +1,268 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-in for FastLED: pixel types, the 8-bit math helpers and the
+// rainbow HSV conversion with the same per-pixel cost profile, plus a LEDS
+// controller whose show() hands the frame to an optional host callback.
+
+#ifndef _HOST_FASTLED_H
+#define _HOST_FASTLED_H
+
+#include "Arduino.h"
+
+typedef uint8_t fract8;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+	return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+inline uint8_t scale8_video(uint8_t i, fract8 scale) {
+	return (((uint16_t)i * (uint16_t)scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+	unsigned t = i + j;
+	return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+	return i > j ? i - j : 0;
+}
+
+inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 frac) {
+	if(b > a)
+		return a + scale8(b - a, frac);
+	return a - scale8(a - b, frac);
+}
+
+enum HSVHue {
+	HUE_RED = 0,
+	HUE_ORANGE = 32,
+	HUE_YELLOW = 64,
+	HUE_GREEN = 96,
+	HUE_AQUA = 128,
+	HUE_BLUE = 160,
+	HUE_PURPLE = 192,
+	HUE_PINK = 224
+};
+
+enum EOrder {
+	RGB = 0012,
+	RBG = 0021,
+	GRB = 0102,
+	GBR = 0120,
+	BRG = 0201,
+	BGR = 0210
+};
+
+struct CHSV {
+	union {
+		struct {
+			uint8_t hue;
+			uint8_t sat;
+			uint8_t val;
+		};
+		struct {
+			uint8_t h;
+			uint8_t s;
+			uint8_t v;
+		};
+		uint8_t raw[3];
+	};
+
+	CHSV() {}
+	CHSV(uint8_t ih, uint8_t is, uint8_t iv) : hue(ih), sat(is), val(iv) {}
+};
+
+struct CRGB;
+void hsv2rgb_rainbow(const CHSV & hsv, CRGB & rgb);
+
+struct CRGB {
+	union {
+		struct {
+			uint8_t r;
+			uint8_t g;
+			uint8_t b;
+		};
+		uint8_t raw[3];
+	};
+
+	CRGB() {}
+	CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+	CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+	CRGB(const CHSV & rhs) {
+		hsv2rgb_rainbow(rhs, *this);
+	}
+
+	CRGB & operator=(const CHSV & rhs) {
+		hsv2rgb_rainbow(rhs, *this);
+		return *this;
+	}
+
+	uint8_t & operator[](uint8_t x) {
+		return raw[x];
+	}
+
+	const uint8_t & operator[](uint8_t x) const {
+		return raw[x];
+	}
+
+	CRGB & nscale8(uint8_t scale) {
+		r = scale8(r, scale);
+		g = scale8(g, scale);
+		b = scale8(b, scale);
+		return *this;
+	}
+
+	CRGB & operator+=(const CRGB & rhs) {
+		r = qadd8(r, rhs.r);
+		g = qadd8(g, rhs.g);
+		b = qadd8(b, rhs.b);
+		return *this;
+	}
+
+	enum HTMLColorCode {
+		Black = 0x000000,
+		White = 0xFFFFFF,
+		Red = 0xFF0000,
+		Green = 0x008000,
+		Blue = 0x0000FF
+	};
+};
+
+inline bool operator==(const CRGB & lhs, const CRGB & rhs) {
+	return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+inline bool operator!=(const CRGB & lhs, const CRGB & rhs) {
+	return !(lhs == rhs);
+}
+
+// FastLED's "rainbow" hue mapping: eight 32-step sections with a boosted
+// yellow band, then saturation and video-scaled value applied per channel.
+inline void hsv2rgb_rainbow(const CHSV & hsv, CRGB & rgb) {
+	uint8_t hue = hsv.hue;
+	uint8_t sat = hsv.sat;
+	uint8_t val = hsv.val;
+	uint8_t offset8 = (hue & 0x1F) << 3;
+	uint8_t third = scale8(offset8, 256 / 3);
+	uint8_t twoThirds = scale8(offset8, (256 * 2) / 3);
+	uint8_t r, g, b;
+
+	switch(hue >> 5) {
+	case 0: r = 255 - third; g = third; b = 0; break;
+	case 1: r = 171; g = 85 + third; b = 0; break;
+	case 2: r = 171 - twoThirds; g = 170 + third; b = 0; break;
+	case 3: r = 0; g = 255 - third; b = third; break;
+	case 4: r = 0; g = 171 - twoThirds; b = 85 + twoThirds; break;
+	case 5: r = third; g = 0; b = 255 - third; break;
+	case 6: r = 85 + third; g = 0; b = 171 - third; break;
+	default: r = 170 + third; g = 0; b = 85 - third; break;
+	}
+
+	if(sat != 255) {
+		if(sat == 0) {
+			r = g = b = 255;
+		}
+		else {
+			uint8_t desat = 255 - sat;
+			desat = scale8_video(desat, desat);
+			uint8_t satscale = 255 - desat;
+			if(r) r = scale8(r, satscale) + 1;
+			if(g) g = scale8(g, satscale) + 1;
+			if(b) b = scale8(b, satscale) + 1;
+			r += desat;
+			g += desat;
+			b += desat;
+		}
+	}
+
+	if(val != 255) {
+		val = scale8_video(val, val);
+		if(val == 0) {
+			r = g = b = 0;
+		}
+		else {
+			if(r) r = scale8(r, val) + 1;
+			if(g) g = scale8(g, val) + 1;
+			if(b) b = scale8(b, val) + 1;
+		}
+	}
+	rgb.r = r;
+	rgb.g = g;
+	rgb.b = b;
+}
+
+inline void fill_solid(CRGB * leds, int numToFill, const CRGB & color) {
+	for(int i = 0; i < numToFill; i++)
+		leds[i] = color;
+}
+
+template<uint8_t DATA_PIN, EOrder RGB_ORDER = RGB> class WS2811 {};
+template<uint8_t DATA_PIN, EOrder RGB_ORDER = RGB> class WS2812B {};
+template<uint8_t DATA_PIN, EOrder RGB_ORDER = RGB> class NEOPIXEL {};
+
+// The LEDS controller. show() does not transmit anything; it counts frames
+// and forwards the strip to the installed hook (frame capture, mock sinks).
+class CFastLED {
+public:
+	typedef void (*ShowHook)(const CRGB * leds, int numLeds, uint8_t brightness, void * context);
+
+	CFastLED() : leds(NULL), numLeds(0), brightness(255), shows(0), hook(NULL), hookContext(NULL) {}
+
+	template<template<uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+	CFastLED & addLeds(CRGB * data, int count, int offset = 0) {
+		leds = data + offset;
+		numLeds = count;
+		return *this;
+	}
+
+	void show() {
+		shows++;
+		if(hook)
+			hook(leds, numLeds, brightness, hookContext);
+	}
+
+	void setBrightness(uint8_t scale) {
+		brightness = scale;
+	}
+
+	uint8_t getBrightness() {
+		return brightness;
+	}
+
+	uint32_t getShowCount() {
+		return shows;
+	}
+
+	void setShowHook(ShowHook h, void * context = NULL) {
+		hook = h;
+		hookContext = context;
+	}
+
+private:
+	CRGB * leds;
+	int numLeds;
+	uint8_t brightness;
+	uint32_t shows;
+	ShowHook hook;
+	void * hookContext;
+};
+
+extern CFastLED FastLED;
+#define LEDS FastLED
+
+#endif
@@ -0,0 +1,64 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _HOSTCLOCK_H
+#define _HOSTCLOCK_H
+
+#include <stdint.h>
+
+// The time source behind micros(), millis() and delay() on the host build.
+// The default source follows the wall clock; install a VirtualClock to make
+// fades, hue sweeps and FFT frame timing fully deterministic.
+class HostClock {
+public:
+	virtual ~HostClock() {}
+	virtual uint64_t nowMicros() = 0;
+	virtual void delayMicros(uint32_t us) = 0;
+
+	// Makes clock the source for micros()/millis()/delay(). NULL restores the wall clock.
+	static void install(HostClock * clock);
+	// As install(), for the calling thread only, so pipelines on several
+	// threads can each keep their own time. NULL goes back to the shared clock.
+	static void installForThread(HostClock * clock);
+	static HostClock & current();
+};
+
+// A clock that only moves when told to. delay() advances it instantly.
+class VirtualClock : public HostClock {
+public:
+	VirtualClock(uint64_t startMicros = 0) : now(startMicros) {}
+
+	uint64_t nowMicros() {
+		return now;
+	}
+
+	void delayMicros(uint32_t us) {
+		now += us;
+	}
+
+	void advanceMicros(uint64_t us) {
+		now += us;
+	}
+
+	void setMicros(uint64_t us) {
+		now = us;
+	}
+
+private:
+	uint64_t now;
+};
+
+#endif
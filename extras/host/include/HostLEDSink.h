@@ -0,0 +1,138 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Host stand-ins for LED strip drivers, for LEDFrameBuffer. ThreadLEDSink
+// sends from a thread of its own the way a DMA driver sends from memory:
+// begin() returns at once and the thread reads the frame out over the wire
+// time, on the wall clock. It checksums the frame as the send starts and
+// again as it ends, so a caller that draws into a frame being sent shows up
+// as a torn frame. BlockingLEDSink holds the caller for the wire time, like
+// FastLED's show(). Both take the number of strips sent in parallel.
+
+#ifndef _HOST_LEDSINK_H
+#define _HOST_LEDSINK_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "LEDFrameBuffer.h"
+
+inline uint32_t hostFrameChecksum(const CRGB * frame, int numLeds) {
+	uint32_t sum = 0;
+	for(int i = 0; i < numLeds; i++)
+		sum = sum * 31 + (frame[i].r | frame[i].g << 8 | frame[i].b << 16);
+	return sum;
+}
+
+class ThreadLEDSink {
+public:
+	ThreadLEDSink(int strips = 1) : frame(NULL), numLeds(0), strips(strips), sending(false), stopping(false), frames(0),
+		torn(0) {
+		thread = std::thread(&ThreadLEDSink::run, this);
+	}
+
+	~ThreadLEDSink() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		thread.join();
+	}
+
+	void begin(const CRGB * frame, int numLeds) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			this->frame = frame;
+			this->numLeds = numLeds;
+			sending = true;
+		}
+		wake.notify_one();
+	}
+
+	bool busy() {
+		return sending;
+	}
+
+	uint32_t transferMicros(int numLeds) {
+		return ws2811Micros(numLeds, strips);
+	}
+
+	uint32_t getFrames() {
+		return frames;
+	}
+
+	// Frames that changed while they were being sent
+	uint32_t getTorn() {
+		return torn;
+	}
+
+private:
+	const CRGB * frame;
+	int numLeds;
+	int strips;
+	std::atomic<bool> sending;
+	bool stopping;
+	std::atomic<uint32_t> frames;
+	std::atomic<uint32_t> torn;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::thread thread;
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			wake.wait(lock, [this]() { return sending || stopping; });
+			if(stopping)
+				return;
+			const CRGB * sent = frame;
+			int count = numLeds;
+			lock.unlock();
+			uint32_t before = hostFrameChecksum(sent, count);
+			std::this_thread::sleep_for(std::chrono::microseconds(ws2811Micros(count, strips)));
+			if(hostFrameChecksum(sent, count) != before)
+				torn++;
+			frames++;
+			lock.lock();
+			sending = false;
+		}
+	}
+};
+
+class BlockingLEDSink {
+public:
+	BlockingLEDSink(int strips = 1) : strips(strips) {
+	}
+
+	void begin(const CRGB *, int numLeds) {
+		std::this_thread::sleep_for(std::chrono::microseconds(ws2811Micros(numLeds, strips)));
+	}
+
+	bool busy() {
+		return false;
+	}
+
+	uint32_t transferMicros(int numLeds) {
+		return ws2811Micros(numLeds, strips);
+	}
+
+private:
+	int strips;
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _HOSTTEST_H
+#define _HOSTTEST_H
+
+#include <stdio.h>
+
+// What the host tests share. Each test is one program: CHECK() prints a
+// failed condition with a printf message and counts it, and main() ends
+// with return testResult();
+
+// The failed CHECKs of this program
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+	if(!(condition)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		failures++; \
+	} \
+} while(0)
+
+// Prints the failures, or ok, and gives the exit status
+inline int testResult() {
+	if(failures)
+		printf("%d failures\n", failures);
+	else
+		printf("ok\n");
+	return failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Runs the shards of a ShardedRenderer on threads of their own. The
+// workers start with the executor and wait for jobs; run() hands them the
+// job, takes shards itself until none are left and returns once every
+// shard is done, so a frame still ends before the next one starts.
+
+#ifndef _HOST_THREADEXECUTOR_H
+#define _HOST_THREADEXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class HostThreadExecutor {
+public:
+	// workers threads besides the caller; by default one per spare core
+	HostThreadExecutor(int workers = -1) : job(NULL), generation(0), stopping(false), count(0), running(0) {
+		if(workers < 0) {
+			int cores = std::thread::hardware_concurrency();
+			workers = cores > 1 ? cores - 1 : 1;
+		}
+		for(int i = 0; i < workers; i++)
+			threads.push_back(std::thread(&HostThreadExecutor::work, this));
+	}
+
+	~HostThreadExecutor() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+	template<class F>
+	void run(int count, F & f) {
+		Job<F> task(f);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &task;
+			this->count = count;
+			next = 0;
+			remaining = count;
+			generation++;
+		}
+		wake.notify_all();
+		take(task, count);
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this]() { return remaining == 0 && running == 0; });
+		job = NULL;
+	}
+
+	int getWorkers() {
+		return (int)threads.size();
+	}
+
+private:
+	struct Task {
+		virtual void operator()(int i) = 0;
+	};
+
+	template<class F>
+	struct Job : Task {
+		F & f;
+		Job(F & f) : f(f) {
+		}
+		void operator()(int i) {
+			f(i);
+		}
+	};
+
+	Task * job;
+	unsigned generation;
+	bool stopping;
+	int count;
+	// workers inside the current job
+	int running;
+	std::atomic<int> next;
+	std::atomic<int> remaining;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	std::vector<std::thread> threads;
+
+	// Claims shards until all are taken
+	void take(Task & task, int count) {
+		for(int i = next++; i < count; i = next++) {
+			task(i);
+			if(--remaining == 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				finished.notify_all();
+			}
+		}
+	}
+
+	void work() {
+		unsigned seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			wake.wait(lock, [&]() { return stopping || (job != NULL && generation != seen); });
+			if(stopping)
+				return;
+			seen = generation;
+			Task * task = job;
+			int jobCount = count;
+			running++;
+			lock.unlock();
+			take(*task, jobCount);
+			lock.lock();
+			if(--running == 0)
+				finished.notify_all();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,468 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Runs the device pipeline over a recording instead of the audio input:
+// the samples go through FFTAnalyzer<1024> (the same frames as
+// AudioAnalyzeFFT1024), AudioProcessor and LEDStripAudioRenderer, as fast
+// as the host goes. Time is a VirtualClock of the calling thread, moved on
+// one loop() at a time and fed the samples that came in meanwhile, so the
+// fades and hue sweeps come out as on the device and renders on several
+// threads don't see each other's clocks. The strip is captured at a fixed
+// frame rate, RGB bytes a pixel. See tools/RenderWav.cpp.
+
+#ifndef _HOST_OFFLINERENDERER_H
+#define _HOST_OFFLINERENDERER_H
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AudioProcessor.h"
+#include "AudioRenderer.h"
+#include "BinLayout.h"
+#include "RenderScheduler.h"
+
+// A recording, mixed down to mono at the Audio library's sample rate
+struct WavAudio {
+	std::vector<int16_t> samples;
+
+	uint64_t durationMicros() const {
+		return (uint64_t)(samples.size() * 1000000.0 / AUDIO_SAMPLE_RATE_EXACT);
+	}
+};
+
+// Reads 8, 16, 24 or 32 bit PCM or 32 bit float WAV files of any rate and
+// channel count. Returns false with error set if path can't be used.
+inline bool loadWav(const char * path, WavAudio & audio, std::string & error) {
+	FILE * f = fopen(path, "rb");
+	if(f == NULL) {
+		error = std::string(path) + ": can't open";
+		return false;
+	}
+	std::vector<uint8_t> file;
+	uint8_t chunk[65536];
+	size_t read;
+	while((read = fread(chunk, 1, sizeof(chunk), f)) > 0)
+		file.insert(file.end(), chunk, chunk + read);
+	fclose(f);
+
+	struct Reader {
+		static uint32_t u16(const uint8_t * p) {
+			return p[0] | (p[1] << 8);
+		}
+		static uint32_t u32(const uint8_t * p) {
+			return u16(p) | (u16(p + 2) << 16);
+		}
+	};
+	if(file.size() < 12 || memcmp(&file[0], "RIFF", 4) || memcmp(&file[8], "WAVE", 4)) {
+		error = std::string(path) + ": not a WAV file";
+		return false;
+	}
+	int format = 0, channels = 0, bits = 0;
+	uint32_t rate = 0;
+	const uint8_t * data = NULL;
+	size_t dataLength = 0;
+	for(size_t at = 12; at + 8 <= file.size();) {
+		uint32_t length = Reader::u32(&file[at + 4]);
+		const uint8_t * body = &file[at + 8];
+		size_t available = min((size_t)length, file.size() - at - 8);
+		if(!memcmp(&file[at], "fmt ", 4) && available >= 16) {
+			format = Reader::u16(body);
+			channels = Reader::u16(body + 2);
+			rate = Reader::u32(body + 4);
+			bits = Reader::u16(body + 14);
+			// WAVE_FORMAT_EXTENSIBLE keeps the format in its subformat
+			if(format == 0xFFFE && available >= 26)
+				format = Reader::u16(body + 24);
+		}
+		else if(!memcmp(&file[at], "data", 4)) {
+			data = body;
+			dataLength = available;
+		}
+		at += 8 + (size_t)length + (length & 1);
+	}
+	const bool pcm = format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+	const bool floating = format == 3 && bits == 32;
+	if(data == NULL || channels < 1 || rate == 0 || !(pcm || floating)) {
+		error = std::string(path) + ": only PCM and float WAV files are read";
+		return false;
+	}
+
+	// mixed down, in [-1, 1]
+	const int width = bits / 8;
+	const size_t frames = dataLength / (width * channels);
+	std::vector<float> mono(frames);
+	for(size_t i = 0; i < frames; i++) {
+		float sum = 0;
+		for(int c = 0; c < channels; c++) {
+			const uint8_t * s = data + (i * channels + c) * width;
+			if(floating) {
+				uint32_t word = Reader::u32(s);
+				float value;
+				memcpy(&value, &word, sizeof(value));
+				sum += value;
+			}
+			else if(bits == 8)
+				sum += (s[0] - 128) / 128.0f;
+			else if(bits == 16)
+				sum += (int16_t)Reader::u16(s) / 32768.0f;
+			else if(bits == 24)
+				sum += (int32_t)((s[0] << 8) | (s[1] << 16) | ((uint32_t)s[2] << 24)) / 2147483648.0f;
+			else
+				sum += (int32_t)Reader::u32(s) / 2147483648.0f;
+		}
+		mono[i] = sum / channels;
+	}
+
+	// resampled by straight lines between samples, which is plenty for
+	// what ends up in 512 FFT bins
+	const double step = rate / AUDIO_SAMPLE_RATE_EXACT;
+	const size_t count = frames ? (size_t)((frames - 1) / step) + 1 : 0;
+	audio.samples.resize(count);
+	for(size_t i = 0; i < count; i++) {
+		double position = i * step;
+		size_t at = (size_t)position;
+		float fraction = position - at;
+		float v = mono[at] + (at + 1 < frames ? (mono[at + 1] - mono[at]) * fraction : 0.0f);
+		audio.samples[i] = (int16_t)constrain((int)lroundf(v * 32767.0f), -32768, 32767);
+	}
+	return true;
+}
+
+// One configuration to render: the strip, its bin layout and the
+// renderer's and autoscale's settings, as parsed from a line of
+// key=value pairs by parse().
+struct RenderParams {
+	std::string name;
+	int leds;
+	int bins;
+	// octave, linear, mel or custom (set by fft=)
+	std::string layout;
+	// start and end FFT bin of each display bin, with layout custom
+	std::vector<int> fftRanges;
+	// LEDs of each display bin, or empty for equal parts
+	std::vector<int> split;
+	DisplayFunction function;
+	BinWeighting weighting;
+	int edgeFade;
+	int newValueFade;
+	int sweepTime;
+	int startHue;
+	int endHue;
+	int saturation;
+	bool reverse;
+	int beatHueStep;
+	// manual scale, or below 0 for autoscale
+	float scale;
+	// autoscale attack and release in ms, 0 for the defaults
+	int attack;
+	int release;
+	// the bin value autoscale aims for, 0 for the default
+	int target;
+	bool uniform;
+	// RenderScheduler frames a second, 0 to draw on every analysis frame
+	int frameRate;
+	// how long one loop() takes on the device
+	int loopMicros;
+
+	RenderParams() : leds(168), bins(8), layout("octave"), function(DisplayFunction::Sqrt), weighting(BinWeighting::Flat),
+		edgeFade(2000), newValueFade(11000), sweepTime(10000), startHue(HUE_BLUE), endHue(HUE_PINK), saturation(240),
+		reverse(false), beatHueStep(0), scale(-1.0f), attack(0), release(0), target(0), uniform(false), frameRate(0),
+		loopMicros(1000) {
+	}
+
+	// The display bin counts the renderer is built for
+	static bool isSupportedBins(int bins) {
+		return bins == 3 || bins == 4 || bins == 6 || bins == 8 || bins == 12 || bins == 16;
+	}
+
+	// Reads pairs like "leds=240 bins=8 sweep=160,224,240", over the
+	// defaults. Returns false with error set on a key or value it doesn't
+	// know. Anything after a # is a comment.
+	bool parse(const std::string & line, std::string & error) {
+		size_t at = 0;
+		while(at < line.size()) {
+			while(at < line.size() && isspace((unsigned char)line[at]))
+				at++;
+			if(at >= line.size() || line[at] == '#')
+				break;
+			size_t end = at;
+			while(end < line.size() && !isspace((unsigned char)line[end]))
+				end++;
+			std::string pair = line.substr(at, end - at);
+			at = end;
+			size_t equals = pair.find('=');
+			if(equals == std::string::npos || equals == 0) {
+				error = "expected key=value, got " + pair;
+				return false;
+			}
+			if(!set(pair.substr(0, equals), pair.substr(equals + 1), error))
+				return false;
+		}
+		return check(error);
+	}
+
+	// Fills the BINS display bins this configuration describes
+	template<int BINS, class SPECTRUM>
+	void layoutBins(DisplayBin * out) const {
+		typedef BinLayout<1, BINS, SPECTRUM::SIZE, AUDIO_SAMPLE_RATE_MHZ, SPECTRUM> Layout;
+		const DisplayBin * table = layout == "linear" ? Layout::linear.bins :
+			layout == "mel" ? Layout::mel.bins : Layout::octave.bins;
+		int led = 0;
+		for(int i = 0; i < BINS; i++) {
+			out[i] = table[i];
+			if(!fftRanges.empty()) {
+				out[i].startFFTBin = fftRanges[2 * i];
+				out[i].endFFTBin = fftRanges[2 * i + 1];
+			}
+			out[i].startLEDNum = split.empty() ? i * leds / BINS : led;
+			led += split.empty() ? 0 : split[i];
+			out[i].endLEDNum = split.empty() ? (i + 1) * leds / BINS : led;
+			out[i].displayFunction = function;
+			out[i].weighting = weighting;
+		}
+	}
+
+private:
+	static bool numbers(const std::string & value, std::vector<int> & out, const char * separators) {
+		out.clear();
+		const char * p = value.c_str();
+		while(*p) {
+			char * end;
+			long n = strtol(p, &end, 10);
+			if(end == p)
+				return false;
+			out.push_back((int)n);
+			p = end;
+			if(*p && strchr(separators, *p))
+				p++;
+			else if(*p)
+				return false;
+		}
+		return !out.empty();
+	}
+
+	bool set(const std::string & key, const std::string & value, std::string & error) {
+		std::vector<int> n;
+		bool ok = true;
+		if(key == "name")
+			name = value;
+		else if(key == "leds")
+			ok = numbers(value, n, "") && (leds = n[0]) > 0;
+		else if(key == "bins")
+			ok = numbers(value, n, "") && isSupportedBins(bins = n[0]);
+		else if(key == "layout") {
+			layout = value;
+			fftRanges.clear();
+			ok = value == "octave" || value == "linear" || value == "mel";
+		}
+		else if(key == "fft") {
+			layout = "custom";
+			ok = numbers(value, fftRanges, ",-") && fftRanges.size() % 2 == 0;
+		}
+		else if(key == "split")
+			ok = numbers(value, split, ",");
+		else if(key == "function") {
+			if(value == "lin")
+				function = DisplayFunction::Lin;
+			else if(value == "log")
+				function = DisplayFunction::Log;
+			else if(value == "sq")
+				function = DisplayFunction::Sq;
+			else if(value == "sqrt")
+				function = DisplayFunction::Sqrt;
+			else
+				ok = false;
+		}
+		else if(key == "weighting") {
+			if(value == "flat")
+				weighting = BinWeighting::Flat;
+			else if(value == "triangle")
+				weighting = BinWeighting::Triangle;
+			else if(value == "mel")
+				weighting = BinWeighting::Mel;
+			else if(value == "bark")
+				weighting = BinWeighting::Bark;
+			else
+				ok = false;
+		}
+		else if(key == "speed") {
+			ok = numbers(value, n, ",") && n.size() == 3;
+			if(ok) {
+				edgeFade = n[0];
+				newValueFade = n[1];
+				sweepTime = n[2];
+			}
+		}
+		else if(key == "sweep") {
+			std::string hues = value;
+			reverse = hues.size() > 8 && hues.compare(hues.size() - 8, 8, ",reverse") == 0;
+			if(reverse)
+				hues.erase(hues.size() - 8);
+			ok = numbers(hues, n, ",") && n.size() >= 2 && n.size() <= 3;
+			if(ok) {
+				startHue = n[0];
+				endHue = n[1];
+				saturation = n.size() > 2 ? n[2] : 255;
+			}
+		}
+		else if(key == "beat")
+			ok = numbers(value, n, "") && (beatHueStep = n[0]) >= 0;
+		else if(key == "scale")
+			scale = atof(value.c_str());
+		else if(key == "gain") {
+			ok = numbers(value, n, ",") && n.size() == 2;
+			if(ok) {
+				attack = n[0];
+				release = n[1];
+			}
+		}
+		else if(key == "target")
+			ok = numbers(value, n, "") && (target = n[0]) >= 0 && target <= 255;
+		else if(key == "uniform")
+			uniform = value == "1" || value == "true";
+		else if(key == "fps")
+			ok = numbers(value, n, "") && (frameRate = n[0]) >= 0;
+		else if(key == "loop")
+			ok = numbers(value, n, "") && (loopMicros = n[0]) > 0;
+		else {
+			error = "unknown key " + key;
+			return false;
+		}
+		if(!ok)
+			error = "bad value for " + key + ": " + value;
+		return ok;
+	}
+
+	bool check(std::string & error) {
+		if(!fftRanges.empty() && (int)fftRanges.size() != 2 * bins) {
+			error = "fft= needs a start-end range for each of the " + std::to_string(bins) + " bins";
+			return false;
+		}
+		if(!split.empty()) {
+			int total = 0;
+			for(size_t i = 0; i < split.size(); i++)
+				total += split[i];
+			if((int)split.size() != bins || total > leds) {
+				error = "split= needs an LED count for each bin, adding up to at most leds";
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// Renders audio with params, appending frames a second of leds RGB bytes
+// to pixels until the recording ends. Returns the frames rendered.
+template<int BINS>
+int renderOffline(const WavAudio & audio, const RenderParams & params, int fps, std::vector<uint8_t> & pixels) {
+	typedef FFTAnalyzer<1024, FFTWindow::Hann, 2> Analyzer;
+	// weights for every band of a half-overlapping layout
+	typedef AudioProcessor<BINS, 0, 0x01, DefaultReduceKernel, Analyzer, 1, Analyzer::Spectrum::SIZE * 2> Processor;
+	typedef LEDStripAudioRenderer<BINS> Renderer;
+
+	// hands analysis frames to the renderer without drawing, as
+	// AudioVisualizer does on a frame rate
+	struct FrameTarget {
+		Renderer * renderer;
+		void update(FFTBinData<BINS> * data) {
+			if(data != NULL)
+				renderer->setFrame(data);
+		}
+	};
+
+	VirtualClock clock;
+	HostClock::installForThread(&clock);
+
+	// the analyzer and processor are big for a thread's stack
+	std::unique_ptr<Analyzer> fft(new Analyzer());
+	std::unique_ptr<Processor> processorOwner(new Processor(*fft));
+	Processor & processor = *processorOwner;
+	std::unique_ptr<Renderer> rendererOwner(new Renderer());
+	Renderer & renderer = *rendererOwner;
+	DisplayBin bins[BINS];
+	params.layoutBins<BINS, typename Analyzer::Spectrum>(bins);
+	std::vector<CRGB> leds(params.leds, CRGB(0, 0, 0));
+
+	processor.init(bins);
+	processor.setUniformScale(params.uniform);
+	if(params.attack > 0 && params.release > 0)
+		processor.setAutoScaleTimes(params.attack, params.release);
+	if(params.target > 0)
+		processor.getAutoGain().setTarget(params.target);
+	renderer.setSpeed(params.edgeFade, params.newValueFade, params.sweepTime);
+	renderer.setColorSweep(params.startHue, params.endHue, params.saturation, params.reverse);
+	renderer.setBeatHueStep(params.beatHueStep);
+	renderer.init(&leds[0], params.leds, bins);
+	RendererSet<BINS, Renderer> set(renderer);
+	FrameTarget target = {&renderer};
+	RenderScheduler scheduler;
+	scheduler.setFrameRate(params.frameRate);
+
+	const uint64_t duration = audio.durationMicros();
+	const double frameMicros = 1000000.0 / fps;
+	double nextFrame = 0;
+	size_t fed = 0;
+	int frames = 0;
+	for(uint64_t now = 0; now < duration; now += params.loopMicros) {
+		clock.setMicros(now);
+		size_t due = min(audio.samples.size(), (size_t)(now * AUDIO_SAMPLE_RATE_EXACT / 1000000.0));
+		if(due > fed) {
+			fft->write(&audio.samples[fed], due - fed);
+			fed = due;
+		}
+		if(scheduler.isEnabled()) {
+			processor.analyzeData(target, params.scale);
+			if(scheduler.due(micros()))
+				renderer.render();
+		}
+		else
+			processor.analyzeData(set, params.scale);
+		// the strip as it stands at each output frame
+		while(nextFrame <= now) {
+			pixels.insert(pixels.end(), (const uint8_t *)&leds[0], (const uint8_t *)&leds[0] + params.leds * 3);
+			nextFrame += frameMicros;
+			frames++;
+		}
+	}
+	HostClock::installForThread(NULL);
+	return frames;
+}
+
+// renderOffline() for the display bins params asks for, or -1 if they are
+// not one of RenderParams::isSupportedBins()
+inline int renderOffline(const WavAudio & audio, const RenderParams & params, int fps, std::vector<uint8_t> & pixels) {
+	switch(params.bins) {
+	case 3:
+		return renderOffline<3>(audio, params, fps, pixels);
+	case 4:
+		return renderOffline<4>(audio, params, fps, pixels);
+	case 6:
+		return renderOffline<6>(audio, params, fps, pixels);
+	case 8:
+		return renderOffline<8>(audio, params, fps, pixels);
+	case 12:
+		return renderOffline<12>(audio, params, fps, pixels);
+	case 16:
+		return renderOffline<16>(audio, params, fps, pixels);
+	default:
+		return -1;
+	}
+}
+
+#endif
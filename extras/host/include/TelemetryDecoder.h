@@ -0,0 +1,167 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Finds the records of a telemetry stream (see Telemetry.h) in bytes as
+// they come off the serial port. Anything that is not a record, such as
+// text printed before streaming started or a record cut short, is skipped
+// up to the next pair of sync bytes whose record sums right. Gaps in the
+// sequence numbers count the records the device dropped or the port lost.
+
+#ifndef _HOST_TELEMETRYDECODER_H
+#define _HOST_TELEMETRYDECODER_H
+
+#include <stdint.h>
+#include <vector>
+#include "Telemetry.h"
+
+class TelemetryDecoder {
+public:
+	struct Record {
+		uint8_t type;
+		uint16_t sequence;
+		std::vector<uint8_t> payload;
+
+		uint8_t u8(size_t offset) const {
+			return payload[offset];
+		}
+
+		uint16_t u16(size_t offset) const {
+			return payload[offset] | (payload[offset + 1] << 8);
+		}
+
+		uint32_t u32(size_t offset) const {
+			return u16(offset) | ((uint32_t)u16(offset + 2) << 16);
+		}
+	};
+
+	// maxPayload bounds what a false sync can make the decoder wait for
+	TelemetryDecoder(size_t maxPayload = 8192) : maxPayload(maxPayload), taken(0), started(false), expected(0),
+		records(0), missing(0), skipped(0), badSums(0) {
+	}
+
+	// Adds length bytes of the stream, and returns how many records are
+	// ready in next()
+	size_t feed(const uint8_t * data, size_t length) {
+		buffer.insert(buffer.end(), data, data + length);
+		parse();
+		return ready.size() - taken;
+	}
+
+	// Takes the oldest ready record, returning false if there is none
+	bool next(Record & record) {
+		if(taken == ready.size())
+			return false;
+		record = ready[taken++];
+		if(taken == ready.size()) {
+			ready.clear();
+			taken = 0;
+		}
+		return true;
+	}
+
+	// Records found
+	uint32_t getRecords() {
+		return records;
+	}
+
+	// Records missing from the sequence
+	uint32_t getMissing() {
+		return missing;
+	}
+
+	// Bytes skipped between records
+	uint32_t getSkipped() {
+		return skipped;
+	}
+
+	// Sync bytes that were followed by a bad sum
+	uint32_t getBadSums() {
+		return badSums;
+	}
+
+	static const char * name(uint8_t type) {
+		switch(type) {
+		case TelemetrySpectrum:
+			return "spectrum";
+		case TelemetryBins:
+			return "bins";
+		case TelemetryScale:
+			return "scale";
+		case TelemetryStats:
+			return "stats";
+		default:
+			return "unknown";
+		}
+	}
+
+private:
+	size_t maxPayload;
+	std::vector<uint8_t> buffer;
+	std::vector<Record> ready;
+	size_t taken;
+	bool started;
+	uint16_t expected;
+	uint32_t records;
+	uint32_t missing;
+	uint32_t skipped;
+	uint32_t badSums;
+
+	void parse() {
+		size_t at = 0;
+		while(true) {
+			// the next sync pair
+			size_t sync = at;
+			while(sync + 1 < buffer.size() && !(buffer[sync] == TELEMETRY_SYNC0 && buffer[sync + 1] == TELEMETRY_SYNC1))
+				sync++;
+			skipped += sync - at;
+			at = sync;
+			if(at + TELEMETRY_HEADER > buffer.size())
+				break;
+			size_t length = buffer[at + 3] | (buffer[at + 4] << 8);
+			if(length > maxPayload) {
+				// not a record's header after all
+				skipped++;
+				at++;
+				continue;
+			}
+			if(at + TELEMETRY_HEADER + length + 1 > buffer.size())
+				break;
+			uint8_t sum = 0;
+			for(size_t i = at + 2; i < at + TELEMETRY_HEADER + length; i++)
+				sum += buffer[i];
+			if(sum != buffer[at + TELEMETRY_HEADER + length]) {
+				badSums++;
+				skipped++;
+				at++;
+				continue;
+			}
+			Record record;
+			record.type = buffer[at + 2];
+			record.sequence = buffer[at + 5] | (buffer[at + 6] << 8);
+			record.payload.assign(buffer.begin() + at + TELEMETRY_HEADER, buffer.begin() + at + TELEMETRY_HEADER + length);
+			if(started)
+				missing += (uint16_t)(record.sequence - expected);
+			started = true;
+			expected = record.sequence + 1;
+			records++;
+			ready.push_back(record);
+			at += TELEMETRY_HEADER + length + 1;
+		}
+		buffer.erase(buffer.begin(), buffer.begin() + at);
+	}
+};
+
+#endif
@@ -0,0 +1,2 @@
+// Host stand-in: forwards to the FastLED shim.
+#include "FastLED.h"
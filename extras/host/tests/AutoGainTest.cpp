@@ -0,0 +1,205 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Steps the input level up and down by 20dB and counts the FFT frames the
+// autoscale takes to bring every bin back within 1dB of its target value,
+// and checks the default target is the old autoscale's.
+// Runs on the virtual clock, so frame timing is exact.
+
+#include <vector>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+const int BINS = 4;
+const int TARGET = 128;
+VirtualClock virtualClock;
+
+// Keeps the bin values of the latest frame.
+class LastFrame : public AudioRenderer<BINS> {
+public:
+	FFTBinData<BINS> data;
+	void update(FFTBinData<BINS> * data) {
+		if(data)
+			this->data = *data;
+	}
+};
+
+struct Rig {
+	AudioAnalyzeFFT1024 fft;
+	AudioProcessor<BINS> processor;
+	LastFrame frame;
+	DisplayBin bins[BINS];
+
+	// target 0 leaves the AutoGain's default
+	Rig(int target = TARGET) : processor(fft) {
+		// four 16 bin wide bands
+		for(int i = 0; i < BINS; i++) {
+			bins[i].startFFTBin = 16 * i;
+			bins[i].endFFTBin = 16 * (i + 1);
+			bins[i].startLEDNum = i;
+			bins[i].endLEDNum = i + 1;
+			bins[i].displayFunction = DisplayFunction::Lin;
+			bins[i].weighting = BinWeighting::Flat;
+		}
+		virtualClock.setMicros(0);
+		processor.init(bins);
+		if(target)
+			processor.getAutoGain().setTarget(target);
+		processor.connectAudioRenderer(&frame);
+	}
+
+	// A constant spectrum with each band at level * gains[i] per FFT bin
+	void setLevel(double level, const double * gains = NULL) {
+		std::vector<uint16_t> spectrum(AudioAnalyzeFFT1024::OUTPUT_SIZE, 0);
+		for(int i = 0; i < BINS; i++)
+			for(int k = bins[i].startFFTBin; k < bins[i].endFFTBin; k++)
+				spectrum[k] = (uint16_t)min(65535.0, level * (gains ? gains[i] : 1.0));
+		fft.feed(&spectrum[0], 1);
+	}
+
+	// Runs one FFT period
+	void frameStep() {
+		virtualClock.advanceMicros(AudioAnalyzeFFT1024::FRAME_MICROS);
+		processor.analyzeData();
+	}
+
+	bool settled(const int * targets) {
+		for(int i = 0; i < BINS; i++) {
+			// 1dB either way
+			int v = frame.data.binValues[i];
+			if(v * 112 < targets[i] * 100 || v * 100 > targets[i] * 112)
+				return false;
+		}
+		return true;
+	}
+
+	// Frames until the bins settle on targets and stay there for 8 frames
+	int framesToSettle(const int * targets, int limit) {
+		int streak = 0;
+		for(int n = 1; n <= limit; n++) {
+			frameStep();
+			streak = settled(targets) ? streak + 1 : 0;
+			if(streak == 8)
+				return n - 7;
+		}
+		return -1;
+	}
+};
+
+// Frames for a first order follower of time constant tauMs to close all but
+// remaining of the gap
+int expectedFrames(double tauMs, double remaining) {
+	double frameMs = AudioAnalyzeFFT1024::FRAME_MICROS / 1000.0;
+	return (int)ceil(log(remaining) / log(tauMs / (tauMs + frameMs)));
+}
+
+// The gain works in 16us ticks and approximate logs, and bin values are
+// whole numbers, so allow 5% over the ideal follower
+bool closeTo(int frames, int expected) {
+	return frames > 0 && frames <= expected * 21 / 20 + 2;
+}
+
+void testSteps(uint16_t attackMs, uint16_t releaseMs) {
+	Rig rig;
+	rig.processor.setAutoScaleTimes(attackMs, releaseMs);
+	const int targets[BINS] = {TARGET, TARGET, TARGET, TARGET};
+	// 20dB is 3.3 octaves and 1dB 0.17, so about 5% of the step remains
+	const double remaining = 0.166 / 3.32;
+
+	rig.setLevel(60.0);
+	int start = rig.framesToSettle(targets, 20000);
+	CHECK(start > 0, "no convergence from the initial scale");
+
+	rig.setLevel(600.0);
+	int up = rig.framesToSettle(targets, 20000);
+	int upExpected = expectedFrames(attackMs, remaining);
+	printf("attack %4ums: +20dB settled in %4d frames (first order: %4d)\n", attackMs, up, upExpected);
+	CHECK(closeTo(up, upExpected), "+20dB took %d frames, expected %d", up, upExpected);
+
+	rig.setLevel(60.0);
+	int down = rig.framesToSettle(targets, 20000);
+	int downExpected = expectedFrames(releaseMs, remaining);
+	printf("release %4ums: -20dB settled in %4d frames (first order: %4d)\n", releaseMs, down, downExpected);
+	CHECK(closeTo(down, downExpected), "-20dB took %d frames, expected %d", down, downExpected);
+	CHECK(down > up || attackMs >= releaseMs, "release (%d frames) was not slower than attack (%d)", down, up);
+}
+
+// Linked bins follow the loudest and keep their balance.
+void testUniform() {
+	Rig rig;
+	rig.processor.setUniformScale(true);
+	rig.processor.setAutoScaleTimes(50, 500);
+	const double gains[BINS] = {1.0, 0.5, 0.25, 0.125};
+	const int targets[BINS] = {TARGET, TARGET / 2, TARGET / 4, TARGET / 8};
+	rig.setLevel(400.0, gains);
+	int frames = rig.framesToSettle(targets, 20000);
+	printf("uniform: settled in %d frames at %d %d %d %d\n", frames,
+		rig.frame.data.binValues[0], rig.frame.data.binValues[1],
+		rig.frame.data.binValues[2], rig.frame.data.binValues[3]);
+	CHECK(frames > 0, "linked bins never settled on their relative levels");
+}
+
+// Left alone, the gain settles where the stepping autoscale did, a quarter
+// of full scale, so displays keep their old brightness.
+void testDefaultTarget() {
+	Rig rig(0);
+	const int quarter = 255 / 4;
+	const int targets[BINS] = {quarter, quarter, quarter, quarter};
+	rig.setLevel(600.0);
+	CHECK(rig.framesToSettle(targets, 20000) > 0, "default target: settled at %d, not %d",
+		rig.frame.data.binValues[0], quarter);
+}
+
+// Near silence under the gate leaves the scale alone instead of
+// amplifying the noise to full brightness.
+void testNoiseGate() {
+	Rig rig;
+	rig.processor.setAutoScaleTimes(50, 200);
+	rig.processor.setNoiseGate(16 * 20);
+	rig.setLevel(600.0);
+	for(int n = 0; n < 200; n++)
+		rig.frameStep();
+	uint32_t loudScale = rig.processor.getAutoGain().scale(0);
+	rig.setLevel(10.0);
+	for(int n = 0; n < 2000; n++)
+		rig.frameStep();
+	CHECK(rig.processor.getAutoGain().scale(0) == loudScale, "gated scale moved from %u to %u",
+		loudScale, rig.processor.getAutoGain().scale(0));
+	CHECK(rig.frame.data.binValues[0] < TARGET / 16, "gated noise shows as %d", rig.frame.data.binValues[0]);
+
+	// without the gate the same noise is pulled up to the target
+	rig.processor.setNoiseGate(0);
+	const int targets[BINS] = {TARGET, TARGET, TARGET, TARGET};
+	CHECK(rig.framesToSettle(targets, 20000) > 0, "ungated noise never reached the target");
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	testSteps(50, 1500);
+	testSteps(10, 300);
+	testSteps(200, 3000);
+	testUniform();
+	testDefaultTarget();
+	testNoiseGate();
+
+	return testResult();
+}
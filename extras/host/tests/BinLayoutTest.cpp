@@ -0,0 +1,103 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks the compile-time octave and linear layouts against the runtime
+// pow() code they replaced, for a spread of strip lengths and bin counts,
+// and that the millihertz sample rate keeps the Audio library's fraction.
+
+#include <math.h>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+// what AudioVisualizer computed at construction before the tables
+void runtimeOctave(DisplayBin * bins, int numLeds, int displayBins) {
+	float functionBase = pow(MAX_FFT_HZ, 1.0 / (float)displayBins);
+	float ledsPerBin = (float)numLeds / (float)displayBins;
+	for(int i = 0; i < displayBins; i++) {
+		DisplayBin & bin = bins[i];
+		bin.startFFTBin = HZ_TO_NEAREST_FFT_BIN(pow(functionBase, i));
+		bin.endFFTBin = HZ_TO_NEAREST_FFT_BIN(pow(functionBase, i + 1));
+		if(bin.endFFTBin == bin.startFFTBin)
+			bin.endFFTBin++;
+		if(bin.startFFTBin > FFT_OUTPUT_SIZE - 1)
+			bin.startFFTBin = FFT_OUTPUT_SIZE - 1;
+		if(bin.endFFTBin > FFT_OUTPUT_SIZE - 1)
+			bin.endFFTBin = FFT_OUTPUT_SIZE - 1;
+		bin.startLEDNum = i * ledsPerBin;
+		bin.endLEDNum = (i + 1) * ledsPerBin;
+	}
+}
+
+void runtimeLinear(DisplayBin * bins, int numLeds, int displayBins) {
+	float displaySize = FFT_OUTPUT_SIZE / (float)displayBins;
+	float ledsPerBin = (float)numLeds / (float)displayBins;
+	for(int i = 0; i < displayBins; i++) {
+		DisplayBin & bin = bins[i];
+		bin.startFFTBin = i * displaySize;
+		bin.endFFTBin = (i + 1.0) * displaySize;
+		bin.startLEDNum = i * ledsPerBin;
+		bin.endLEDNum = (i + 1) * ledsPerBin;
+	}
+}
+
+void compare(const char * name, int numLeds, int displayBins, const DisplayBin * table,
+		const DisplayBin * expected) {
+	for(int i = 0; i < displayBins; i++) {
+		const DisplayBin & got = table[i];
+		const DisplayBin & want = expected[i];
+		CHECK(got.startFFTBin == want.startFFTBin && got.endFFTBin == want.endFFTBin,
+			"%s %d leds %d bins: bin %d FFT bins [%d, %d), expected [%d, %d)", name, numLeds,
+			displayBins, i, got.startFFTBin, got.endFFTBin, want.startFFTBin, want.endFFTBin);
+		CHECK(got.startLEDNum == want.startLEDNum && got.endLEDNum == want.endLEDNum,
+			"%s %d leds %d bins: bin %d LEDs [%d, %d), expected [%d, %d)", name, numLeds,
+			displayBins, i, got.startLEDNum, got.endLEDNum, want.startLEDNum, want.endLEDNum);
+		CHECK(got.displayFunction == DisplayFunction::Lin && got.weighting == BinWeighting::Flat,
+			"%s %d leds %d bins: bin %d not a flat linear bar", name, numLeds, displayBins, i);
+	}
+}
+
+template<int NUM_LEDS, int DISPLAY_BINS>
+void checkLayouts() {
+	typedef BinLayout<NUM_LEDS, DISPLAY_BINS, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ> Layout;
+	DisplayBin expected[DISPLAY_BINS];
+	runtimeOctave(expected, NUM_LEDS, DISPLAY_BINS);
+	compare("octave", NUM_LEDS, DISPLAY_BINS, Layout::octave.bins, expected);
+	runtimeLinear(expected, NUM_LEDS, DISPLAY_BINS);
+	compare("linear", NUM_LEDS, DISPLAY_BINS, Layout::linear.bins, expected);
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	CHECK(AUDIO_SAMPLE_RATE_MHZ == 44117647, "AUDIO_SAMPLE_RATE_MHZ is %ld", (long)AUDIO_SAMPLE_RATE_MHZ);
+	typedef UniformSpectrum<FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ> Spectrum;
+	CHECK(fabs(Spectrum::BIN_HZ - FFT_BIN_SIZE_HZ) < 1e-3, "bin width %f, expected %f",
+		Spectrum::BIN_HZ, (double)FFT_BIN_SIZE_HZ);
+
+	checkLayouts<168, 8>();
+	checkLayouts<150, 8>();
+	checkLayouts<60, 3>();
+	checkLayouts<100, 7>();
+	checkLayouts<120, 16>();
+	checkLayouts<255, 12>();
+	checkLayouts<64, 32>();
+
+	return testResult();
+}
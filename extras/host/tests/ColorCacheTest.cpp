@@ -0,0 +1,94 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks that the strip renderer's fading colors are CHSV of the current
+// hue, saturation and brightness with and without the color cache: after
+// the hue moves, after the saturation changes and at every brightness. The
+// cache costs its 800 bytes only when it is asked for.
+
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+template<bool COLOR_CACHE>
+class Renderer : public LEDStripAudioRenderer<1, 8, COLOR_CACHE> {
+public:
+	uint8_t getHue8() {
+		return this->hue8;
+	}
+};
+
+// every brightness against a fresh conversion
+template<bool COLOR_CACHE>
+void checkColors(Renderer<COLOR_CACHE> & renderer, const char * name, uint8_t saturation) {
+	uint8_t hue8 = renderer.getHue8();
+	for(int b = 0; b < 256; b++) {
+		CRGB got = renderer.color(b);
+		CRGB want = CHSV(hue8, saturation, b);
+		CHECK(got.r == want.r && got.g == want.g && got.b == want.b,
+			"%s: brightness %d at hue %u is (%u, %u, %u), expected (%u, %u, %u)", name, b, hue8, got.r, got.g, got.b,
+			want.r, want.g, want.b);
+	}
+}
+
+template<bool COLOR_CACHE>
+void checkInvalidation(const char * name) {
+	Renderer<COLOR_CACHE> renderer;
+	char label[64];
+	renderer.setColorSweep(HUE_RED, HUE_BLUE, 255);
+	snprintf(label, sizeof(label), "%s first", name);
+	checkColors(renderer, label, 255);
+
+	// filled at one hue, read at the next
+	renderer.setHue8(HUE_GREEN);
+	snprintf(label, sizeof(label), "%s after setHue8", name);
+	checkColors(renderer, label, 255);
+
+	// the sweep moving the hue on by itself
+	renderer.setSpeed(2000, 10000, 100);
+	renderer.updateHue(40);
+	snprintf(label, sizeof(label), "%s after the sweep", name);
+	checkColors(renderer, label, 255);
+
+	// same hue, new saturation
+	renderer.setColorSweep(HUE_GREEN, HUE_BLUE, 128);
+	snprintf(label, sizeof(label), "%s after a saturation change", name);
+	checkColors(renderer, label, 128);
+
+	// brightness is the key, so descending reads hit entries filled above
+	for(int b = 255; b >= 0; b -= 17) {
+		CRGB got = renderer.color(b);
+		CRGB want = CHSV(renderer.getHue8(), 128, b);
+		CHECK(got.r == want.r && got.g == want.g && got.b == want.b, "%s: brightness %d read back as (%u, %u, %u)", name,
+			b, got.r, got.g, got.b);
+	}
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	checkInvalidation<true>("cached");
+	checkInvalidation<false>("uncached");
+
+	int cost = (int)(sizeof(Renderer<true>) - sizeof(Renderer<false>));
+	CHECK(cost >= 800 && cost <= 808, "the cache costs %d bytes", cost);
+	CHECK(sizeof(ColorCache<false>) == 1, "the disabled cache takes %d bytes", (int)sizeof(ColorCache<false>));
+
+	return testResult();
+}
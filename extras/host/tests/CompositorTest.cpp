@@ -0,0 +1,153 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks the LayerCompositor blend modes and opacity, that the fused pass
+// matches blending the layers one pass at a time, that the controller's
+// boxes fade without showing the strip, and that a layered AudioVisualizer
+// draws its bars over the ambient boxes.
+
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+VirtualClock virtualClock;
+
+typedef LayerCompositor<4> Compositor;
+
+void testBlendModes() {
+	CHECK(Compositor::blend(90, 200, Normal, 255) == 200, "opaque normal");
+	CHECK(Compositor::blend(90, 200, Normal, 0) == 90, "clear normal");
+	uint8_t half = Compositor::blend(0, 200, Normal, 128);
+	CHECK(half >= 99 && half <= 101, "half of 200 over 0 is %u", half);
+	CHECK(Compositor::blend(200, 100, Add, 255) == 255, "add does not saturate");
+	CHECK(Compositor::blend(20, 100, Add, 128) == 20 + scale8(100, 128), "add at half opacity");
+	CHECK(Compositor::blend(90, 0, Screen, 255) == 90, "screening black changes %u", Compositor::blend(90, 0, Screen, 255));
+	CHECK(Compositor::blend(90, 255, Screen, 255) == 255, "screening white");
+	uint8_t screened = Compositor::blend(128, 128, Screen, 255);
+	CHECK(screened > 128 && screened < 200, "128 screened over 128 is %u", screened);
+	CHECK(Compositor::blend(90, 40, Lighten, 255) == 90 && Compositor::blend(40, 90, Lighten, 255) == 90, "lighten");
+	CHECK(Compositor::blend(90, 255, Multiply, 255) >= 89 && Compositor::blend(90, 0, Multiply, 255) == 0,
+		"multiply by white %u, by black %u", Compositor::blend(90, 255, Multiply, 255),
+		Compositor::blend(90, 0, Multiply, 255));
+}
+
+void testFusedPass() {
+	const int PIXELS = 50;
+	CRGB a[PIXELS], b[PIXELS], c[PIXELS], fused[PIXELS], passes[PIXELS];
+	for(int i = 0; i < PIXELS; i++) {
+		a[i] = CRGB(i * 5, 255 - i * 5, 60);
+		b[i] = CRGB(i * 3, i * 2, 255 - i);
+		c[i] = CRGB(i & 1 ? 255 : 0, 128, i * 4);
+	}
+	Compositor compositor;
+	compositor.addLayer(a);
+	compositor.addLayer(b, Screen, 200);
+	int top = compositor.addLayer(c, Multiply, 90);
+	compositor.addLayer(c, Add, 0);
+	CHECK(compositor.addLayer(c) == -1, "a fifth layer was added to four");
+	compositor.compose(fused, PIXELS);
+
+	const CRGB * layers[3] = {a, b, c};
+	const BlendMode modes[3] = {Normal, Screen, Multiply};
+	const uint8_t opacities[3] = {255, 200, 90};
+	fill_solid(passes, PIXELS, CRGB::Black);
+	for(int l = 0; l < 3; l++) {
+		for(int i = 0; i < PIXELS; i++) {
+			passes[i].r = Compositor::blend(passes[i].r, layers[l][i].r, modes[l], opacities[l]);
+			passes[i].g = Compositor::blend(passes[i].g, layers[l][i].g, modes[l], opacities[l]);
+			passes[i].b = Compositor::blend(passes[i].b, layers[l][i].b, modes[l], opacities[l]);
+		}
+	}
+	CHECK(memcmp(fused, passes, sizeof(fused)) == 0, "the fused pass differs from a pass per layer");
+
+	compositor.setOpacity(top, 0);
+	compositor.setOpacity(1, 0);
+	compositor.compose(fused, PIXELS);
+	CHECK(memcmp(fused, a, sizeof(fused)) == 0, "hidden layers still show");
+}
+
+void testController() {
+	const int PIXELS = 40;
+	CRGB leds[PIXELS];
+	LightingControllerClass<4> controller;
+	uint32_t shows = LEDS.getShowCount();
+	controller.init(leds, PIXELS, 1024);
+	controller.setColor(2, CRGB(200, 0, 100), true);
+	int renders = 0, falls = 0;
+	uint8_t last = 0;
+	while(!controller.isRendered(2) && renders < 100) {
+		controller.render();
+		falls += leds[25].r < last;
+		last = leds[25].r;
+		renders++;
+	}
+	controller.render();
+	CHECK(renders == 32, "the fade took %d renders, expected 32", renders);
+	CHECK(falls == 0, "the fade went back %d times", falls);
+	CHECK(leds[20].r == 200 && leds[29].b == 100 && leds[19].r == 0, "box 2 is %u %u %u", leds[20].r, leds[20].g,
+		leds[20].b);
+	CHECK(LEDS.getShowCount() == shows, "render() showed the strip");
+}
+
+void testLayeredVisualizer() {
+	static CRGB leds[168], audio[168], ambient[168];
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<168, 8> visualizer(fft);
+	fft.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	virtualClock.setMicros(0);
+	visualizer.init(leds, audio, ambient);
+	visualizer.controller.setColor(CRGB(0, 0, 60), false);
+	uint32_t shows = LEDS.getShowCount();
+	fft.synthesize(64);
+	int drawn = 0;
+	for(int t = 0; t < 200; t++) {
+		virtualClock.advanceMicros(1000);
+		drawn += visualizer.update();
+	}
+	CHECK(drawn > 0, "nothing drawn");
+	// the layers may have faded since the last frame drawn, so compare
+	// just after one
+	do
+		virtualClock.advanceMicros(1000);
+	while(!visualizer.update());
+	CHECK(LEDS.getShowCount() == shows, "update() showed the strip");
+	int differences = 0, dark = 0;
+	for(int i = 0; i < 168; i++) {
+		CRGB expected;
+		expected.r = Compositor::blend(ambient[i].r, audio[i].r, Screen, 255);
+		expected.g = Compositor::blend(ambient[i].g, audio[i].g, Screen, 255);
+		expected.b = Compositor::blend(ambient[i].b, audio[i].b, Screen, 255);
+		differences += leds[i].r != expected.r || leds[i].g != expected.g || leds[i].b != expected.b;
+		dark += leds[i].b < 60;
+	}
+	CHECK(differences == 0, "%d pixels are not the bars over the boxes", differences);
+	CHECK(dark == 0, "%d pixels darker than the ambient boxes", dark);
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	testBlendModes();
+	testFusedPass();
+	testController();
+	testLayeredVisualizer();
+
+	return testResult();
+}
@@ -0,0 +1,264 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Compiles FilterBank tables and checks them: a Flat band sums exactly its
+// [start, end) of FFT bins, bands may overlap, and triangles peak at the
+// middle of the band on their own frequency axis, symmetric on the linear
+// one. Bands trimmed of their zero taps move their start and keep their
+// weights at the samples' word alignment, a band the weight pool can't hold
+// stays flat, as every band does with no pool, and ranges past the spectrum
+// or collapsed to nothing are clamped.
+
+#include <vector>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+typedef UniformSpectrum<512, 44100000> Spectrum;
+const int BINS = 6;
+typedef FilterBank<BINS, 1024, ScalarReduceKernel> Bank;
+// room for two bands of 30 weights and not a third
+typedef FilterBank<BINS, 64, ScalarReduceKernel> SmallBank;
+
+DisplayBin displayBin(int start, int end, BinWeighting weighting) {
+	DisplayBin bin;
+	memset(&bin, 0, sizeof(bin));
+	bin.startFFTBin = start;
+	bin.endFFTBin = end;
+	bin.weighting = weighting;
+	return bin;
+}
+
+// A different level in every FFT bin, so a sum off by one bin shows
+std::vector<uint16_t> spectrum() {
+	std::vector<uint16_t> s(Spectrum::SIZE);
+	for(int i = 0; i < Spectrum::SIZE; i++)
+		s[i] = 100 + (i * i * 37) % 9000;
+	return s;
+}
+
+double warp(BinWeighting weighting, double hz) {
+	switch(weighting) {
+	case BinWeighting::Mel:
+		return 2595.0 * log10(1.0 + hz / 700.0);
+	case BinWeighting::Bark:
+		return 26.81 * hz / (1960.0 + hz) - 0.53;
+	default:
+		return hz;
+	}
+}
+
+// Weight of FFT bin, or 0 outside the band
+int weightAt(Bank & bank, int band, int bin) {
+	const Bank::Band & b = bank.getBand(band);
+	const uint16_t * w = bank.getWeights(b);
+	if(bin < b.start || bin >= b.start + b.length)
+		return 0;
+	return w == NULL ? 256 : w[bin - b.start];
+}
+
+void testFlat() {
+	DisplayBin bins[BINS] = {
+		displayBin(0, 1, BinWeighting::Flat),
+		displayBin(3, 10, BinWeighting::Flat),
+		// overlapping the band before it, and wholly inside the one after
+		displayBin(7, 40, BinWeighting::Flat),
+		displayBin(20, 30, BinWeighting::Flat),
+		displayBin(101, 102, BinWeighting::Flat),
+		displayBin(200, 512, BinWeighting::Flat),
+	};
+	Bank bank;
+	bank.configure<Spectrum>(bins);
+	std::vector<uint16_t> s = spectrum();
+	uint32_t sums[BINS];
+	uint32_t total = bank.apply(&s[0], sums);
+	uint32_t expectedTotal = 0;
+	int taps = 0;
+	for(int i = 0; i < BINS; i++) {
+		const Bank::Band & band = bank.getBand(i);
+		CHECK(band.start == bins[i].startFFTBin && band.start + band.length == bins[i].endFFTBin &&
+			bank.getWeights(band) == NULL, "band %d reads %d-%d, expected %d-%d flat", i, band.start,
+			band.start + band.length, bins[i].startFFTBin, bins[i].endFFTBin);
+		uint32_t expected = 0;
+		for(int k = bins[i].startFFTBin; k < bins[i].endFFTBin; k++)
+			expected += s[k];
+		CHECK(sums[i] == expected, "band %d summed %u, expected %u", i, sums[i], expected);
+		expectedTotal += expected;
+		taps += bins[i].endFFTBin - bins[i].startFFTBin;
+	}
+	CHECK(total == expectedTotal, "total %u, expected %u", total, expectedTotal);
+	CHECK(bank.tapCount() == taps, "%d taps, expected %d", bank.tapCount(), taps);
+}
+
+// Ranges off either end of the spectrum are clamped, and a collapsed one
+// still reads its one FFT bin
+void testClamped() {
+	DisplayBin bins[BINS] = {
+		displayBin(-5, 4, BinWeighting::Flat),
+		displayBin(500, 600, BinWeighting::Flat),
+		displayBin(50, 50, BinWeighting::Flat),
+		displayBin(80, 60, BinWeighting::Triangle),
+		displayBin(700, 800, BinWeighting::Flat),
+		displayBin(10, 11, BinWeighting::Mel),
+	};
+	Bank bank;
+	bank.configure<Spectrum>(bins);
+	const int expected[BINS][2] = {{0, 4}, {500, 512}, {50, 51}, {80, 81}, {511, 512}, {10, 11}};
+	for(int i = 0; i < BINS; i++) {
+		const Bank::Band & band = bank.getBand(i);
+		CHECK(band.start == expected[i][0] && band.start + band.length == expected[i][1], "band %d reads %d-%d, expected %d-%d",
+			i, band.start, band.start + band.length, expected[i][0], expected[i][1]);
+	}
+}
+
+// A band that does not fit the weight pool stays a flat sum
+void testPoolFull() {
+	DisplayBin bins[BINS] = {
+		displayBin(10, 40, BinWeighting::Triangle),
+		displayBin(40, 70, BinWeighting::Mel),
+		displayBin(70, 100, BinWeighting::Bark),
+		displayBin(100, 110, BinWeighting::Flat),
+		displayBin(110, 112, BinWeighting::Triangle),
+		displayBin(120, 130, BinWeighting::Triangle),
+	};
+	SmallBank bank;
+	bank.configure<Spectrum>(bins);
+	const bool weighted[BINS] = {true, true, false, false, true, false};
+	for(int i = 0; i < BINS; i++) {
+		CHECK((bank.getWeights(bank.getBand(i)) != NULL) == weighted[i], "band %d weighted %d, expected %d", i,
+			bank.getWeights(bank.getBand(i)) != NULL, weighted[i]);
+	}
+	const SmallBank::Band & band = bank.getBand(2);
+	CHECK(band.start == 70 && band.length == 30, "the band left flat reads %d-%d", band.start, band.start + band.length);
+}
+
+// With no pool at all every band is flat, and the bank holds little more
+// than its bands
+void testNoWeights() {
+	DisplayBin bins[BINS] = {
+		displayBin(10, 40, BinWeighting::Triangle),
+		displayBin(40, 70, BinWeighting::Mel),
+		displayBin(70, 100, BinWeighting::Bark),
+		displayBin(100, 110, BinWeighting::Flat),
+		displayBin(110, 112, BinWeighting::Triangle),
+		displayBin(120, 130, BinWeighting::Triangle),
+	};
+	FilterBank<BINS, 0, ScalarReduceKernel> bank;
+	bank.configure<Spectrum>(bins);
+	std::vector<uint16_t> s = spectrum();
+	uint32_t sums[BINS];
+	bank.apply(&s[0], sums);
+	for(int i = 0; i < BINS; i++) {
+		uint32_t expected = 0;
+		for(int k = bins[i].startFFTBin; k < bins[i].endFFTBin; k++)
+			expected += s[k];
+		CHECK(bank.getWeights(bank.getBand(i)) == NULL && sums[i] == expected, "band %d summed %u, expected %u flat", i,
+			sums[i], expected);
+	}
+	CHECK(sizeof(bank) <= sizeof(Bank::Band) * BINS + 8, "%d bytes with no weights", (int)sizeof(bank));
+}
+
+// Triangles on each axis over the same ranges, odd and even, at both parities
+void testTriangles(BinWeighting weighting, const char * name) {
+	DisplayBin bins[BINS] = {
+		displayBin(4, 25, weighting),
+		displayBin(11, 40, weighting),
+		displayBin(30, 90, weighting),
+		displayBin(57, 160, weighting),
+		displayBin(100, 300, weighting),
+		displayBin(255, 510, weighting),
+	};
+	Bank bank;
+	bank.configure<Spectrum>(bins);
+	std::vector<uint16_t> s = spectrum();
+	uint32_t sums[BINS];
+	bank.apply(&s[0], sums);
+	for(int i = 0; i < BINS; i++) {
+		const Bank::Band & band = bank.getBand(i);
+		const uint16_t * w = bank.getWeights(band);
+		CHECK(w != NULL, "%s band %d is flat", name, i);
+		if(w == NULL)
+			continue;
+		// trimmed to its nonzero taps, inside the range asked for, the
+		// weights at the samples' word alignment
+		CHECK(band.start >= bins[i].startFFTBin && band.start + band.length <= bins[i].endFFTBin,
+			"%s band %d reads %d-%d, outside %d-%d", name, i, band.start, band.start + band.length,
+			bins[i].startFFTBin, bins[i].endFFTBin);
+		CHECK(w[0] > 0 && w[band.length - 1] > 0, "%s band %d has a zero tap at an edge", name, i);
+		CHECK((((uintptr_t)w ^ (uintptr_t)&s[band.start]) & 2) == 0, "%s band %d weights are misaligned", name, i);
+
+		// the sum reads the weights it shows, from the trimmed start
+		uint64_t expected = 0;
+		for(int k = 0; k < band.length; k++)
+			expected += (uint32_t)s[band.start + k] * w[k];
+		CHECK(sums[i] == (uint32_t)(expected >> 8), "%s band %d summed %u, expected %u", name, i, sums[i],
+			(uint32_t)(expected >> 8));
+
+		// the peak is the FFT bin nearest the middle on the warped axis,
+		// with the weights rising to it and falling after
+		double low = warp(weighting, Spectrum::binToHz(bins[i].startFFTBin));
+		double high = warp(weighting, Spectrum::binToHz(bins[i].endFFTBin));
+		int middle = bins[i].startFFTBin;
+		for(int k = bins[i].startFFTBin; k < bins[i].endFFTBin; k++) {
+			if(fabs(warp(weighting, Spectrum::binToHz(k + 0.5)) - (low + high) / 2) <
+				fabs(warp(weighting, Spectrum::binToHz(middle + 0.5)) - (low + high) / 2))
+				middle = k;
+		}
+		int peak = band.start;
+		for(int k = band.start; k < band.start + band.length; k++) {
+			if(weightAt(bank, i, k) > weightAt(bank, i, peak))
+				peak = k;
+		}
+		CHECK(abs(peak - middle) <= 1 && weightAt(bank, i, peak) >= 240, "%s band %d peaks at %d (%d), expected %d",
+			name, i, peak, weightAt(bank, i, peak), middle);
+		bool shaped = true;
+		for(int k = band.start + 1; k < band.start + band.length; k++)
+			shaped &= k <= peak ? w[k - band.start] >= w[k - 1 - band.start] : w[k - band.start] <= w[k - 1 - band.start];
+		CHECK(shaped, "%s band %d does not rise to its peak and fall", name, i);
+
+		if(weighting == BinWeighting::Triangle) {
+			// mirrored about the middle of the range asked for
+			bool symmetric = true;
+			for(int k = bins[i].startFFTBin; k < bins[i].endFFTBin; k++) {
+				int mirror = bins[i].startFFTBin + bins[i].endFFTBin - 1 - k;
+				symmetric &= abs(weightAt(bank, i, k) - weightAt(bank, i, mirror)) <= 1;
+			}
+			CHECK(symmetric, "%s band %d is not symmetric", name, i);
+		}
+		else if(bins[i].endFFTBin - bins[i].startFFTBin > 50) {
+			// both axes bunch up toward the treble, so a wide band peaks below its linear middle
+			CHECK(peak < (bins[i].startFFTBin + bins[i].endFFTBin) / 2 - 2, "%s band %d peaks at %d, not below the middle",
+				name, i, peak);
+		}
+	}
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	testFlat();
+	testClamped();
+	testPoolFull();
+	testNoWeights();
+	testTriangles(BinWeighting::Triangle, "triangle");
+	testTriangles(BinWeighting::Mel, "mel");
+	testTriangles(BinWeighting::Bark, "bark");
+
+	return testResult();
+}
@@ -0,0 +1,260 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks FixedFFT and FFTAnalyzer against a double precision DFT of the
+// same windowed samples, at every size and window, on tones, noise and an
+// impulse, checks the Goertzel path the same way, and checks that frames
+// come out once per hop. Checks that MultirateAnalyzer reads tones the same
+// on either side of its splice, keeps aliases out of the bass, and is
+// smaller than two single rate analyzers.
+
+#include <vector>
+#include "AudioVisualizer.h"
+#include "FixedFFT.h"
+#include "MultirateAnalyzer.h"
+#include "HostTest.h"
+
+namespace {
+
+// |DFT| / SIZE of the Q15 windowed samples, in the analyzer's output units
+std::vector<double> referenceSpectrum(const std::vector<int16_t> & samples, const int16_t * window, int size) {
+	std::vector<double> windowed(size);
+	for(int n = 0; n < size; n++)
+		windowed[n] = window ? (samples[n] * window[n]) / 32768.0 : samples[n];
+	std::vector<double> out(size / 2);
+	for(int k = 0; k < size / 2; k++) {
+		double re = 0, im = 0;
+		for(int n = 0; n < size; n++) {
+			double a = 2.0 * M_PI * k * n / size;
+			re += windowed[n] * cos(a);
+			im -= windowed[n] * sin(a);
+		}
+		out[k] = sqrt(re * re + im * im) / size;
+	}
+	return out;
+}
+
+std::vector<int16_t> tones(int size, double binA, double ampA, double binB, double ampB) {
+	std::vector<int16_t> s(size);
+	for(int n = 0; n < size; n++)
+		s[n] = (int16_t)lround(ampA * sin(2.0 * M_PI * binA * n / size) + ampB * sin(2.0 * M_PI * binB * n / size + 1.0));
+	return s;
+}
+
+std::vector<int16_t> noise(int size, int amplitude, uint32_t seed) {
+	std::vector<int16_t> s(size);
+	for(int n = 0; n < size; n++) {
+		seed = seed * 1664525u + 1013904223u;
+		s[n] = (int16_t)((int)(seed >> 16) % (2 * amplitude + 1) - amplitude);
+	}
+	return s;
+}
+
+// Runs samples through a fresh analyzer; one write of SIZE samples with
+// OVERLAP 1 is exactly one frame over exactly those samples.
+template<int SIZE, int WINDOW>
+void checkSignal(const char * name, const std::vector<int16_t> & samples) {
+	static FFTAnalyzer<SIZE, WINDOW, 1> analyzer;
+	analyzer.write(&samples[0], SIZE);
+	CHECK(analyzer.available(), "%s: no frame after %d samples", name, SIZE);
+	const int16_t * window = WINDOW == FFTWindow::Rectangular ? NULL : FFTWindowTables<SIZE, WINDOW>::window.weights;
+	std::vector<double> reference = referenceSpectrum(samples, window, SIZE);
+	double peak = 0, worst = 0;
+	int worstBin = 0;
+	for(int k = 0; k < SIZE / 2; k++) {
+		peak = max(peak, reference[k]);
+		double error = fabs(analyzer.output[k] - reference[k]);
+		if(error > worst) {
+			worst = error;
+			worstBin = k;
+		}
+	}
+	// rounding at each of the log4(SIZE) passes, plus truncation of the output
+	double allowed = 4.0 + peak * 0.002;
+	printf("%4d %-8s %-22s peak %8.1f  worst error %6.2f at bin %3d\n", SIZE,
+		WINDOW == FFTWindow::Hann ? "hann" : WINDOW == FFTWindow::Hamming ? "hamming" :
+		WINDOW == FFTWindow::BlackmanHarris ? "blackman" : "rect", name, peak, worst, worstBin);
+	CHECK(worst <= allowed, "%d point %s: error %.2f at bin %d, allowed %.2f", SIZE, name, worst, worstBin, allowed);
+}
+
+template<int SIZE, int WINDOW>
+void checkWindow() {
+	checkSignal<SIZE, WINDOW>("full scale on-bin tone", tones(SIZE, SIZE / 16, 32000, 0, 0));
+	checkSignal<SIZE, WINDOW>("two off-bin tones", tones(SIZE, 10.37, 12000, SIZE / 5 + 0.5, 3000));
+	checkSignal<SIZE, WINDOW>("quiet tone", tones(SIZE, 3, 400, 0, 0));
+	checkSignal<SIZE, WINDOW>("noise", noise(SIZE, 16000, SIZE));
+	std::vector<int16_t> impulse(SIZE, 0);
+	impulse[SIZE / 2] = 32767;
+	checkSignal<SIZE, WINDOW>("impulse", impulse);
+}
+
+template<int SIZE>
+void checkSize() {
+	checkWindow<SIZE, FFTWindow::Rectangular>();
+	checkWindow<SIZE, FFTWindow::Hann>();
+	checkWindow<SIZE, FFTWindow::Hamming>();
+	checkWindow<SIZE, FFTWindow::BlackmanHarris>();
+}
+
+// With few bins selected the Goertzel path computes those bins, to the same
+// tolerance, and leaves the rest 0; with many it stays on the FFT.
+template<int SIZE>
+void checkSparse() {
+	static FFTAnalyzer<SIZE, FFTWindow::Hann, 1> analyzer;
+	DisplayBin bins[2];
+	bins[0].startFFTBin = 1;
+	bins[0].endFFTBin = 4;
+	bins[1].startFFTBin = 3;
+	bins[1].endFFTBin = 7;
+	CHECK(analyzer.selectBins(bins, 2), "%d point: 6 bins did not go sparse", SIZE);
+	std::vector<int16_t> samples = tones(SIZE, 2.3, 9000, 5, 4000);
+	for(int n = 0; n < SIZE; n++)
+		samples[n] += (int16_t)(n * 37 % 2001 - 1000);
+	analyzer.write(&samples[0], SIZE);
+	CHECK(analyzer.available(), "%d point sparse: no frame", SIZE);
+	std::vector<double> reference = referenceSpectrum(samples, FFTWindowTables<SIZE, FFTWindow::Hann>::window.weights, SIZE);
+	double worst = 0;
+	for(int k = 0; k < SIZE / 2; k++) {
+		bool selected = k >= 1 && k < 7;
+		if(selected)
+			worst = max(worst, fabs(analyzer.output[k] - reference[k]));
+		else
+			CHECK(analyzer.output[k] == 0, "%d point sparse: unselected bin %d is %u", SIZE, k, analyzer.output[k]);
+	}
+	printf("%4d goertzel bins 1-6, worst error %.2f\n", SIZE, worst);
+	CHECK(worst <= 2.0, "%d point sparse: error %.2f", SIZE, worst);
+
+	bins[1].endFFTBin = 64;
+	CHECK(!analyzer.selectBins(bins, 2) && !analyzer.isSparse(), "%d point: 63 bins went sparse", SIZE);
+}
+
+// Bin 0 and the bins next to it, on a signal with a DC offset, agree
+// between the Goertzel path and the full FFT. Most layouts start at bin 0.
+template<int SIZE>
+void checkSparseDC() {
+	static FFTAnalyzer<SIZE, FFTWindow::Hann, 1> full;
+	static FFTAnalyzer<SIZE, FFTWindow::Hann, 1> sparse;
+	DisplayBin bins[2];
+	bins[0].startFFTBin = 0;
+	bins[0].endFFTBin = 2;
+	bins[1].startFFTBin = 2;
+	bins[1].endFFTBin = 4;
+	CHECK(sparse.selectBins(bins, 2), "%d point: bins 0-3 did not go sparse", SIZE);
+	std::vector<int16_t> samples = tones(SIZE, 1.4, 6000, 3, 3000);
+	for(int n = 0; n < SIZE; n++)
+		samples[n] += 2000;
+	full.write(&samples[0], SIZE);
+	sparse.write(&samples[0], SIZE);
+	CHECK(full.available() && sparse.available(), "%d point DC: no frame", SIZE);
+	CHECK(full.output[0] > 200, "%d point DC: the FFT's bin 0 is only %u", SIZE, full.output[0]);
+	for(int k = 0; k < 4; k++)
+		CHECK(abs((int)sparse.output[k] - (int)full.output[k]) <= 3, "%d point DC: bin %d is %u sparse, %u full",
+			SIZE, k, sparse.output[k], full.output[k]);
+}
+
+// A frame every SIZE/OVERLAP samples, whatever the block size.
+template<int SIZE, int OVERLAP>
+void checkHop() {
+	static FFTAnalyzer<SIZE, FFTWindow::Hann, OVERLAP> analyzer;
+	audio_block_t block;
+	for(int i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+		block.data[i] = i * 97;
+	int frames = 0;
+	const int blocks = 64;
+	for(int b = 0; b < blocks; b++) {
+		analyzer.deliver(&block);
+		frames += analyzer.available();
+	}
+	int expected = blocks * AUDIO_BLOCK_SAMPLES / (SIZE / OVERLAP);
+	// with hops shorter than a block several frames land in one update; only the last is kept
+	if(SIZE / OVERLAP < AUDIO_BLOCK_SAMPLES)
+		expected = blocks;
+	CHECK(frames == expected, "%d point, overlap %d: %d frames from %d blocks, expected %d",
+		SIZE, OVERLAP, frames, blocks, expected);
+}
+
+// A tone of amplitude 8000 at hz through a fresh analyzer, settled past
+// the decimated window and the filter delay. Returns the output.
+template<int SIZE, int DECIMATION>
+std::vector<uint16_t> multirateTone(double hz) {
+	typedef MultirateAnalyzer<SIZE, DECIMATION> Analyzer;
+	static Analyzer * analyzer = NULL;
+	delete analyzer;
+	analyzer = new Analyzer();
+	const int count = 2 * SIZE * DECIMATION;
+	std::vector<int16_t> samples(count);
+	for(int n = 0; n < count; n++)
+		samples[n] = (int16_t)lround(8000.0 * sin(2.0 * M_PI * hz * n / AUDIO_SAMPLE_RATE));
+	analyzer->write(&samples[0], count);
+	CHECK(analyzer->available(), "multirate %.0fHz: no frame", hz);
+	return std::vector<uint16_t>(analyzer->output, analyzer->output + Analyzer::OUTPUT_SIZE);
+}
+
+template<int SIZE, int DECIMATION>
+void checkMultirate() {
+	typedef typename MultirateAnalyzer<SIZE, DECIMATION>::Spectrum Spectrum;
+	// an on-bin tone under Hann reads a quarter of its amplitude
+	const double expected = 8000.0 / 4;
+	// on bin tones in the bass, the middle of the decimated band, and the treble
+	const double tones[] = {3 * Spectrum::LOW_BIN_HZ, (Spectrum::LOW_BINS / 2) * Spectrum::LOW_BIN_HZ,
+		(SIZE / 4) * Spectrum::HIGH_BIN_HZ};
+	for(int t = 0; t < 3; t++) {
+		std::vector<uint16_t> out = multirateTone<SIZE, DECIMATION>(tones[t]);
+		int bin = (int)lround(Spectrum::hzToBin(tones[t]));
+		int peak = 0;
+		for(int k = 0; k < Spectrum::SIZE; k++)
+			if(out[k] > out[peak])
+				peak = k;
+		printf("%4d/%d multirate %6.0fHz: peak %4u at bin %3d\n", SIZE, DECIMATION, tones[t], out[peak], peak);
+		CHECK(peak == bin, "%.0fHz peaked at bin %d, expected %d", tones[t], peak, bin);
+		CHECK(fabs(out[peak] - expected) <= expected * 0.05, "%.0fHz read %u, expected %.0f", tones[t], out[peak], expected);
+	}
+	// a tone past the decimated Nyquist would alias into the top of the bass
+	// spectrum; the filter keeps it under 1% there
+	double alias = 1.3 * Spectrum::LOW_BINS * Spectrum::LOW_BIN_HZ / 0.75;
+	std::vector<uint16_t> out = multirateTone<SIZE, DECIMATION>(alias);
+	int worst = 0;
+	for(int k = 0; k < Spectrum::LOW_BINS; k++)
+		worst = max(worst, (int)out[k]);
+	printf("%4d/%d multirate %6.0fHz: worst alias %d\n", SIZE, DECIMATION, alias, worst);
+	CHECK(worst <= expected / 100, "%.0fHz aliased into the bass at %d", alias, worst);
+	// both paths share one transform buffer, so the pair costs less than
+	// two single rate analyzers
+	CHECK(sizeof(MultirateAnalyzer<SIZE, DECIMATION>) < 2 * sizeof(FFTAnalyzer<SIZE>), "%d/%d multirate is %d bytes",
+		SIZE, DECIMATION, (int)sizeof(MultirateAnalyzer<SIZE, DECIMATION>));
+}
+
+}
+
+int main() {
+	checkSize<256>();
+	checkSize<512>();
+	checkSize<1024>();
+	checkSparse<256>();
+	checkSparse<512>();
+	checkSparse<1024>();
+	checkSparseDC<256>();
+	checkSparseDC<1024>();
+	checkHop<256, 1>();
+	checkHop<256, 2>();
+	checkHop<512, 4>();
+	checkHop<1024, 2>();
+	checkHop<1024, 4>();
+	checkMultirate<256, 8>();
+	checkMultirate<512, 4>();
+
+	return testResult();
+}
@@ -0,0 +1,192 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks FrameQueue's ordering and counters, then races a producer thread
+// against a consumer thread: every frame must arrive whole, in order, and
+// be accounted for as consumed, dropped or overrun. Last, runs
+// AudioProcessor's analysis on one thread and its rendering on another.
+
+#include <atomic>
+#include <thread>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+const int BINS = 8;
+typedef FFTBinData<BINS> Frame;
+VirtualClock virtualClock;
+
+// Every byte of the frame follows from its sequence number, so a frame
+// copied while it was being written shows up as a mismatch.
+Frame makeFrame(uint32_t sequence) {
+	Frame f;
+	f.peak = sequence;
+	for(int i = 0; i < BINS; i++)
+		f.binValues[i] = sequence * 7 + i;
+	f.onset = sequence & 1;
+	f.onsetStrength = sequence >> 8;
+	f.beat = sequence & 2;
+	f.beatPhase = sequence >> 16;
+	f.tempo = sequence >> 24;
+	return f;
+}
+
+bool matches(const Frame & f, uint32_t sequence) {
+	Frame expected = makeFrame(sequence);
+	return !memcmp(&f, &expected, sizeof(Frame));
+}
+
+void testOrdering() {
+	FrameQueue<Frame, 4> queue;
+	Frame f;
+	uint32_t sequence;
+	CHECK(!queue.pop(f) && !queue.popLatest(f), "empty queue gave a frame");
+	for(uint32_t i = 0; i < 4; i++)
+		CHECK(queue.push(makeFrame(i)), "push %u into a queue of 4 failed", i);
+	CHECK(!queue.push(makeFrame(4)), "fifth push fit in a queue of 4");
+	CHECK(queue.getOverruns() == 1 && queue.getPushes() == 5, "%u overruns in %u pushes, expected 1 in 5",
+		queue.getOverruns(), queue.getPushes());
+	CHECK(queue.pop(f, &sequence) && sequence == 0 && matches(f, 0), "pop gave frame %u, expected 0", sequence);
+	CHECK(queue.push(makeFrame(5)), "push after a pop failed");
+	CHECK(queue.popLatest(f, &sequence) && sequence == 5 && matches(f, 5), "popLatest gave frame %u, expected 5", sequence);
+	CHECK(queue.getDrops() == 3 && queue.size() == 0, "%u drops and %d left, expected 3 and 0", queue.getDrops(), queue.size());
+}
+
+// Pushes in bursts while the consumer alternates pop() and popLatest() and
+// sometimes stalls, so both counters get exercised. The yields interleave
+// the threads finely even on one core.
+void testStress() {
+	static FrameQueue<Frame, 4> queue;
+	const uint32_t PUSHES = 2000000;
+	std::atomic<bool> done(false);
+	uint32_t pushed = 0;
+
+	std::thread producer([&]() {
+		uint32_t seed = 2;
+		for(uint32_t i = 0; i < PUSHES; i++) {
+			pushed += queue.push(makeFrame(i));
+			seed = seed * 1664525u + 1013904223u;
+			if((seed >> 28) == 0)
+				std::this_thread::yield();
+		}
+		done = true;
+	});
+
+	uint32_t consumed = 0, torn = 0, disorder = 0, last = 0;
+	bool first = true;
+	uint32_t seed = 1;
+	Frame f;
+	uint32_t sequence;
+	for(;;) {
+		bool finished = done;
+		seed = seed * 1664525u + 1013904223u;
+		bool got = seed >> 31 ? queue.popLatest(f, &sequence) : queue.pop(f, &sequence);
+		if(got) {
+			consumed++;
+			torn += !matches(f, sequence);
+			disorder += !first && sequence <= last;
+			last = sequence;
+			first = false;
+			// a render that overruns the frame period
+			if((seed >> 20 & 63) == 0)
+				for(volatile int spin = 0; spin < 2000; spin++);
+		}
+		else if(finished)
+			break;
+		if((seed >> 24 & 7) == 0)
+			std::this_thread::yield();
+	}
+	producer.join();
+
+	uint32_t overruns = queue.getOverruns(), drops = queue.getDrops();
+	printf("stress: %u pushes, %u consumed, %u dropped, %u overruns\n", PUSHES, consumed, drops, overruns);
+	CHECK(torn == 0, "%u frames were torn", torn);
+	CHECK(disorder == 0, "%u frames arrived out of order", disorder);
+	CHECK(queue.getPushes() == PUSHES && pushed + overruns == PUSHES, "%u pushed and %u overruns of %u",
+		pushed, overruns, PUSHES);
+	CHECK(consumed + drops == pushed, "%u consumed and %u dropped of %u pushed", consumed, drops, pushed);
+}
+
+class CountingRenderer : public AudioRenderer<BINS> {
+public:
+	uint32_t frames;
+	uint32_t empty;
+	CountingRenderer() : frames(0), empty(0) {
+	}
+	void update(FFTBinData<BINS> * data) {
+		if(data)
+			frames++;
+		else
+			empty++;
+	}
+};
+
+// analyzeData() on its own thread, as from the audio interrupt, and
+// renderQueued() on this one, as from loop().
+void testProcessor() {
+	static AudioAnalyzeFFT1024 fft;
+	static AudioProcessor<BINS> processor(fft);
+	CountingRenderer renderer;
+	fft.synthesize(256);
+	fft.setFrameInterval(0);
+	virtualClock.setMicros(0);
+	processor.init(BinLayout<168, BINS, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::octave.bins);
+	processor.connectAudioRenderer(&renderer);
+	processor.setQueued(true);
+
+	const int FRAMES = 20000;
+	std::atomic<bool> done(false);
+	std::thread analysis([&]() {
+		for(int i = 0; i < FRAMES; i++) {
+			virtualClock.advanceMicros(AudioAnalyzeFFT1024::FRAME_MICROS);
+			processor.analyzeData();
+			// the next block is a while coming
+			if(i % 3 == 0)
+				std::this_thread::yield();
+		}
+		done = true;
+	});
+	for(;;) {
+		bool finished = done;
+		if(!processor.renderQueued()) {
+			if(finished)
+				break;
+			std::this_thread::yield();
+		}
+	}
+	analysis.join();
+
+	AudioProcessor<BINS>::Queue & queue = processor.getFrameQueue();
+	printf("processor: %d frames analyzed, %u rendered, %u dropped, %u overruns\n", FRAMES,
+		renderer.frames, queue.getDrops(), queue.getOverruns());
+	CHECK(queue.getPushes() == FRAMES, "%u frames queued of %d", queue.getPushes(), FRAMES);
+	CHECK(renderer.frames + queue.getDrops() + queue.getOverruns() == FRAMES, "%u rendered, %u dropped, %u overruns of %d",
+		renderer.frames, queue.getDrops(), queue.getOverruns(), FRAMES);
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	testOrdering();
+	testStress();
+	testProcessor();
+
+	return testResult();
+}
@@ -0,0 +1,100 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Draws frames into an LEDFrameBuffer while a thread-backed sink sends the
+// last one: no frame may change while it is sent, and the drawing time
+// should come off the wire time. Drawing straight into the frame being sent
+// must tear, or the sink would not catch it. Runs on the wall clock.
+
+#include <chrono>
+#include "AudioVisualizer.h"
+#include "LEDFrameBuffer.h"
+#include "HostLEDSink.h"
+#include "HostTest.h"
+
+namespace {
+
+const int LEDS = 168;
+const int FRAMES = 60;
+// about 60% of the 5ms a 168 LED frame is on the wire
+const uint32_t DRAW_MICROS = 3000;
+
+// Fills the strip over DRAW_MICROS, the way a slow renderer would
+void draw(CRGB * leds, int frame) {
+	uint32_t start = micros();
+	int pass = 0;
+	do {
+		for(int i = 0; i < LEDS; i++)
+			leds[i] = CRGB(frame + i, frame * 3 + pass, i);
+		pass++;
+	} while(micros() - start < DRAW_MICROS);
+}
+
+template<class SINK>
+uint32_t hiddenPercent(SINK & sink) {
+	LEDFrameBuffer<LEDS, SINK> buffer(sink);
+	for(int f = 0; f < FRAMES; f++) {
+		draw(buffer.back(), f);
+		buffer.show();
+	}
+	buffer.flush();
+	CHECK(buffer.getFrames() == FRAMES, "%u frames shown of %d", buffer.getFrames(), FRAMES);
+	uint32_t percent = (uint64_t)buffer.getHiddenMicros() * 100 / buffer.getTransferMicros();
+	printf("%u us on the wire, %u us blocked, %u%% hidden\n", buffer.getTransferMicros(), buffer.getBlockedMicros(),
+		percent);
+	return percent;
+}
+
+void testDoubleBuffered() {
+	ThreadLEDSink sink;
+	uint32_t hidden = hiddenPercent(sink);
+	CHECK(sink.getTorn() == 0, "%u of %u frames changed while sent", sink.getTorn(), sink.getFrames());
+	CHECK(sink.getFrames() == FRAMES, "the sink sent %u frames of %d", sink.getFrames(), FRAMES);
+	// 60% at best; a busy machine wakes the sink late
+	CHECK(hidden >= 25, "only %u%% of the wire time was hidden", hidden);
+}
+
+void testBlocking() {
+	BlockingLEDSink sink;
+	uint32_t hidden = hiddenPercent(sink);
+	CHECK(hidden <= 10, "%u%% hidden behind a blocking show", hidden);
+}
+
+void testSingleBuffered() {
+	ThreadLEDSink sink;
+	static CRGB leds[LEDS];
+	for(int f = 0; f < 10; f++) {
+		while(sink.busy())
+			yield();
+		sink.begin(leds, LEDS);
+		draw(leds, f);
+	}
+	while(sink.busy())
+		yield();
+	CHECK(sink.getTorn() > 0, "drawing into the frame being sent never tore it");
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	testDoubleBuffered();
+	testBlocking();
+	testSingleBuffered();
+
+	return testResult();
+}
@@ -0,0 +1,133 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks that FilterBank::applyChannels() gives exactly what apply() gives
+// channel by channel, for each kernel, and that a stereo AudioProcessor
+// routes its left, right, mid and side outputs to the right renderers.
+
+#include <vector>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+const int BINS = 8;
+VirtualClock virtualClock;
+
+template<int FREQ_BINS, int CHANNELS, class KERNEL>
+void checkChannels(const char * name, const DisplayBin * bins) {
+	static uint16_t spectra[CHANNELS][FFT_OUTPUT_SIZE] __attribute__((aligned(4)));
+	uint32_t seed = 3;
+	for(int c = 0; c < CHANNELS; c++)
+		for(int i = 0; i < FFT_OUTPUT_SIZE; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			spectra[c][i] = (seed >> 16) % 46341;
+		}
+	const uint16_t * channels[CHANNELS];
+	for(int c = 0; c < CHANNELS; c++)
+		channels[c] = spectra[c];
+
+	FilterBank<FREQ_BINS, 512, KERNEL> filterBank;
+	filterBank.template configure<FFTSpectrum<AudioAnalyzeFFT1024>::type>(bins);
+	uint32_t sums[FREQ_BINS * CHANNELS];
+	uint32_t total = filterBank.template applyChannels<CHANNELS>(channels, sums);
+
+	uint32_t expectedTotal = 0;
+	int mismatches = 0;
+	for(int c = 0; c < CHANNELS; c++) {
+		uint32_t expected[FREQ_BINS];
+		expectedTotal += filterBank.apply(spectra[c], expected);
+		for(int i = 0; i < FREQ_BINS; i++)
+			mismatches += sums[CHANNELS * i + c] != expected[i];
+	}
+	CHECK(mismatches == 0, "%s, %d channels: %d sums differ from apply()", name, CHANNELS, mismatches);
+	CHECK(total == expectedTotal, "%s, %d channels: total %u, expected %u", name, CHANNELS, total, expectedTotal);
+}
+
+template<class KERNEL>
+void checkKernel(const char * name) {
+	checkChannels<8, 2, KERNEL>(name, BinLayout<168, 8, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::octave.bins);
+	checkChannels<16, 2, KERNEL>(name, BinLayout<168, 16, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::mel.bins);
+	checkChannels<16, 3, KERNEL>(name, BinLayout<168, 16, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::mel.bins);
+}
+
+// Keeps the latest frame.
+class LastFrame : public AudioRenderer<BINS> {
+public:
+	FFTBinData<BINS> data;
+	int frames;
+	LastFrame() : frames(0) {
+		memset(&data, 0, sizeof(data));
+	}
+	void update(FFTBinData<BINS> * data) {
+		if(data) {
+			this->data = *data;
+			frames++;
+		}
+	}
+};
+
+// A signal on the left only: the right reads nothing, and mid and side
+// are both half the left, so they scale the same.
+void testStereo() {
+	typedef AudioProcessor<BINS, 16, 0x01, DefaultReduceKernel, AudioAnalyzeFFT1024, 2> Stereo;
+	static AudioAnalyzeFFT1024 left, right;
+	static AudioAnalyzeFFT1024 * const ffts[2] = {&left, &right};
+	static Stereo processor(ffts);
+	LastFrame outputs[Stereo::OUTPUTS];
+
+	left.synthesize(64);
+	std::vector<uint16_t> silence(AudioAnalyzeFFT1024::OUTPUT_SIZE, 0);
+	right.feed(&silence[0], 1);
+	left.setFrameInterval(0);
+	right.setFrameInterval(0);
+	virtualClock.setMicros(0);
+	processor.init(BinLayout<168, BINS, FFT_OUTPUT_SIZE, AUDIO_SAMPLE_RATE_MHZ>::octave.bins);
+	for(int o = 0; o < Stereo::OUTPUTS; o++)
+		CHECK(processor.connectAudioRenderer(&outputs[o], o), "output %d would not connect", o);
+
+	for(int n = 0; n < 200; n++) {
+		virtualClock.advanceMicros(AudioAnalyzeFFT1024::FRAME_MICROS);
+		processor.analyzeData();
+	}
+
+	for(int o = 0; o < Stereo::OUTPUTS; o++)
+		CHECK(outputs[o].frames == 200, "output %d rendered %d frames of 200", o, outputs[o].frames);
+	int leftLevel = 0, rightLevel = 0, sideDiffers = 0;
+	for(int i = 0; i < BINS; i++) {
+		leftLevel += outputs[0].data.binValues[i];
+		rightLevel += outputs[1].data.binValues[i];
+		sideDiffers += outputs[Stereo::MID].data.binValues[i] != outputs[Stereo::SIDE].data.binValues[i];
+	}
+	CHECK(leftLevel > 0, "the left output is dark");
+	CHECK(rightLevel == 0, "the silent right output reads %d", rightLevel);
+	CHECK(sideDiffers == 0, "%d side bins differ from mid", sideDiffers);
+	CHECK(outputs[0].data.beat == outputs[Stereo::SIDE].data.beat &&
+		outputs[0].data.tempo == outputs[Stereo::SIDE].data.tempo, "outputs disagree on the beat");
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	checkKernel<ScalarReduceKernel>("scalar");
+	checkKernel<VectorReduceKernel>("vector");
+	testStereo();
+
+	return testResult();
+}
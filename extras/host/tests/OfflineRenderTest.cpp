@@ -0,0 +1,185 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks the parameter sets of the offline renderer, that WAV files of
+// other rates and widths come in at the Audio library's rate, that a tone
+// lights the display bin it falls in, and that renders on several threads
+// each keep their own clock and match a render on its own.
+
+#include <thread>
+#include "OfflineRenderer.h"
+#include "HostTest.h"
+
+namespace {
+
+void put16(std::vector<uint8_t> & out, uint32_t v) {
+	out.push_back(v);
+	out.push_back(v >> 8);
+}
+
+void put32(std::vector<uint8_t> & out, uint32_t v) {
+	put16(out, v);
+	put16(out, v >> 16);
+}
+
+// Writes seconds of a sine at hz, as 16 or 24 bit PCM of channels, the
+// last channel silent
+std::string writeTone(const char * name, double hz, double seconds, uint32_t rate, int bits, int channels) {
+	const int width = bits / 8;
+	const uint32_t frames = (uint32_t)(seconds * rate);
+	std::vector<uint8_t> file;
+	file.insert(file.end(), {'R', 'I', 'F', 'F'});
+	put32(file, 36 + frames * channels * width);
+	file.insert(file.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+	put32(file, 16);
+	put16(file, 1);
+	put16(file, channels);
+	put32(file, rate);
+	put32(file, rate * channels * width);
+	put16(file, channels * width);
+	put16(file, bits);
+	file.insert(file.end(), {'d', 'a', 't', 'a'});
+	put32(file, frames * channels * width);
+	for(uint32_t i = 0; i < frames; i++) {
+		for(int c = 0; c < channels; c++) {
+			double v = c == channels - 1 && channels > 1 ? 0.0 : 0.5 * sin(2.0 * M_PI * hz * i / rate);
+			int32_t s = (int32_t)lround(v * ((1 << (bits - 1)) - 1));
+			for(int b = 0; b < width; b++)
+				file.push_back(s >> (8 * b));
+		}
+	}
+	std::string path = std::string("/tmp/") + name;
+	FILE * f = fopen(path.c_str(), "wb");
+	fwrite(&file[0], 1, file.size(), f);
+	fclose(f);
+	return path;
+}
+
+void testParams() {
+	RenderParams params;
+	std::string error;
+	CHECK(params.parse("name=bar leds=168 bins=3 fft=0-3,3-10,10-41 split=72,24,72 sweep=0,96,200,reverse # comment",
+		error), "%s", error.c_str());
+	CHECK(params.name == "bar" && params.leds == 168 && params.bins == 3 && params.layout == "custom",
+		"parsed %s %d %d %s", params.name.c_str(), params.leds, params.bins, params.layout.c_str());
+	CHECK(params.startHue == 0 && params.endHue == 96 && params.saturation == 200 && params.reverse, "sweep misread");
+	DisplayBin bins[3];
+	params.layoutBins<3, FFTAnalyzer<1024>::Spectrum>(bins);
+	CHECK(bins[1].startFFTBin == 3 && bins[1].endFFTBin == 10 && bins[1].startLEDNum == 72 && bins[1].endLEDNum == 96 &&
+		bins[2].endLEDNum == 168, "bin 1 is FFT %d-%d, LEDs %d-%d", bins[1].startFFTBin, bins[1].endFFTBin,
+		bins[1].startLEDNum, bins[1].endLEDNum);
+
+	RenderParams bad;
+	CHECK(!bad.parse("bins=5", error), "5 bins accepted");
+	CHECK(!bad.parse("bins=4 fft=0-1,1-2", error), "2 ranges for 4 bins accepted");
+	CHECK(!bad.parse("leds=10 bins=3 split=5,5,5", error), "a split past the strip accepted");
+	CHECK(!bad.parse("colour=red", error) && error.find("colour") != std::string::npos, "unknown key: %s", error.c_str());
+	CHECK(!bad.parse("leds", error), "a key with no value accepted");
+}
+
+void testWav() {
+	WavAudio audio;
+	std::string error;
+	CHECK(!loadWav("/tmp/no such file.wav", audio, error), "a missing file loaded");
+
+	// 48kHz stereo, 24 bit, one channel silent, so the mix is half as loud
+	std::string path = writeTone("OfflineRenderTest48k.wav", 1000.0, 0.5, 48000, 24, 2);
+	CHECK(loadWav(path.c_str(), audio, error), "%s", error.c_str());
+	double expected = 0.5 * AUDIO_SAMPLE_RATE_EXACT;
+	CHECK(fabs(audio.samples.size() - expected) < 2, "%d samples, expected %.0f", (int)audio.samples.size(), expected);
+	int peak = 0;
+	int crossings = 0;
+	for(size_t i = 0; i < audio.samples.size(); i++) {
+		peak = max(peak, abs((int)audio.samples[i]));
+		crossings += i > 0 && (audio.samples[i - 1] < 0) != (audio.samples[i] < 0);
+	}
+	CHECK(abs(peak - 32767 / 4) < 200, "peak %d", peak);
+	// 1kHz crosses zero 2000 times a second
+	CHECK(abs(crossings - 1000) <= 2, "%d zero crossings in half a second", crossings);
+	remove(path.c_str());
+}
+
+// The brightness of each display bin's LEDs over every frame
+std::vector<double> binLight(const std::vector<uint8_t> & pixels, const DisplayBin * bins, int count, int leds) {
+	std::vector<double> light(count, 0.0);
+	for(size_t frame = 0; frame < pixels.size() / (leds * 3); frame++) {
+		for(int b = 0; b < count; b++) {
+			for(int led = bins[b].startLEDNum; led < bins[b].endLEDNum; led++) {
+				const uint8_t * p = &pixels[(frame * leds + led) * 3];
+				light[b] += p[0] + p[1] + p[2];
+			}
+		}
+	}
+	return light;
+}
+
+void testTone() {
+	// 2kHz is in FFT bin 46 of 1024 at 44.1kHz
+	std::string path = writeTone("OfflineRenderTestTone.wav", 2000.0, 2.0, 44100, 16, 1);
+	WavAudio audio;
+	std::string error;
+	CHECK(loadWav(path.c_str(), audio, error), "%s", error.c_str());
+	remove(path.c_str());
+
+	RenderParams params;
+	// at half scale, so the tone's bar stands well clear of the leakage
+	CHECK(params.parse("leds=60 bins=4 fft=1-10,10-30,30-80,80-300 uniform=1 target=128", error), "%s",
+		error.c_str());
+	std::vector<uint8_t> pixels;
+	int frames = renderOffline(audio, params, 30, pixels);
+	CHECK(frames == 60 && (int)pixels.size() == frames * 60 * 3, "%d frames, %d bytes", frames, (int)pixels.size());
+	DisplayBin bins[4];
+	params.layoutBins<4, FFTAnalyzer<1024>::Spectrum>(bins);
+	std::vector<double> light = binLight(pixels, bins, 4, 60);
+	CHECK(light[2] > 0 && light[2] > 4 * (light[0] + light[1] + light[3]), "light by bin %.0f %.0f %.0f %.0f", light[0],
+		light[1], light[2], light[3]);
+}
+
+void testThreads() {
+	std::string path = writeTone("OfflineRenderTestThreads.wav", 150.0, 1.5, 44100, 16, 1);
+	WavAudio audio;
+	std::string error;
+	CHECK(loadWav(path.c_str(), audio, error), "%s", error.c_str());
+	remove(path.c_str());
+
+	RenderParams a, b;
+	a.parse("leds=120 bins=8 layout=mel beat=40", error);
+	b.parse("leds=90 bins=3 fps=120 speed=1000,5000,3000", error);
+	std::vector<uint8_t> aAlone, bAlone, aThreaded, bThreaded;
+	renderOffline(audio, a, 60, aAlone);
+	renderOffline(audio, b, 60, bAlone);
+	std::thread other([&]() {
+		renderOffline(audio, b, 60, bThreaded);
+	});
+	renderOffline(audio, a, 60, aThreaded);
+	other.join();
+	CHECK(!aAlone.empty() && aThreaded == aAlone, "set a differs on a thread");
+	CHECK(!bAlone.empty() && bThreaded == bAlone, "set b differs on a thread");
+	CHECK(aAlone != std::vector<uint8_t>(aAlone.size(), 0), "set a drew nothing");
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	testParams();
+	testWav();
+	testTone();
+	testThreads();
+
+	return testResult();
+}
@@ -0,0 +1,114 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Feeds the onset detector bin sums of clicks over a quiet, slightly noisy
+// floor. Each click must be flagged in its own frame and nowhere else, a
+// second click inside the refractory window must not be, and a steady
+// click must bring the tempo to its BPM.
+
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+const int BINS = 4;
+const uint32_t PERIOD = 11610;
+typedef OnsetDetector<BINS> Detector;
+
+// The sums of a frame: the floor with a little noise, plus a click that
+// halves every frame after it lands
+class Clicks {
+public:
+	Clicks() : seed(1), level(0) {
+	}
+	const uint32_t * frame(bool click) {
+		if(click)
+			level = 256000;
+		else
+			level /= 2;
+		for(int i = 0; i < BINS; i++) {
+			seed = seed * 1664525 + 1013904223;
+			sums[i] = 1000 + (seed >> 16) % 50 + level;
+		}
+		return sums;
+	}
+private:
+	uint32_t seed;
+	uint32_t level;
+	uint32_t sums[BINS];
+};
+
+FFTBinData<BINS> run(Detector & detector, Clicks & clicks, bool click) {
+	FFTBinData<BINS> data;
+	memset(&data, 0, sizeof(data));
+	detector.update(clicks.frame(click), PERIOD, data);
+	return data;
+}
+
+// A click every 50 frames, each followed by a second one after gap frames
+void testOnsetFrames() {
+	Detector detector;
+	Clicks clicks;
+	for(int f = 0; f < 40; f++)
+		CHECK(!run(detector, clicks, false).onset, "an onset in the quiet frame %d", f);
+	// 80ms is 6.9 frames, so a second click 6 frames on is inside the
+	// window and one 7 frames on is outside
+	const int gaps[2] = {6, 7};
+	for(int g = 0; g < 2; g++) {
+		for(int n = 0; n < 5; n++) {
+			for(int f = 0; f < 50; f++) {
+				bool click = f == 0 || f == gaps[g];
+				FFTBinData<BINS> data = run(detector, clicks, click);
+				bool expected = f == 0 || (f == gaps[g] && gaps[g] * PERIOD >= 80000);
+				CHECK(data.onset == expected, "click %d of gap %d, frame %d: onset %d, expected %d", n, gaps[g], f,
+					data.onset, expected);
+				CHECK(!data.onset || data.onsetStrength > 0, "an onset of no strength");
+			}
+		}
+	}
+}
+
+// A steady click at frames a beat must converge to its tempo, with one
+// beat flagged a click
+void testTempo(int frames) {
+	const int bpm = (int)(60000000.0 / (frames * PERIOD) + 0.5);
+	Detector detector;
+	Clicks clicks;
+	int beats = 0;
+	const int CLICKS = 60;
+	for(int n = 0; n < CLICKS; n++) {
+		for(int f = 0; f < frames; f++) {
+			FFTBinData<BINS> data = run(detector, clicks, f == 0);
+			if(n >= CLICKS - 10)
+				beats += data.beat;
+		}
+	}
+	CHECK(abs(detector.getTempo() - bpm) <= 1, "%d BPM, expected %d", detector.getTempo(), bpm);
+	CHECK(abs(beats - 10) <= 1, "%d beats over the last 10 clicks at %d BPM", beats, bpm);
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	testOnsetFrames();
+	testTempo(43);
+	testTempo(52);
+	testTempo(34);
+
+	return testResult();
+}
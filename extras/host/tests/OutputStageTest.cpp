@@ -0,0 +1,135 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks the LEDOutputStage tables against the gamma curve, that a flat
+// configuration passes pixels through, that dithering averages to the
+// table level over 8 frames, with no bias either way, where rounding would
+// lose the dim levels, and
+// that LEDFrameBuffer corrects what it sends and not what was drawn.
+
+#include <math.h>
+#include "AudioVisualizer.h"
+#include "LEDOutputStage.h"
+#include "HostTest.h"
+
+namespace {
+
+void testTables() {
+	LEDOutputStage stage;
+	stage.configure(2.2f, CRGB(255, 176, 240), 200);
+	int rises = 0;
+	for(int v = 0; v < 256; v++) {
+		double expected = pow(v / 255.0, 2.2) * 200 * 256;
+		CHECK(fabs(stage.level(0, v) - expected) <= 1, "red %d is %u, expected %.1f", v, stage.level(0, v), expected);
+		CHECK(fabs(stage.level(1, v) - expected * 176 / 255) <= 1, "green %d is %u, expected %.1f", v,
+			stage.level(1, v), expected * 176 / 255);
+		rises += v > 0 && stage.level(2, v) < stage.level(2, v - 1);
+	}
+	CHECK(rises == 0, "the blue table falls %d times", rises);
+	stage.configure(2.8f, CRGB(255, 255, 255));
+	CHECK(stage.level(0, 255) == 255 * 256, "full red is %u", stage.level(0, 255));
+}
+
+void testPassThrough() {
+	LEDOutputStage stage;
+	stage.setDithering(false);
+	CRGB in[256], out[256];
+	for(int i = 0; i < 256; i++)
+		in[i] = CRGB(i, 255 - i, i ^ 0x5a);
+	stage.apply(out, in, 256);
+	int differences = 0;
+	for(int i = 0; i < 256; i++)
+		differences += out[i].r != in[i].r || out[i].g != in[i].g || out[i].b != in[i].b;
+	CHECK(differences == 0, "a flat stage changed %d pixels", differences);
+}
+
+void testDithering() {
+	LEDOutputStage stage;
+	stage.configure(2.5f, CRGB(255, 255, 255));
+	const int LEDS = 64;
+	CRGB in[LEDS], out[LEDS];
+	int lostRounded = 0, lostDithered = 0, worst = 0;
+	// 8 frame sums against the table, signed, in 1/2048 of a level
+	long bias = 0;
+	int samples = 0;
+	for(int v = 1; v < 256; v++) {
+		for(int i = 0; i < LEDS; i++)
+			in[i] = CRGB(v, v, v);
+		// every pixel over 8 frames, against the 8.8 level
+		int sum[LEDS] = {0};
+		for(int f = 0; f < 8; f++) {
+			stage.apply(out, in, LEDS);
+			stage.nextFrame();
+			for(int i = 0; i < LEDS; i++)
+				sum[i] += out[i].g;
+		}
+		uint16_t level = stage.level(1, v);
+		for(int i = 0; i < LEDS; i++) {
+			int error = sum[i] * 256 - level * 8;
+			worst = max(worst, abs(error));
+			bias += error;
+			samples++;
+		}
+		lostDithered += sum[0] == 0;
+		lostRounded += (level + 128) >> 8 == 0;
+		// a frame lights some of any 8 neighbors, not all or none
+		stage.apply(out, in, 8);
+		int up = 0;
+		for(int i = 0; i < 8; i++)
+			up += out[i].g > level >> 8;
+		if((level & 0xff) >= 16 && (level & 0xff) < 240)
+			CHECK(up > 0 && up < 8, "%d of 8 neighbors up a level at %d", up, v);
+	}
+	// 8 frames resolve a level to 1/16 of a step, as often under as over
+	CHECK(worst <= 128, "8 frames average %.3f steps off", worst / 2048.0);
+	CHECK(labs(bias) <= (long)samples * 2048 / 256, "8 frames average %.4f steps off the table",
+		(double)bias / samples / 2048.0);
+	printf("8 frame mean: %.4f steps off the table, at worst %.4f\n", (double)bias / samples / 2048.0,
+		worst / 2048.0);
+	CHECK(lostDithered < lostRounded, "%d dim levels dark dithered, %d rounded", lostDithered, lostRounded);
+	printf("dim levels lost: %d rounded, %d dithered\n", lostRounded, lostDithered);
+}
+
+void testFrameBuffer() {
+	const int LEDS = 16;
+	FastLEDSink sink;
+	LEDFrameBuffer<LEDS> buffer(sink);
+	LEDOutputStage stage;
+	stage.configure(2.2f, CRGB(255, 128, 255));
+	stage.setDithering(false);
+	buffer.setOutputStage(&stage);
+	for(int i = 0; i < LEDS; i++)
+		buffer.back()[i] = CRGB(255, 255, 128);
+	buffer.show(4);
+	CHECK(buffer.back()[0].g == 255, "show() corrected the back buffer");
+	CHECK(buffer.front()[0].r == 255 && buffer.front()[0].g == 128 && buffer.front()[LEDS - 1].g == 128,
+		"full green went out at %u and %u", buffer.front()[0].g, buffer.front()[LEDS - 1].g);
+	uint8_t blue = (stage.level(2, 128) + 128) >> 8;
+	CHECK(buffer.front()[5].b == blue, "half blue went out at %u, expected %u", buffer.front()[5].b, blue);
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	testTables();
+	testPassThrough();
+	testDithering();
+	testFrameBuffer();
+
+	return testResult();
+}
@@ -0,0 +1,138 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks the log-bucket histogram's buckets and percentiles, that it
+// keeps its shape past 16 bit counts, and that with the probes built in a
+// visualizer times every stage once a frame and prints them on 'p'.
+
+#define AUDIOVISUALIZER_PROFILE 1
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+VirtualClock virtualClock;
+
+void testBuckets() {
+	int misplaced = 0;
+	for(uint64_t v = 0; v < 0x100000000ULL; v = v < 4096 ? v + 1 : v * 17 / 16) {
+		int b = ProfileHistogram::bucket(v);
+		misplaced += b < 0 || b >= ProfileHistogram::BUCKETS || v < ProfileHistogram::bottom(b) ||
+			v > ProfileHistogram::top(b);
+	}
+	CHECK(misplaced == 0, "%d values outside their bucket", misplaced);
+	CHECK(ProfileHistogram::bucket(0xFFFFFFFF) == ProfileHistogram::BUCKETS - 1, "2^32-1 is in bucket %d",
+		ProfileHistogram::bucket(0xFFFFFFFF));
+	for(int b = 5; b < ProfileHistogram::BUCKETS; b++)
+		CHECK(ProfileHistogram::top(b) < (uint64_t)ProfileHistogram::bottom(b) * 3 / 2, "bucket %d is %u to %u", b,
+			ProfileHistogram::bottom(b), ProfileHistogram::top(b));
+}
+
+void testPercentiles() {
+	ProfileHistogram h;
+	CHECK(h.percentile(50) == 0 && h.getMin() == 0 && h.getMax() == 0, "an empty histogram has values");
+	for(uint32_t v = 1; v <= 1000; v++)
+		h.add(v);
+	CHECK(h.getMin() == 1 && h.getMax() == 1000, "min %u, max %u", h.getMin(), h.getMax());
+	uint32_t p50 = h.percentile(50), p99 = h.percentile(99);
+	CHECK(p50 >= 500 && p50 < 500 * 3 / 2, "p50 of 1-1000 is %u", p50);
+	CHECK(p99 >= 990 && p99 <= 1000, "p99 of 1-1000 is %u", p99);
+
+	// a long run of one value, then a few outliers
+	h.reset();
+	for(int i = 0; i < 200000; i++)
+		h.add(300);
+	for(int i = 0; i < 100; i++)
+		h.add(90000);
+	CHECK(h.getSamples() == 200100, "%u samples", h.getSamples());
+	CHECK(h.percentile(50) >= 300 && h.percentile(50) < 450, "p50 of 300s is %u", h.percentile(50));
+	CHECK(h.percentile(99) < 450, "p99 is %u with 0.05%% outliers", h.percentile(99));
+	CHECK(h.percentile(100) == 90000, "p100 is %u", h.percentile(100));
+}
+
+// Counts a stage's line in the printed profile
+int printedStage(const char * printed, const char * stage) {
+	int found = 0;
+	for(const char * line = printed; line && *line; line = strchr(line, '\n')) {
+		if(*line == '\n')
+			line++;
+		found += strncmp(line, stage, strlen(stage)) == 0 && line[strlen(stage)] == ' ';
+	}
+	return found;
+}
+
+void testVisualizer() {
+	static CRGB leds[168];
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<168, 8> visualizer(fft);
+	FastLEDSink sink;
+	LEDFrameBuffer<168> buffer(sink);
+	fft.synthesize(64);
+	fft.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	virtualClock.setMicros(0);
+	visualizer.init(leds);
+	profiler().reset();
+	int frames = 0;
+	for(int t = 0; t < 1000; t++) {
+		virtualClock.advanceMicros(100);
+		if(visualizer.update()) {
+			frames++;
+			buffer.show();
+		}
+	}
+	CHECK(frames > 5, "%d frames", frames);
+	CHECK((int)profiler().histogram(ProfileReduce).getSamples() == frames, "reduce timed %u times in %d frames",
+		profiler().histogram(ProfileReduce).getSamples(), frames);
+	CHECK((int)profiler().histogram(ProfileAutoscale).getSamples() == frames, "autoscale timed %u times",
+		profiler().histogram(ProfileAutoscale).getSamples());
+	CHECK((int)profiler().histogram(ProfileFFTWait).getSamples() == frames - 1, "the FFT wait timed %u times",
+		profiler().histogram(ProfileFFTWait).getSamples());
+	// the strip renderer runs between frames too, to fade
+	CHECK((int)profiler().histogram(ProfileRenderer).getSamples() == 1000, "the renderer timed %u times",
+		profiler().histogram(ProfileRenderer).getSamples());
+	CHECK((int)profiler().histogram(ProfileShow).getSamples() == frames, "show timed %u times",
+		profiler().histogram(ProfileShow).getSamples());
+	CHECK(profiler().histogram(ProfileRenderer + 1).getSamples() == 0, "a second renderer was timed");
+
+	char printed[2048] = {0};
+	FILE * out = tmpfile();
+	Serial.setOutput(out);
+	visualizer.enableSerialCommands();
+	Serial.inject("p");
+	visualizer.update();
+	Serial.setOutput(NULL);
+	rewind(out);
+	fread(printed, 1, sizeof(printed) - 1, out);
+	fclose(out);
+	CHECK(strstr(printed, "Profile, in ns") != NULL, "no profile printed:\n%s", printed);
+	CHECK(printedStage(printed, "reduce") == 1 && printedStage(printed, "renderer 0") == 1 &&
+		printedStage(printed, "show") == 1, "stages missing:\n%s", printed);
+	CHECK(printedStage(printed, "renderer 1") == 0, "an unused stage printed:\n%s", printed);
+	CHECK(profiler().histogram(ProfileReduce).getSamples() == 0, "printing did not start the profile over");
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	testBuckets();
+	testPercentiles();
+	testVisualizer();
+
+	return testResult();
+}
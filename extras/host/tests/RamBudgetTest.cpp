@@ -0,0 +1,78 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Pins the example sketch's 168 LED, 8 bin visualizer to the Teensy LC's
+// RAM budget at compile time, and checks that ramInUse() adds the layers
+// and telemetry ring a sketch hands in to ramBytes(). Pointers are twice
+// as wide here as on the device, so the host figures run above the LC's.
+
+#include <vector>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+const int LC_RAM_BUDGET = 6144;
+const int NUM_LEDS = 168;
+typedef AudioVisualizer<NUM_LEDS, 8> Visualizer;
+
+static_assert(Visualizer::ramBytes() <= LC_RAM_BUDGET, "AudioVisualizer<168, 8> no longer fits the Teensy LC");
+
+void testInUse() {
+	static AudioAnalyzeFFT1024 fft;
+	static Visualizer visualizer(fft);
+	std::vector<CRGB> leds(NUM_LEDS), audio(NUM_LEDS), ambient(NUM_LEDS);
+	printf("AudioVisualizer<168, 8>: %u bytes of the LC's %d\n", (unsigned)Visualizer::ramBytes(), LC_RAM_BUDGET);
+
+	visualizer.init(&leds[0]);
+	CHECK(visualizer.ramInUse() == Visualizer::ramBytes(), "one strip: %u in use, %u static",
+		(unsigned)visualizer.ramInUse(), (unsigned)Visualizer::ramBytes());
+
+	visualizer.init(&leds[0], &audio[0], &ambient[0]);
+	size_t layers = 2 * NUM_LEDS * sizeof(CRGB);
+	CHECK(visualizer.ramInUse() == Visualizer::ramBytes() + layers, "layers: %u in use, expected %u",
+		(unsigned)visualizer.ramInUse(), (unsigned)(Visualizer::ramBytes() + layers));
+
+	static uint8_t storage[512];
+	static TelemetryRing ring(storage, sizeof(storage));
+	visualizer.setTelemetry(&ring);
+	size_t telemetry = sizeof(TelemetryRing) + sizeof(storage);
+	CHECK(visualizer.ramInUse() == Visualizer::ramBytes() + layers + telemetry, "telemetry: %u in use, expected %u",
+		(unsigned)visualizer.ramInUse(), (unsigned)(Visualizer::ramBytes() + layers + telemetry));
+
+	// back to one strip, the layers are no longer counted
+	visualizer.init(&leds[0]);
+	CHECK(visualizer.ramInUse() == Visualizer::ramBytes() + telemetry, "after re-init: %u in use",
+		(unsigned)visualizer.ramInUse());
+}
+
+// Opting in to the color cache is counted in the static figure
+void testColorCache() {
+	typedef AudioVisualizer<NUM_LEDS, 8, AudioAnalyzeFFT1024, 0, 1, 8 * 32, true> Cached;
+	size_t cost = Cached::ramBytes() - Visualizer::ramBytes();
+	CHECK(cost >= 800, "the color cache adds only %u bytes", (unsigned)cost);
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	testInUse();
+	testColorCache();
+
+	return testResult();
+}
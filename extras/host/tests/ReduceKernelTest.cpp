@@ -0,0 +1,190 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks every reduce kernel against a 64 bit reference over random
+// spectra and weights, at odd and even offsets and at lengths on and off
+// the kernels' steps. The DSP kernel's pairing and alignment run on a model
+// of its instructions, which also counts any word load the M4 would make
+// off a word boundary; its weighted sums are within the low bit it drops
+// from each sample. The real one is checked too when built for a Cortex-M4.
+
+#include <vector>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+const int SIZE = 512;
+const int CHANNELS = 3;
+uint32_t seed = 1;
+
+uint32_t randomBelow(uint32_t range) {
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) % range;
+}
+
+struct Data {
+	// word aligned, as the analyzers' outputs are
+	std::vector<uint32_t> words[CHANNELS];
+	const uint16_t * spectra[CHANNELS];
+	std::vector<uint32_t> weightWords;
+	const uint16_t * weights;
+
+	Data() {
+		for(int c = 0; c < CHANNELS; c++) {
+			words[c].resize(SIZE / 2);
+			uint16_t * s = (uint16_t *)&words[c][0];
+			// up to a full-scale FFT1024 magnitude
+			for(int i = 0; i < SIZE; i++)
+				s[i] = randomBelow(46342);
+			spectra[c] = s;
+		}
+		weightWords.resize(SIZE / 2 + 1);
+		uint16_t * w = (uint16_t *)&weightWords[0];
+		for(int i = 0; i < SIZE + 2; i++)
+			w[i] = randomBelow(256);
+		weights = w;
+	}
+};
+
+uint32_t referenceSum(const uint16_t * s, int n) {
+	uint64_t acc = 0;
+	for(int i = 0; i < n; i++)
+		acc += s[i];
+	return (uint32_t)acc;
+}
+
+uint32_t referenceWeightedSum(const uint16_t * s, const uint16_t * w, int n) {
+	uint64_t acc = 0;
+	for(int i = 0; i < n; i++)
+		acc += (uint64_t)s[i] * w[i];
+	return (uint32_t)(acc >> 8);
+}
+
+// UHADD16 and SMLAD bit for bit, and a word load that counts misalignment
+struct ModelDualHalfwordOps {
+	static int misaligned;
+
+	static uint32_t pair(const uint16_t * p) {
+		if((uintptr_t)p & 3)
+			misaligned++;
+		return p[0] | (uint32_t)p[1] << 16;
+	}
+
+	static uint32_t uhadd16(uint32_t a, uint32_t b) {
+		uint32_t low = ((a & 0xFFFF) + (b & 0xFFFF)) >> 1;
+		uint32_t high = ((a >> 16) + (b >> 16)) >> 1;
+		return low | high << 16;
+	}
+
+	static int32_t smlad(uint32_t a, uint32_t b, int32_t acc) {
+		int32_t low = (int16_t)(a & 0xFFFF) * (int16_t)(b & 0xFFFF);
+		int32_t high = (int16_t)(a >> 16) * (int16_t)(b >> 16);
+		return (int32_t)((uint32_t)acc + (uint32_t)low + (uint32_t)high);
+	}
+};
+
+int ModelDualHalfwordOps::misaligned = 0;
+
+// How far a weighted sum may be off: nothing, or for the DSP kernel half a
+// weight a tap and the rounding of its two shifts
+uint32_t tolerance(bool exact, const uint16_t * w, int n) {
+	if(exact)
+		return 0;
+	uint32_t total = 0;
+	for(int i = 0; i < n; i++)
+		total += w[i];
+	return (total >> 8) + 2;
+}
+
+bool near(uint32_t a, uint32_t b, uint32_t slack) {
+	return (a > b ? a - b : b - a) <= slack;
+}
+
+// w is taken at either parity, so kernels that pair weights with samples
+// see both alignments
+template<class KERNEL, int C>
+void checkRun(const char * name, bool exact, const Data & data, int offset, int n, int weightShift) {
+	const uint16_t * w = data.weights + weightShift;
+	for(int c = 0; c < C; c++) {
+		const uint16_t * s = data.spectra[c] + offset;
+		uint32_t expected = referenceSum(s, n);
+		uint32_t sum = KERNEL::sum(s, n);
+		CHECK(sum == expected, "%s sum at %d of %d: %u, expected %u", name, offset, n, sum, expected);
+		expected = referenceWeightedSum(s, w, n);
+		sum = KERNEL::weightedSum(s, w, n);
+		CHECK(near(sum, expected, tolerance(exact, w, n)), "%s weightedSum at %d of %d, weights at %d: %u, expected %u",
+			name, offset, n, weightShift, sum, expected);
+	}
+
+	uint32_t sums[C];
+	KERNEL::template sumChannels<C>(data.spectra, offset, n, sums);
+	for(int c = 0; c < C; c++) {
+		uint32_t expected = referenceSum(data.spectra[c] + offset, n);
+		CHECK(sums[c] == expected, "%s sumChannels<%d> channel %d at %d of %d: %u, expected %u", name, C, c, offset, n,
+			sums[c], expected);
+	}
+	KERNEL::template weightedSumChannels<C>(data.spectra, offset, w, n, sums);
+	for(int c = 0; c < C; c++) {
+		uint32_t expected = referenceWeightedSum(data.spectra[c] + offset, w, n);
+		CHECK(near(sums[c], expected, tolerance(exact, w, n)),
+			"%s weightedSumChannels<%d> channel %d at %d of %d, weights at %d: %u, expected %u", name, C, c, offset,
+			n, weightShift, sums[c], expected);
+	}
+}
+
+template<class KERNEL, int C>
+void checkChannels(const char * name, bool exact, const Data & data) {
+	// every short length, around the vector kernel's 8 lanes, at each alignment
+	for(int offset = 0; offset < 4; offset++)
+		for(int n = 0; n <= 18; n++)
+			for(int shift = 0; shift < 2; shift++)
+				checkRun<KERNEL, C>(name, exact, data, offset, n, shift);
+	// the whole spectrum, and random runs of it
+	checkRun<KERNEL, C>(name, exact, data, 0, SIZE, 0);
+	for(int r = 0; r < 200; r++) {
+		int offset = randomBelow(SIZE);
+		int n = randomBelow(SIZE - offset + 1);
+		checkRun<KERNEL, C>(name, exact, data, offset, n, randomBelow(2));
+	}
+}
+
+template<class KERNEL>
+void checkKernel(const char * name, bool exact) {
+	for(int trial = 0; trial < 4; trial++) {
+		Data data;
+		checkChannels<KERNEL, 1>(name, exact, data);
+		checkChannels<KERNEL, 2>(name, exact, data);
+		checkChannels<KERNEL, 3>(name, exact, data);
+	}
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	checkKernel<ScalarReduceKernel>("scalar", true);
+	checkKernel<VectorReduceKernel>("vector", true);
+	checkKernel<DualHalfwordKernel<ModelDualHalfwordOps> >("dual halfword model", false);
+	CHECK(ModelDualHalfwordOps::misaligned == 0, "dual halfword model: %d misaligned word loads",
+		ModelDualHalfwordOps::misaligned);
+#if defined(__ARM_FEATURE_DSP)
+	checkKernel<DualHalfwordReduceKernel>("dual halfword", false);
+#endif
+
+	return testResult();
+}
@@ -0,0 +1,172 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks that RenderScheduler keeps its frame rate under an uneven loop
+// and skips what a stall misses, that bars glide down between analysis
+// frames and jump up, that fades follow elapsed time however often the
+// strip is drawn, and that a scheduled AudioVisualizer draws at its rate.
+
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+VirtualClock virtualClock;
+
+void testScheduler() {
+	RenderScheduler scheduler;
+	scheduler.setFrameRate(120);
+	virtualClock.setMicros(5000);
+	uint32_t seed = 7;
+	int drawn = 0;
+	// a second of loop() passes between 37 and 900us long
+	while(micros() < 1005000) {
+		drawn += scheduler.due(micros());
+		seed = seed * 1664525u + 1013904223u;
+		virtualClock.advanceMicros(37 + (seed >> 16) % 864);
+	}
+	CHECK(drawn >= 119 && drawn <= 121, "%d frames in a second at 120fps", drawn);
+	CHECK(scheduler.getSkipped() == 0, "%u frames skipped without a stall", scheduler.getSkipped());
+
+	// a 50ms stall misses five frames and draws one, not six in a row
+	virtualClock.advanceMicros(50000);
+	CHECK(scheduler.due(micros()), "no frame after a stall");
+	CHECK(!scheduler.due(micros()), "a second frame right after a stall");
+	CHECK(scheduler.getSkipped() >= 5 && scheduler.getSkipped() <= 6, "%u frames skipped in a 50ms stall",
+		scheduler.getSkipped());
+}
+
+// One bin across 100 LEDs with a linear curve
+struct Strip {
+	static const int LEDS = 100;
+	CRGB leds[LEDS];
+	DisplayBin bins[1];
+	LEDStripAudioRenderer<1, LEDS> renderer;
+
+	Strip() {
+		bins[0].startFFTBin = 0;
+		bins[0].endFFTBin = 1;
+		bins[0].startLEDNum = 0;
+		bins[0].endLEDNum = LEDS;
+		bins[0].displayFunction = DisplayFunction::Lin;
+		bins[0].weighting = BinWeighting::Flat;
+		renderer.init(leds, LEDS, bins);
+	}
+
+	FFTBinData<1> data(uint8_t level) {
+		FFTBinData<1> d;
+		memset(&d, 0, sizeof(d));
+		d.binValues[0] = level;
+		return d;
+	}
+
+	void frame(uint8_t level) {
+		FFTBinData<1> d = data(level);
+		renderer.setFrame(&d);
+	}
+
+	int value() {
+		return renderer.getBinState()[0].value;
+	}
+};
+
+void testGlide() {
+	virtualClock.setMicros(0);
+	Strip strip;
+	// the running average pulls bars down, so build it up first
+	for(int i = 0; i < 20; i++) {
+		virtualClock.advanceMicros(10000);
+		strip.frame(40);
+	}
+	virtualClock.advanceMicros(10000);
+	strip.frame(255);
+	strip.renderer.render();
+	int top = strip.value();
+	CHECK(top > 0 && top == strip.renderer.getBinState()[0].toValue, "a rising bar read %d, heading for %d", top,
+		strip.renderer.getBinState()[0].toValue);
+
+	virtualClock.advanceMicros(10000);
+	strip.frame(0);
+	int bottom = strip.renderer.getBinState()[0].toValue;
+	CHECK(bottom < top, "the bar heads for %d from %d", bottom, top);
+	int last = top, rises = 0;
+	for(int t = 0; t < 10; t++) {
+		strip.renderer.render();
+		rises += strip.value() > last;
+		last = strip.value();
+		virtualClock.advanceMicros(1000);
+	}
+	int middle = strip.value();
+	strip.renderer.render();
+	CHECK(rises == 0, "a falling bar rose %d times", rises);
+	CHECK(strip.value() == bottom, "the bar is at %d a frame later, expected %d", strip.value(), bottom);
+	CHECK(middle > bottom && middle < top, "the bar went from %d to %d without passing %d", top, bottom, middle);
+}
+
+// The fade of a full bright pixel after 20ms, drawn every stepMicros
+int fadedBrightness(uint32_t stepMicros) {
+	virtualClock.setMicros(0);
+	Strip strip;
+	strip.renderer.setSpeed(2000, 11000, 10000);
+	virtualClock.advanceMicros(10000);
+	FFTBinData<1> full = strip.data(255);
+	strip.renderer.update(&full);
+	for(uint32_t t = 0; t < 20000; t += stepMicros) {
+		virtualClock.advanceMicros(stepMicros);
+		strip.renderer.update(NULL);
+	}
+	return strip.renderer.getBinState()[0].brightness[Strip::LEDS / 2];
+}
+
+void testFadeTiming() {
+	int fast = fadedBrightness(10), slow = fadedBrightness(2000);
+	CHECK(fast < 255 && fast == slow, "drawn every 10us the pixel is at %d, every 2ms at %d", fast, slow);
+}
+
+void testVisualizer() {
+	static CRGB leds[168];
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<168, 8> visualizer(fft);
+	fft.synthesize(64);
+	fft.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	virtualClock.setMicros(0);
+	visualizer.init(leds);
+	visualizer.setFrameRate(120);
+	int shown = 0;
+	for(int t = 0; t < 10000; t++) {
+		virtualClock.advanceMicros(100);
+		shown += visualizer.update();
+	}
+	CHECK(shown >= 119 && shown <= 121, "shown %d times in a second at 120fps", shown);
+	int lit = 0;
+	for(int i = 0; i < 168; i++)
+		lit += leds[i].r || leds[i].g || leds[i].b;
+	CHECK(lit > 0, "the scheduled strip is dark");
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	testScheduler();
+	testGlide();
+	testFadeTiming();
+	testVisualizer();
+
+	return testResult();
+}
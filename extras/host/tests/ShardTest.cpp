@@ -0,0 +1,254 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Draws the same frames with one renderer over the whole array and with a
+// renderer per strip, in turn and on threads: with every bin inside a
+// strip the pixels must match. A bin that crosses strips is drawn as one
+// bar, matching the single renderer away from the seams, and parallel
+// strips take the wire time of one. A renderer keeps to its MAX_LEDS when
+// given a longer strip.
+
+#include "AudioVisualizer.h"
+#include "HostThreadExecutor.h"
+#include "HostTest.h"
+
+namespace {
+
+const int BINS = 8;
+const int STRIPS = 4;
+const int PER_STRIP = 42;
+const int LEDS = STRIPS * PER_STRIP;
+VirtualClock virtualClock;
+
+// Two bins a strip, uneven, with every curve
+void makeBins(DisplayBin * bins) {
+	const int split[2] = {0, 17};
+	for(int i = 0; i < BINS; i++) {
+		int strip = i / 2;
+		bins[i].startFFTBin = i * 4;
+		bins[i].endFFTBin = i * 4 + 4;
+		bins[i].startLEDNum = strip * PER_STRIP + split[i % 2];
+		bins[i].endLEDNum = i % 2 ? (strip + 1) * PER_STRIP : strip * PER_STRIP + split[1];
+		bins[i].displayFunction = (DisplayFunction)(i % 3);
+		bins[i].weighting = BinWeighting::Flat;
+	}
+}
+
+FFTBinData<BINS> frame(int f) {
+	FFTBinData<BINS> data;
+	memset(&data, 0, sizeof(data));
+	for(int i = 0; i < BINS; i++)
+		data.binValues[i] = (uint8_t)((f * 37 + i * 91) % 256);
+	data.beat = f % 5 == 0;
+	data.onset = f % 3 == 0;
+	return data;
+}
+
+// Runs the renderer through update() and the glide of render(), the clock
+// restarted so every renderer sees the same times
+template<class RENDERER>
+void draw(RENDERER & renderer, CRGB * leds, const DisplayBin * bins) {
+	virtualClock.setMicros(0);
+	fill_solid(leds, LEDS, CRGB::Black);
+	renderer.init(leds, LEDS, bins);
+	renderer.setSpeed(3000, 9000, 4000);
+	for(int f = 0; f < 40; f++) {
+		virtualClock.advanceMicros(11000);
+		FFTBinData<BINS> data = frame(f);
+		if(f % 2) {
+			renderer.update(&data);
+		}
+		else {
+			renderer.setFrame(&data);
+			for(int t = 0; t < 3; t++) {
+				virtualClock.advanceMicros(3000);
+				renderer.render();
+			}
+		}
+	}
+}
+
+int differences(const CRGB * a, const CRGB * b) {
+	int count = 0;
+	for(int i = 0; i < LEDS; i++)
+		count += a[i].r != b[i].r || a[i].g != b[i].g || a[i].b != b[i].b;
+	return count;
+}
+
+int lit(const CRGB * leds, int start, int end) {
+	int count = 0;
+	for(int i = start; i < end; i++)
+		count += leds[i].r || leds[i].g || leds[i].b;
+	return count;
+}
+
+void testMatchesSingleRenderer() {
+	DisplayBin bins[BINS];
+	makeBins(bins);
+	static CRGB single[LEDS], serial[LEDS], threaded[LEDS];
+	static LEDStripAudioRenderer<BINS, LEDS> whole;
+	draw(whole, single, bins);
+	CHECK(lit(single, 0, LEDS) > 0, "the single renderer drew nothing");
+
+	static ShardedRenderer<BINS, STRIPS, PER_STRIP> shards;
+	draw(shards, serial, bins);
+	CHECK(differences(single, serial) == 0, "%d pixels differ, shards drawn in turn", differences(single, serial));
+
+	HostThreadExecutor executor(STRIPS - 1);
+	ShardedRenderer<BINS, STRIPS, PER_STRIP, HostThreadExecutor> threadedShards(executor);
+	draw(threadedShards, threaded, bins);
+	CHECK(differences(single, threaded) == 0, "%d pixels differ, shards drawn on threads",
+		differences(single, threaded));
+}
+
+void testCrossingBin() {
+	typedef StripMap<STRIPS, PER_STRIP> Map;
+	DisplayBin bin;
+	bin.startLEDNum = 30;
+	bin.endLEDNum = 100;
+	DisplayBin part = Map::onStrip(bin, 0);
+	CHECK(part.startLEDNum == 30 && part.endLEDNum == 42, "strip 0 has %d to %d", part.startLEDNum, part.endLEDNum);
+	part = Map::onStrip(bin, 1);
+	CHECK(part.startLEDNum == 0 && part.endLEDNum == 42, "strip 1 has %d to %d", part.startLEDNum, part.endLEDNum);
+	part = Map::onStrip(bin, 2);
+	CHECK(part.startLEDNum == 0 && part.endLEDNum == 16, "strip 2 has %d to %d", part.startLEDNum, part.endLEDNum);
+	part = Map::onStrip(bin, 3);
+	CHECK(part.startLEDNum == part.endLEDNum, "strip 3 has %d to %d", part.startLEDNum, part.endLEDNum);
+	CHECK(Map::strip(100) == 2 && Map::offset(100) == 16, "pixel 100 is %d on strip %d", Map::offset(100),
+		Map::strip(100));
+
+	// one bin over the middle strips at full and half level, a single bar
+	// centered as one renderer over the whole array draws it
+	DisplayBin bins[1];
+	bins[0].startFFTBin = 0;
+	bins[0].endFFTBin = 1;
+	bins[0].startLEDNum = 21;
+	bins[0].endLEDNum = 147;
+	bins[0].displayFunction = DisplayFunction::Lin;
+	bins[0].weighting = BinWeighting::Flat;
+	static CRGB single[LEDS], sharded[LEDS];
+	static LEDStripAudioRenderer<1, LEDS> whole;
+	static ShardedRenderer<1, STRIPS, PER_STRIP> shards;
+	const uint8_t levels[2] = {255, 128};
+	for(int l = 0; l < 2; l++) {
+		fill_solid(single, LEDS, CRGB::Black);
+		fill_solid(sharded, LEDS, CRGB::Black);
+		virtualClock.setMicros(0);
+		whole.init(single, LEDS, bins);
+		shards.init(sharded, LEDS, bins);
+		FFTBinData<1> data;
+		memset(&data, 0, sizeof(data));
+		data.binValues[0] = levels[l];
+		virtualClock.advanceMicros(10000);
+		whole.update(&data);
+		shards.update(&data);
+		CHECK(lit(single, 0, LEDS) > 0, "level %d: the single renderer is dark", levels[l]);
+		CHECK(differences(single, sharded) == 0, "level %d: %d pixels differ from one bar", levels[l],
+			differences(single, sharded));
+		CHECK(lit(sharded, 0, 21) == 0 && lit(sharded, 147, LEDS) == 0, "level %d: pixels lit outside the bin",
+			levels[l]);
+	}
+	CHECK(shards.getBinState(1)[0].barLeds == 126 && shards.getBinState(1)[0].barOffset == 21,
+		"strip 1 has %d of a %d LED bar", shards.getBinState(1)[0].barOffset, shards.getBinState(1)[0].barLeds);
+	CHECK(shards.getLEDS() == sharded, "getLEDS() is not the array the strips were given");
+	static const TransferCurve steep = TransferCurve::gamma(3.0);
+	shards.setTransferCurve(0, steep);
+	for(int s = 0; s < STRIPS; s++)
+		CHECK(shards.getBinState(s)[0].curve == steep.table, "strip %d kept its old curve", s);
+
+	// bins across every seam through rising, falling and gliding frames:
+	// only the pixels either side of a seam may fade differently
+	DisplayBin crossing[BINS];
+	makeBins(crossing);
+	for(int i = 0; i < BINS; i++) {
+		crossing[i].startLEDNum = 10 + i * 19;
+		crossing[i].endLEDNum = 10 + (i + 1) * 19;
+	}
+	static LEDStripAudioRenderer<BINS, LEDS> wholeStrip;
+	static ShardedRenderer<BINS, STRIPS, PER_STRIP> strips;
+	static CRGB wholeLeds[LEDS], stripLeds[LEDS];
+	draw(wholeStrip, wholeLeds, crossing);
+	draw(strips, stripLeds, crossing);
+	int away = 0;
+	for(int i = 0; i < LEDS; i++) {
+		int offset = Map::offset(i);
+		bool seam = offset == 0 || offset == PER_STRIP - 1;
+		const CRGB & a = wholeLeds[i];
+		const CRGB & b = stripLeds[i];
+		away += !seam && (a.r != b.r || a.g != b.g || a.b != b.b);
+	}
+	CHECK(away == 0, "%d pixels away from the seams differ from one bar", away);
+}
+
+// A renderer of one strip given the whole array keeps to its strip
+void testLongerThanMax() {
+	DisplayBin bins[1];
+	bins[0].startFFTBin = 0;
+	bins[0].endFFTBin = 1;
+	bins[0].startLEDNum = 0;
+	bins[0].endLEDNum = LEDS;
+	bins[0].displayFunction = DisplayFunction::Lin;
+	bins[0].weighting = BinWeighting::Flat;
+	static CRGB leds[LEDS];
+	static LEDStripAudioRenderer<1, PER_STRIP> strip;
+	virtualClock.setMicros(0);
+	strip.init(leds, LEDS, bins);
+	FFTBinData<1> data;
+	memset(&data, 0, sizeof(data));
+	data.binValues[0] = 255;
+	virtualClock.advanceMicros(10000);
+	strip.update(&data);
+	CHECK(lit(leds, 0, PER_STRIP) > 0, "the strip is dark");
+	CHECK(lit(leds, PER_STRIP, LEDS) == 0, "%d pixels lit past MAX_LEDS", lit(leds, PER_STRIP, LEDS));
+}
+
+void testParallelWireTime() {
+	CHECK(ws2811Micros(LEDS, STRIPS) == ws2811Micros(PER_STRIP), "%u us for %d strips of %d, %u for one",
+		ws2811Micros(LEDS, STRIPS), STRIPS, PER_STRIP, ws2811Micros(PER_STRIP));
+	FastLEDSink one, four(STRIPS);
+	CHECK(four.transferMicros(LEDS) * 3 < one.transferMicros(LEDS), "%u us on 4 strips, %u on one",
+		four.transferMicros(LEDS), one.transferMicros(LEDS));
+}
+
+void testVisualizer() {
+	static CRGB leds[LEDS];
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<LEDS, BINS, AudioAnalyzeFFT1024, 0, STRIPS> visualizer(fft);
+	fft.synthesize(64);
+	fft.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	virtualClock.setMicros(0);
+	visualizer.init(leds);
+	for(int t = 0; t < 1000; t++) {
+		virtualClock.advanceMicros(1000);
+		visualizer.update();
+	}
+	CHECK(lit(leds, 0, LEDS) > 0, "the sharded visualizer is dark");
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	testMatchesSingleRenderer();
+	testCrossingBin();
+	testLongerThanMax();
+	testParallelWireTime();
+	testVisualizer();
+
+	return testResult();
+}
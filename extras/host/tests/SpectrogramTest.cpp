@@ -0,0 +1,137 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Feeds a SpectrogramRenderer frames and checks that each one writes a
+// single row, that the rows come out oldest first through the frame
+// buffer's rotated copy and through copyTo(), and that a serpentine copy
+// reverses every other row.
+
+#include "AudioVisualizer.h"
+#include "SpectrogramRenderer.h"
+#include "HostTest.h"
+
+namespace {
+
+const int BINS = 8;
+const int ROWS = 6;
+
+typedef SpectrogramRenderer<BINS, ROWS> Spectrogram;
+
+bool same(const CRGB & a, const CRGB & b) {
+	return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+// Frame f lights only bin f % BINS, so every row is told apart by its column
+FFTBinData<BINS> frame(int f) {
+	FFTBinData<BINS> data;
+	memset(&data, 0, sizeof(data));
+	data.binValues[f % BINS] = 255;
+	return data;
+}
+
+int litColumn(const CRGB * row) {
+	int column = -1;
+	for(int x = 0; x < BINS; x++) {
+		if(row[x].r || row[x].g || row[x].b) {
+			if(column >= 0)
+				return -2;
+			column = x;
+		}
+	}
+	return column;
+}
+
+void testOneRowPerFrame() {
+	static CRGB leds[Spectrogram::NUM_LEDS];
+	Spectrogram spectrogram;
+	spectrogram.init(leds);
+	for(int f = 0; f < ROWS * 2 + 3; f++) {
+		CRGB before[Spectrogram::NUM_LEDS];
+		memcpy(before, leds, sizeof(leds));
+		int row = spectrogram.getRowOffset();
+		FFTBinData<BINS> data = frame(f);
+		spectrogram.update(&data);
+		int changed = 0, outside = 0;
+		for(int i = 0; i < Spectrogram::NUM_LEDS; i++) {
+			if(!same(before[i], leds[i])) {
+				changed++;
+				outside += i / BINS != row;
+			}
+		}
+		CHECK(outside == 0, "frame %d changed %d pixels outside row %d", f, outside, row);
+		CHECK(changed > 0 || f < ROWS, "frame %d changed nothing", f);
+	}
+	CHECK(spectrogram.getRows() == ROWS, "%d rows after %d frames", spectrogram.getRows(), ROWS * 2 + 3);
+	int row = spectrogram.getRowOffset();
+	spectrogram.update(NULL);
+	CHECK(spectrogram.getRowOffset() == row, "an update without a frame scrolled");
+}
+
+void testOrder() {
+	static CRGB frontCopy[Spectrogram::NUM_LEDS], matrix[Spectrogram::NUM_LEDS], serpentine[Spectrogram::NUM_LEDS];
+	FastLEDSink sink;
+	LEDFrameBuffer<Spectrogram::NUM_LEDS> buffer(sink);
+	Spectrogram spectrogram;
+	spectrogram.init(buffer.back());
+	const int FRAMES = ROWS + 4;
+	for(int f = 0; f < FRAMES; f++) {
+		FFTBinData<BINS> data = frame(f);
+		spectrogram.update(&data);
+	}
+	buffer.show(spectrogram.getPixelOffset());
+	memcpy(frontCopy, buffer.front(), sizeof(frontCopy));
+	spectrogram.copyTo(matrix);
+	spectrogram.copyTo(serpentine, true);
+	for(int y = 0; y < ROWS; y++) {
+		// the oldest row kept is frame FRAMES - ROWS
+		int expected = (FRAMES - ROWS + y) % BINS;
+		int shown = litColumn(frontCopy + y * BINS);
+		CHECK(shown == expected, "row %d shows bin %d through the frame buffer, expected %d", y, shown, expected);
+		shown = litColumn(matrix + y * BINS);
+		CHECK(shown == expected, "row %d shows bin %d through copyTo, expected %d", y, shown, expected);
+		shown = litColumn(serpentine + y * BINS);
+		int flipped = y & 1 ? BINS - 1 - expected : expected;
+		CHECK(shown == flipped, "serpentine row %d shows column %d, expected %d", y, shown, flipped);
+		CHECK(same(spectrogram.pixel(expected, y), matrix[y * BINS + expected]), "pixel() disagrees on row %d", y);
+	}
+}
+
+void testColors() {
+	static CRGB leds[BINS];
+	SpectrogramRenderer<BINS, 1> spectrogram;
+	spectrogram.init(leds);
+	FFTBinData<BINS> data;
+	memset(&data, 0, sizeof(data));
+	data.binValues[1] = 40;
+	data.binValues[2] = 255;
+	spectrogram.update(&data);
+	CHECK(!leds[0].r && !leds[0].g && !leds[0].b, "a silent bin is lit");
+	CHECK(leds[1].b > leds[1].r, "a quiet bin is not blue: %u %u %u", leds[1].r, leds[1].g, leds[1].b);
+	CHECK(leds[2].r > leds[2].b && leds[2].r > leds[2].g, "a loud bin is not red: %u %u %u", leds[2].r, leds[2].g,
+		leds[2].b);
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	testOneRowPerFrame();
+	testOrder();
+	testColors();
+
+	return testResult();
+}
@@ -0,0 +1,313 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks that the telemetry ring drops whole records when full and counts
+// them, sends no more than the port takes, and that the decoder gets the
+// records back, finds them after garbage and sees gaps in the sequence.
+// Then streams a visualizer through a slow port and decodes what came out,
+// and one whose analysis runs on a thread of its own.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "AudioVisualizer.h"
+#include "TelemetryDecoder.h"
+#include "HostTest.h"
+
+namespace {
+
+VirtualClock virtualClock;
+
+// A port that takes space bytes per drain
+struct BytePort {
+	std::vector<uint8_t> bytes;
+	int space;
+
+	BytePort(int space) : space(space) {
+	}
+
+	int availableForWrite() {
+		return space;
+	}
+
+	size_t write(const uint8_t * data, size_t length) {
+		bytes.insert(bytes.end(), data, data + length);
+		return length;
+	}
+};
+
+void writeCounted(TelemetryRing & ring, uint8_t n) {
+	TelemetryFields fields;
+	fields.u32(0x01020304 * n).u8(n);
+	const uint8_t tail[3] = {n, (uint8_t)(n + 1), TELEMETRY_SYNC0};
+	ring.write(TelemetryStats, fields.data(), fields.size(), tail, sizeof(tail));
+}
+
+void testRing() {
+	Telemetry<64> ring;
+	// 7 + 8 + 1 bytes a record, so four fit
+	for(int i = 0; i < 6; i++)
+		writeCounted(ring, i);
+	CHECK(ring.getRecords() == 4 && ring.getDropped() == 2, "%u written, %u dropped", ring.getRecords(),
+		ring.getDropped());
+	CHECK(ring.pending() == 64 && ring.getDroppedBytes() == 32, "%u pending, %u bytes dropped", ring.pending(),
+		ring.getDroppedBytes());
+
+	// a stalled port takes nothing, and a slow one a little at a time
+	BytePort port(0);
+	CHECK(ring.drain(port) == 0 && port.bytes.empty(), "sent to a full port");
+	port.space = 20;
+	CHECK(ring.drain(port) == 20 && port.bytes.size() == 20, "sent %d bytes with room for 20", (int)port.bytes.size());
+	CHECK(ring.pending() == 44, "%u pending", ring.pending());
+	// the freed room takes a record, wrapping around the end of the storage
+	writeCounted(ring, 6);
+	CHECK(ring.getRecords() == 4 + 1, "a record did not fit in freed room");
+	port.space = 1000;
+	ring.drain(port);
+	CHECK(ring.pending() == 0 && port.bytes.size() == 80, "%u pending, %d sent", ring.pending(), (int)port.bytes.size());
+
+	TelemetryDecoder decoder;
+	decoder.feed(&port.bytes[0], port.bytes.size());
+	TelemetryDecoder::Record record;
+	const uint8_t expected[5] = {0, 1, 2, 3, 6};
+	for(int i = 0; i < 5; i++) {
+		CHECK(decoder.next(record), "record %d missing", i);
+		uint8_t n = expected[i];
+		CHECK(record.type == TelemetryStats && record.sequence == n && record.payload.size() == 8,
+			"record %d: type %u, sequence %u, %d bytes", i, record.type, record.sequence, (int)record.payload.size());
+		CHECK(record.u32(0) == 0x01020304u * n && record.u8(4) == n && record.u8(5) == n && record.u8(6) == n + 1 &&
+			record.u8(7) == TELEMETRY_SYNC0, "record %d payload differs", i);
+	}
+	CHECK(!decoder.next(record), "an extra record");
+	// 4 and 5 were dropped
+	CHECK(decoder.getRecords() == 5 && decoder.getMissing() == 2, "%u records, %u missing", decoder.getRecords(),
+		decoder.getMissing());
+	CHECK(decoder.getSkipped() == 0 && decoder.getBadSums() == 0, "%u skipped, %u bad sums", decoder.getSkipped(),
+		decoder.getBadSums());
+}
+
+void testResync() {
+	Telemetry<256> ring;
+	for(int i = 0; i < 4; i++)
+		writeCounted(ring, i);
+	BytePort port(1000);
+	ring.drain(port);
+
+	// text before the stream, a false sync, a record cut short and a corrupt one
+	std::vector<uint8_t> stream;
+	const char * text = "DC Offset: 512\r\n";
+	stream.insert(stream.end(), text, text + strlen(text));
+	stream.push_back(TELEMETRY_SYNC0);
+	stream.push_back(TELEMETRY_SYNC1);
+	stream.push_back(0x7F);
+	stream.insert(stream.end(), port.bytes.begin(), port.bytes.begin() + 16);
+	stream.insert(stream.end(), port.bytes.begin() + 16, port.bytes.begin() + 25);
+	stream.insert(stream.end(), port.bytes.begin() + 32, port.bytes.end());
+	stream[stream.size() - 3] ^= 0x40;
+
+	// fed a few bytes at a time, as off the port
+	TelemetryDecoder decoder;
+	std::vector<uint16_t> sequences;
+	TelemetryDecoder::Record record;
+	for(size_t i = 0; i < stream.size(); i += 5) {
+		decoder.feed(&stream[i], min((size_t)5, stream.size() - i));
+		while(decoder.next(record))
+			sequences.push_back(record.sequence);
+	}
+	CHECK(sequences.size() == 2 && sequences[0] == 0 && sequences[1] == 2, "found %d records, first %d",
+		(int)sequences.size(), sequences.empty() ? -1 : sequences[0]);
+	CHECK(decoder.getMissing() == 1, "%u missing", decoder.getMissing());
+	CHECK(decoder.getSkipped() > strlen(text), "%u bytes skipped", decoder.getSkipped());
+}
+
+void testSequenceWrap() {
+	Telemetry<64> ring;
+	BytePort port(1000);
+	TelemetryDecoder decoder;
+	TelemetryDecoder::Record record;
+	int found = 0;
+	// past 65535, and every 1000th record lost
+	for(int i = 0; i < 70001; i++) {
+		if(i % 1000 == 999) {
+			ring.write(TelemetryStats, NULL, 0);
+			ring.drain(port);
+			port.bytes.clear();
+			continue;
+		}
+		ring.write(TelemetryStats, NULL, 0);
+		ring.drain(port);
+		decoder.feed(&port.bytes[0], port.bytes.size());
+		port.bytes.clear();
+		while(decoder.next(record))
+			found++;
+	}
+	CHECK(found == 70001 - 70, "found %d", found);
+	CHECK(decoder.getMissing() == 70, "%u missing", decoder.getMissing());
+}
+
+void testVisualizer() {
+	static CRGB leds[168];
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<168, 8> visualizer(fft);
+	static Telemetry<2048> telemetry;
+	fft.synthesize(64);
+	fft.setFrameInterval(AudioAnalyzeFFT1024::FRAME_MICROS);
+	virtualClock.setMicros(0);
+	visualizer.init(leds);
+	visualizer.setFrameRate(60);
+	visualizer.setTelemetry(&telemetry, TELEMETRY_ALL);
+
+	// a port of 50 bytes a millisecond can't keep up with the spectra
+	FILE * out = tmpfile();
+	Serial.setOutput(out);
+	Serial.setWriteSpace(50);
+	int frames = 0;
+	for(int t = 0; t < 1000; t++) {
+		virtualClock.advanceMicros(1000);
+		frames += visualizer.update();
+	}
+	CHECK(frames > 50, "%d frames", frames);
+	CHECK(telemetry.getDropped() > 0, "nothing dropped on a slow port");
+	uint32_t records = telemetry.getRecords();
+
+	// 't' stops the stream
+	visualizer.enableSerialCommands();
+	Serial.inject("t");
+	for(int t = 0; t < 100; t++) {
+		virtualClock.advanceMicros(1000);
+		visualizer.update();
+	}
+	CHECK(telemetry.getRecords() == records, "%u records written after 't'", telemetry.getRecords() - records);
+	Serial.setOutput(NULL);
+	Serial.setWriteSpace(4096);
+
+	std::vector<uint8_t> bytes;
+	rewind(out);
+	uint8_t chunk[4096];
+	size_t read;
+	while((read = fread(chunk, 1, sizeof(chunk), out)) > 0)
+		bytes.insert(bytes.end(), chunk, chunk + read);
+	fclose(out);
+	CHECK(bytes.size() <= 1100 * 50, "%d bytes sent in 1100 updates", (int)bytes.size());
+
+	TelemetryDecoder decoder;
+	decoder.feed(&bytes[0], bytes.size());
+	TelemetryDecoder::Record record;
+	int counts[TelemetryStats + 1] = {0};
+	bool valid = true;
+	uint32_t lastFrames = 0;
+	while(decoder.next(record)) {
+		counts[record.type]++;
+		if(record.type == TelemetrySpectrum)
+			valid &= record.u16(4) == 512 && record.payload.size() == 6 + 1024;
+		else if(record.type == TelemetryBins)
+			valid &= record.u8(4) == 0 && record.u8(5) == 8 && record.payload.size() == 11 + 8;
+		else if(record.type == TelemetryScale)
+			valid &= record.u16(4) == 8 && record.payload.size() == 6 + 2 * 8 * 4 && record.u32(6 + 8 * 4) >= SCALE_ONE;
+		else if(record.type == TelemetryStats) {
+			valid &= record.payload.size() == 24 && record.u32(4) > lastFrames;
+			lastFrames = record.u32(4);
+		}
+	}
+	CHECK(valid, "a record's fields are wrong");
+	CHECK(decoder.getSkipped() == 0 && decoder.getBadSums() == 0, "%u skipped, %u bad sums", decoder.getSkipped(),
+		decoder.getBadSums());
+	CHECK(counts[TelemetryBins] > 0 && counts[TelemetryScale] > 0 && counts[TelemetryStats] > 0 &&
+		counts[TelemetrySpectrum] > 0, "records missing: %d spectra, %d bins, %d scales, %d stats",
+		counts[TelemetrySpectrum], counts[TelemetryBins], counts[TelemetryScale], counts[TelemetryStats]);
+	// the rest drained after 't', and only the dropped records are missing
+	CHECK(decoder.getRecords() == records && decoder.getMissing() > 0 && decoder.getMissing() <= telemetry.getDropped(),
+		"%u decoded and %u missing of %u written, %u dropped", decoder.getRecords(), decoder.getMissing(), records,
+		telemetry.getDropped());
+}
+
+// The analysis queues its frames and writes its records from a thread of
+// its own while loop() draws and drains: the ring keeps one writer, so
+// every record comes out whole and there are no stats.
+void testQueued() {
+	static CRGB leds[168];
+	static AudioAnalyzeFFT1024 fft;
+	static AudioVisualizer<168, 8> visualizer(fft);
+	static Telemetry<4096> telemetry;
+	fft.synthesize(64);
+	fft.setFrameInterval(0);
+	virtualClock.setMicros(0);
+	visualizer.init(leds);
+	visualizer.processor.setQueued(true);
+	visualizer.setTelemetry(&telemetry, TELEMETRY_ALL);
+
+	FILE * out = tmpfile();
+	Serial.setOutput(out);
+	const int FRAMES = 3000;
+	std::atomic<bool> done(false);
+	std::thread analysis([&]() {
+		for(int i = 0; i < FRAMES; i++) {
+			virtualClock.advanceMicros(AudioAnalyzeFFT1024::FRAME_MICROS);
+			visualizer.processor.analyzeData();
+			if(i % 3 == 0)
+				std::this_thread::yield();
+		}
+		done = true;
+	});
+	int drawn = 0;
+	while(!done)
+		drawn += visualizer.update();
+	analysis.join();
+	while(telemetry.pending() > 0)
+		visualizer.update();
+	Serial.setOutput(NULL);
+	visualizer.setTelemetry(NULL);
+	visualizer.processor.setQueued(false);
+
+	std::vector<uint8_t> bytes;
+	rewind(out);
+	uint8_t chunk[4096];
+	size_t read;
+	while((read = fread(chunk, 1, sizeof(chunk), out)) > 0)
+		bytes.insert(bytes.end(), chunk, chunk + read);
+	fclose(out);
+
+	TelemetryDecoder decoder(2048);
+	decoder.feed(&bytes[0], bytes.size());
+	TelemetryDecoder::Record record;
+	int counts[TelemetryStats + 1] = {0};
+	while(decoder.next(record))
+		counts[record.type]++;
+	CHECK(drawn > 0, "nothing drawn");
+	CHECK(decoder.getSkipped() == 0 && decoder.getBadSums() == 0, "%u skipped, %u bad sums", decoder.getSkipped(),
+		decoder.getBadSums());
+	CHECK(counts[TelemetryStats] == 0, "%d stats records from a queued visualizer", counts[TelemetryStats]);
+	CHECK(decoder.getRecords() == telemetry.getRecords() && decoder.getMissing() <= telemetry.getDropped(),
+		"%u decoded and %u missing of %u written, %u dropped", decoder.getRecords(), decoder.getMissing(),
+		telemetry.getRecords(), telemetry.getDropped());
+	CHECK(counts[TelemetryBins] + (int)telemetry.getDropped() >= FRAMES / 2, "%d bins records of %d frames",
+		counts[TelemetryBins], FRAMES);
+}
+
+}
+
+int main() {
+	HostClock::install(&virtualClock);
+	Serial.setOutput(NULL);
+
+	testRing();
+	testResync();
+	testSequenceWrap();
+	testVisualizer();
+	testQueued();
+
+	return testResult();
+}
@@ -0,0 +1,123 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks the built-in curve tables against the runtime applyFunction() they
+// replaced, normalized to its value at 255 as the renderer did; that gamma
+// and S-curves rise from 0 to full scale without dipping; and that
+// piecewise curves interpolate their points and hold flat past the ends.
+
+#include <math.h>
+#include "AudioVisualizer.h"
+#include "HostTest.h"
+
+namespace {
+
+// the display functions as the renderer applied them each frame
+float applyFunction(DisplayFunction f, uint16_t value) {
+	switch(f) {
+	case DisplayFunction::Log:
+		return log(value);
+	case DisplayFunction::Sq:
+		return pow(value, 2);
+	case DisplayFunction::Sqrt:
+		return sqrt(value);
+	case DisplayFunction::Lin:
+	default:
+		return value;
+	}
+}
+
+// the table entry for value, allowing for float rounding in the reference
+void checkBuiltin(const char * name, DisplayFunction f) {
+	const TransferCurve & curve = transferCurve(f);
+	CHECK(curve[0] == 0, "%s: 0 maps to %u", name, curve[0]);
+	for(int x = 1; x < 256; x++) {
+		double expected = applyFunction(f, x) / applyFunction(f, 255) * 65535.0;
+		CHECK(fabs(curve[x] - expected) <= 2.0, "%s: %d maps to %u, expected %.1f", name, x, curve[x],
+			expected);
+	}
+}
+
+void checkRising(const char * name, const TransferCurve & curve) {
+	CHECK(curve[0] == 0, "%s: 0 maps to %u", name, curve[0]);
+	CHECK(curve[255] == 65535, "%s: 255 maps to %u", name, curve[255]);
+	for(int x = 1; x < 256; x++)
+		CHECK(curve[x] >= curve[x - 1], "%s: falls from %u to %u at %d", name, curve[x - 1], curve[x], x);
+}
+
+void checkGamma() {
+	checkRising("gamma 2.2", TransferCurve::gamma(2.2));
+	checkRising("gamma 0.5", TransferCurve::gamma(0.5));
+	// gamma above 1 sags below the diagonal, below 1 bulges above it
+	CHECK(TransferCurve::gamma(2.2)[128] < 32768, "gamma 2.2: midpoint %u", TransferCurve::gamma(2.2)[128]);
+	CHECK(TransferCurve::gamma(0.5)[128] > 32768, "gamma 0.5: midpoint %u", TransferCurve::gamma(0.5)[128]);
+	// gamma 1 is the straight line
+	const TransferCurve & lin = transferCurve(DisplayFunction::Lin);
+	TransferCurve one = TransferCurve::gamma(1.0);
+	for(int x = 0; x < 256; x++)
+		CHECK(one[x] == lin[x], "gamma 1: %d maps to %u, Lin to %u", x, one[x], lin[x]);
+}
+
+void checkSCurve() {
+	TransferCurve s = TransferCurve::sCurve(8.0);
+	checkRising("sCurve 8", s);
+	checkRising("sCurve 4 at 64", TransferCurve::sCurve(4.0, 64));
+	// half way at the midpoint, steepest around it and flat at the ends
+	CHECK(abs((int)s[128] - 32768) < 400, "sCurve 8: midpoint %u", s[128]);
+	CHECK(s[129] - s[127] > s[2] - s[0] && s[129] - s[127] > s[255] - s[253],
+		"sCurve 8: not steepest in the middle");
+	CHECK(s[64] < 64 * 257 && s[192] > 192 * 257, "sCurve 8: %u at 64, %u at 192", s[64], s[192]);
+}
+
+void checkPiecewise() {
+	const uint8_t x[] = {32, 128, 224};
+	const uint8_t y[] = {16, 200, 240};
+	TransferCurve c = TransferCurve::piecewise(x, y, 3);
+	// flat below the first point and above the last
+	for(int v = 0; v <= 32; v++)
+		CHECK(c[v] == 16 * 257, "piecewise: %d maps to %u below the first point", v, c[v]);
+	for(int v = 224; v < 256; v++)
+		CHECK(c[v] == 240 * 257, "piecewise: %d maps to %u above the last point", v, c[v]);
+	// through each point, and straight between them
+	CHECK(c[128] == 200 * 257, "piecewise: 128 maps to %u", c[128]);
+	CHECK(c[80] == (uint16_t)((16 + 184 / 2.0) * 257 + 0.5), "piecewise: 80 maps to %u", c[80]);
+	CHECK(c[176] == (uint16_t)((200 + 40 / 2.0) * 257 + 0.5), "piecewise: 176 maps to %u", c[176]);
+	const uint8_t ends[] = {0, 255};
+	checkRising("piecewise 0 to 255", TransferCurve::piecewise(ends, ends, 2));
+
+	// a single point is flat everywhere
+	const uint8_t px[] = {100};
+	const uint8_t py[] = {50};
+	TransferCurve flat = TransferCurve::piecewise(px, py, 1);
+	for(int v = 0; v < 256; v++)
+		CHECK(flat[v] == 50 * 257, "piecewise one point: %d maps to %u", v, flat[v]);
+}
+
+}
+
+int main() {
+	Serial.setOutput(NULL);
+
+	checkBuiltin("Log", DisplayFunction::Log);
+	checkBuiltin("Sq", DisplayFunction::Sq);
+	checkBuiltin("Sqrt", DisplayFunction::Sqrt);
+	checkBuiltin("Lin", DisplayFunction::Lin);
+	checkGamma();
+	checkSCurve();
+	checkPiecewise();
+
+	return testResult();
+}
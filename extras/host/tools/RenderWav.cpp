@@ -0,0 +1,197 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Renders a WAV file through the device pipeline (see OfflineRenderer.h)
+// with one or more sets of parameters, on as many threads as there are
+// cores, to compare settings for a venue without flashing and listening.
+//
+//   RenderWav [-j threads] [-r fps] [-f ppm,raw] [-o dir] [-p sets.txt] [-s "set"]... song.wav
+//
+// Each set is a line of key=value pairs over the defaults, e.g.
+//
+//   name=club leds=240 bins=8 layout=mel speed=2000,11000,10000 sweep=160,224,240
+//   name=bar leds=168 bins=3 fft=0-3,3-10,10-41 split=72,24,72 function=sqrt fps=120
+//
+// Keys: name, leds, bins (3, 4, 6, 8, 12 or 16), layout (octave, linear,
+// mel), fft (start-end FFT bins of each display bin), split (LEDs of each
+// display bin), function (lin, log, sq, sqrt), weighting (flat, triangle,
+// mel, bark), speed (edge fade, new value fade, sweep time, as
+// setSpeed()), sweep (start hue, end hue[, saturation][,reverse]), beat
+// (beat hue step), scale (manual scale, or -1 for autoscale), gain
+// (autoscale attack and release, ms), target (the bin value autoscale
+// aims for), uniform (0 or 1), fps (the
+// RenderScheduler's rate, 0 to draw on every analysis frame) and loop
+// (microseconds a loop() takes).
+//
+// -p reads sets from a file, a line each; -s adds one from the command
+// line. With neither, the defaults are rendered as one set. Each set
+// writes dir/<name>.ppm, the strip one row a frame from the top down, and
+// dir/<name>.raw, the frames' RGB bytes back to back, as -f asks.
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "OfflineRenderer.h"
+
+namespace {
+
+struct Job {
+	RenderParams params;
+	int frames;
+	double seconds;
+	std::string error;
+
+	Job() : frames(0), seconds(0) {
+	}
+};
+
+void usage() {
+	fprintf(stderr, "usage: RenderWav [-j threads] [-r fps] [-f ppm,raw] [-o dir] [-p sets.txt] [-s \"set\"]... song.wav\n");
+}
+
+bool writeFile(const std::string & path, const std::string & header, const std::vector<uint8_t> & bytes) {
+	FILE * f = fopen(path.c_str(), "wb");
+	if(f == NULL)
+		return false;
+	bool ok = fwrite(header.data(), 1, header.size(), f) == header.size();
+	if(!bytes.empty())
+		ok &= fwrite(&bytes[0], 1, bytes.size(), f) == bytes.size();
+	return fclose(f) == 0 && ok;
+}
+
+}
+
+int main(int argc, char ** argv) {
+	int threads = std::thread::hardware_concurrency();
+	int fps = 60;
+	std::string formats = "ppm";
+	std::string directory = ".";
+	const char * wavPath = NULL;
+	std::vector<Job> jobs;
+	std::string error;
+
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+		if(arg == "-j" && value)
+			threads = atoi(argv[++i]);
+		else if(arg == "-r" && value)
+			fps = atoi(argv[++i]);
+		else if(arg == "-f" && value)
+			formats = argv[++i];
+		else if(arg == "-o" && value)
+			directory = argv[++i];
+		else if(arg == "-s" && value) {
+			Job job;
+			if(!job.params.parse(argv[++i], error)) {
+				fprintf(stderr, "-s %s: %s\n", argv[i], error.c_str());
+				return 2;
+			}
+			jobs.push_back(job);
+		}
+		else if(arg == "-p" && value) {
+			FILE * f = fopen(argv[++i], "r");
+			if(f == NULL) {
+				perror(argv[i]);
+				return 1;
+			}
+			char line[1024];
+			for(int number = 1; fgets(line, sizeof(line), f); number++) {
+				Job job;
+				if(!job.params.parse(line, error)) {
+					fprintf(stderr, "%s:%d: %s\n", argv[i], number, error.c_str());
+					return 2;
+				}
+				// blank and comment lines
+				if(strspn(line, " \t\r\n") == strlen(line) || line[strspn(line, " \t")] == '#')
+					continue;
+				jobs.push_back(job);
+			}
+			fclose(f);
+		}
+		else if(arg[0] != '-' && wavPath == NULL)
+			wavPath = argv[i];
+		else {
+			usage();
+			return 2;
+		}
+	}
+	if(wavPath == NULL || fps <= 0) {
+		usage();
+		return 2;
+	}
+	if(jobs.empty())
+		jobs.push_back(Job());
+	for(size_t i = 0; i < jobs.size(); i++) {
+		if(jobs[i].params.name.empty())
+			jobs[i].params.name = "set" + std::to_string(i + 1);
+	}
+
+	WavAudio audio;
+	if(!loadWav(wavPath, audio, error)) {
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	const double audioSeconds = audio.durationMicros() / 1000000.0;
+	const bool ppm = formats.find("ppm") != std::string::npos;
+	const bool raw = formats.find("raw") != std::string::npos;
+
+	// each thread takes the next set until none are left
+	std::atomic<size_t> next(0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	auto work = [&]() {
+		for(size_t i = next++; i < jobs.size(); i = next++) {
+			Job & job = jobs[i];
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			std::vector<uint8_t> pixels;
+			job.frames = renderOffline(audio, job.params, fps, pixels);
+			job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			std::string path = directory + "/" + job.params.name;
+			if(ppm) {
+				std::string header = "P6\n" + std::to_string(job.params.leds) + " " + std::to_string(job.frames) + "\n255\n";
+				if(!writeFile(path + ".ppm", header, pixels))
+					job.error = "can't write " + path + ".ppm";
+			}
+			if(raw && !writeFile(path + ".raw", "", pixels))
+				job.error = "can't write " + path + ".raw";
+		}
+	};
+	std::vector<std::thread> workers;
+	for(int t = 1; t < min(threads, (int)jobs.size()); t++)
+		workers.push_back(std::thread(work));
+	work();
+	for(size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%-20s %5s %4s %8s %9s %9s\n", "set", "leds", "bins", "frames", "seconds", "realtime");
+	int failed = 0;
+	for(size_t i = 0; i < jobs.size(); i++) {
+		const Job & job = jobs[i];
+		printf("%-20s %5d %4d %8d %9.2f %8.1fx", job.params.name.c_str(), job.params.leds, job.params.bins, job.frames,
+			job.seconds, job.seconds > 0 ? audioSeconds / job.seconds : 0.0);
+		if(!job.error.empty()) {
+			printf("  %s", job.error.c_str());
+			failed++;
+		}
+		printf("\n");
+	}
+	printf("%.1fs of audio, %d sets in %.2fs on %d threads\n", audioSeconds, (int)jobs.size(), elapsed,
+		(int)workers.size() + 1);
+	return failed ? 1 : 0;
+}
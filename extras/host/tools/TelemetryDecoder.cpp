@@ -0,0 +1,174 @@
+/*
+Copyright 2015 Jeff Hamm <jeff.hamm@gmail.com>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Turns a telemetry capture (see Telemetry.h) into CSV, for a spreadsheet
+// or gnuplot. Capture the port with anything that saves raw bytes, e.g.
+//
+//   stty -F /dev/ttyACM0 raw && cat /dev/ttyACM0 > capture.bin
+//   TelemetryDecoder capture.bin > all.csv
+//   TelemetryDecoder -o show capture.bin
+//
+// With no file it reads stdin, so it can follow the port live. Every
+// record goes to stdout as a line starting with its type and sequence
+// number, or with -o prefix each type goes to prefix-<type>.csv with a
+// header row. What was skipped and missing is printed to stderr at the end.
+//
+//   TelemetryDecoder [-o prefix] [capture.bin]
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "TelemetryDecoder.h"
+
+namespace {
+
+// The CSV for each record type, stdout for all of them without -o
+FILE * outputs[TelemetryStats + 1];
+
+FILE * output(uint8_t type) {
+	return type <= TelemetryStats ? outputs[type] : NULL;
+}
+
+void header(FILE * f, uint8_t type) {
+	switch(type) {
+	case TelemetrySpectrum:
+		fprintf(f, "sequence,micros,bins,values...\n");
+		break;
+	case TelemetryBins:
+		fprintf(f, "sequence,micros,output,bins,peak,onset,beat,onset_strength,beat_phase,tempo,values...\n");
+		break;
+	case TelemetryScale:
+		fprintf(f, "sequence,micros,sums,sum...,scale...\n");
+		break;
+	case TelemetryStats:
+		fprintf(f, "sequence,micros,frames,skipped,overruns,drops,telemetry_dropped\n");
+		break;
+	}
+}
+
+void write(const TelemetryDecoder::Record & record, bool labeled) {
+	FILE * f = output(record.type);
+	if(f == NULL)
+		return;
+	const size_t size = record.payload.size();
+	if(labeled)
+		fprintf(f, "%s,", TelemetryDecoder::name(record.type));
+	fprintf(f, "%u", record.sequence);
+	switch(record.type) {
+	case TelemetrySpectrum: {
+		if(size < 6)
+			break;
+		uint16_t bins = record.u16(4);
+		fprintf(f, ",%u,%u", record.u32(0), bins);
+		for(size_t i = 0; i < bins && 6 + 2 * i + 1 < size; i++)
+			fprintf(f, ",%u", record.u16(6 + 2 * i));
+		break;
+	}
+	case TelemetryBins: {
+		if(size < 11)
+			break;
+		uint8_t flags = record.u8(7);
+		fprintf(f, ",%u,%u,%u,%u,%u,%u,%u,%u,%u", record.u32(0), record.u8(4), record.u8(5), record.u8(6),
+			flags & 1, (flags >> 1) & 1, record.u8(8), record.u8(9), record.u8(10));
+		for(size_t i = 11; i < size; i++)
+			fprintf(f, ",%u", record.u8(i));
+		break;
+	}
+	case TelemetryScale: {
+		if(size < 6)
+			break;
+		uint16_t count = record.u16(4);
+		fprintf(f, ",%u,%u", record.u32(0), count);
+		// the sums, then the scales in Q8.8 as decimals
+		for(size_t i = 0; i < count && 6 + 4 * i + 3 < size; i++)
+			fprintf(f, ",%u", record.u32(6 + 4 * i));
+		for(size_t i = count; i < 2 * (size_t)count && 6 + 4 * i + 3 < size; i++)
+			fprintf(f, ",%.3f", record.u32(6 + 4 * i) / 256.0);
+		break;
+	}
+	case TelemetryStats:
+		for(size_t i = 0; i + 3 < size; i += 4)
+			fprintf(f, ",%u", record.u32(i));
+		break;
+	}
+	fprintf(f, "\n");
+}
+
+void usage() {
+	fprintf(stderr, "usage: TelemetryDecoder [-o prefix] [capture.bin]\n");
+}
+
+}
+
+int main(int argc, char ** argv) {
+	const char * prefix = NULL;
+	const char * path = NULL;
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-o") && i + 1 < argc)
+			prefix = argv[++i];
+		else if(argv[i][0] == '-' && argv[i][1] != 0) {
+			usage();
+			return 2;
+		}
+		else
+			path = argv[i];
+	}
+
+	FILE * in = stdin;
+	if(path != NULL && strcmp(path, "-")) {
+		in = fopen(path, "rb");
+		if(in == NULL) {
+			perror(path);
+			return 1;
+		}
+	}
+
+	for(int type = TelemetrySpectrum; type <= TelemetryStats; type++) {
+		if(prefix == NULL) {
+			outputs[type] = stdout;
+			continue;
+		}
+		std::string name = std::string(prefix) + "-" + TelemetryDecoder::name(type) + ".csv";
+		outputs[type] = fopen(name.c_str(), "w");
+		if(outputs[type] == NULL) {
+			perror(name.c_str());
+			return 1;
+		}
+		header(outputs[type], type);
+	}
+
+	TelemetryDecoder decoder;
+	TelemetryDecoder::Record record;
+	uint8_t chunk[4096];
+	size_t read;
+	while((read = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+		decoder.feed(chunk, read);
+		while(decoder.next(record))
+			write(record, prefix == NULL);
+		if(prefix == NULL)
+			fflush(stdout);
+	}
+
+	if(in != stdin)
+		fclose(in);
+	if(prefix != NULL) {
+		for(int type = TelemetrySpectrum; type <= TelemetryStats; type++)
+			fclose(outputs[type]);
+	}
+	fprintf(stderr, "%u records, %u missing, %u bytes skipped, %u bad sums\n", decoder.getRecords(),
+		decoder.getMissing(), decoder.getSkipped(), decoder.getBadSums());
+	return 0;
+}